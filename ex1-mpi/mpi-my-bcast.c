@@ -16,34 +16,94 @@
  *
  * --------------------------------------------------------------------------
  *
+ * my_Bcast() is implemented in my-bcast.h. This program checks that
+ * it works for every algorithm, root, and a few message sizes, then
+ * compares the average time of MPI_Bcast() and my_Bcast() (with the
+ * automatic choice and with each algorithm) for messages from 8 bytes
+ * up to |maxbytes| (default 256 MB), growing by a factor of 4.
+ *
  * Compile with
  * mpicc -std=c99 -Wall -Wpedantic mpi-my-bcast.c -o mpi-my-bcast
  *
  * run with:
- * mpirun -n 4 ./mpi-my-bcast
+ * mpirun -n 4 ./mpi-my-bcast [maxbytes]
  *
  ****************************************************************************/
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "my-bcast.h"
 
-void my_Bcast(int *v)
+/* Byte |i| of the message of length |n| sent by |root| */
+char pattern( long i, int n, int root )
 {
-    int my_rank, comm_sz;
-    
+    return (char)(i * 7 + n + root);
+}
+
+/* Broadcast |n| bytes from every root with algorithm |alg|; returns the
+   number of processes that got wrong data (on all processes) */
+int check( int n, mb_alg_t alg )
+{
+    int my_rank, comm_sz, root, errors = 0, total;
+    char *buf = (char*)malloc(n + 1);
+    long i;
+
     MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);    
-    /* [TODO] Complete this function */
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+    for (root=0; root<comm_sz; root++) {
+        int ok = 1;
+        for (i=0; i<n; i++) {
+            buf[i] = (my_rank == root ? pattern(i, n, root) : 0);
+        }
+        my_Bcast_alg(buf, n, MPI_CHAR, root, MPI_COMM_WORLD, alg);
+        for (i=0; i<n; i++) {
+            ok &= (buf[i] == pattern(i, n, root));
+        }
+        errors += !ok;
+    }
+    free(buf);
+    MPI_Allreduce(&errors, &total, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    return total;
 }
 
+/* Average time of |reps| broadcasts of |n| bytes from rank 0, with
+   MPI_Bcast() if |alg| < 0 */
+double bench( char *buf, int n, int reps, int alg )
+{
+    double tstart, elapsed;
+    int r;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    tstart = MPI_Wtime();
+    for (r=0; r<reps; r++) {
+        if ( alg < 0 ) {
+            MPI_Bcast(buf, n, MPI_BYTE, 0, MPI_COMM_WORLD);
+        } else {
+            my_Bcast_alg(buf, n, MPI_BYTE, 0, MPI_COMM_WORLD, (mb_alg_t)alg);
+        }
+    }
+    elapsed = MPI_Wtime() - tstart;
+    /* the broadcast is over when the last process has the data */
+    MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return elapsed / reps;
+}
 
 int main( int argc, char *argv[] )
 {
-    int my_rank;
+    int my_rank, comm_sz;
     int v;
+    long maxbytes = 256*1024*1024;
+    const int sizes[] = { 0, 1, 7, 1000, 65537, 1000003 };
+    int i, alg;
 
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+    if ( argc > 1 ) {
+        maxbytes = atol(argv[1]);
+    }
 
     if ( 0 == my_rank ) {
         v = 999; /* only process 0 sets the value to be sent */
@@ -51,7 +111,7 @@ int main( int argc, char *argv[] )
         v = -1; /* all other processes set v to -1; if everything goes well, the value will be overwritten with the value received from the master */ 
     }
 
-    my_Bcast(&v);
+    my_Bcast(&v, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
     if ( v == 999 ) {
         printf("OK: ");
@@ -60,6 +120,93 @@ int main( int argc, char *argv[] )
     }
     printf("Process %d has %d\n", my_rank, v);
 
+    /* Every algorithm, from every root */
+    for (alg=MB_AUTO; alg<=MB_CHAIN; alg++) {
+        for (i=0; i<(int)(sizeof(sizes)/sizeof(sizes[0])); i++) {
+            const int errors = check(sizes[i], (mb_alg_t)alg);
+            if ( errors && 0 == my_rank ) {
+                printf("ERROR: %s, %d bytes: %d wrong broadcasts\n", mb_names[alg], sizes[i], errors);
+            }
+        }
+    }
+
+    /* A non-contiguous datatype: the first column of a 100x3 matrix */
+    {
+        MPI_Datatype column;
+        int m[100][3], ok = 1, all_ok;
+        MPI_Type_vector(100, 1, 3, MPI_INT, &column);
+        MPI_Type_commit(&column);
+        for (i=0; i<100; i++) {
+            m[i][0] = (0 == my_rank ? i : -1);
+            m[i][1] = m[i][2] = -2;
+        }
+        my_Bcast(m, 1, column, 0, MPI_COMM_WORLD);
+        for (i=0; i<100; i++) {
+            ok &= (m[i][0] == i && m[i][1] == -2 && m[i][2] == -2);
+        }
+        MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if ( 0 == my_rank ) {
+            printf("%s: derived datatype\n", (all_ok ? "OK" : "ERROR"));
+        }
+        MPI_Type_free(&column);
+    }
+
+    /* A resized datatype: one int every two, whose true extent is
+       the same as its size, but whose elements are not adjacent */
+    {
+        MPI_Datatype every_other;
+        int v[200], ok = 1, all_ok;
+        MPI_Type_create_resized(MPI_INT, 0, 2*sizeof(int), &every_other);
+        MPI_Type_commit(&every_other);
+        for (i=0; i<200; i++) {
+            v[i] = (0 == my_rank || i % 2 ? i : -1);
+        }
+        my_Bcast(v, 100, every_other, 0, MPI_COMM_WORLD);
+        for (i=0; i<200; i++) {
+            ok &= (v[i] == i);
+        }
+        MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if ( 0 == my_rank ) {
+            printf("%s: resized datatype\n", (all_ok ? "OK" : "ERROR"));
+        }
+        MPI_Type_free(&every_other);
+    }
+
+    /* Benchmark */
+    {
+        char *buf = (char*)malloc(maxbytes);
+        long n;
+
+        memset(buf, 0, maxbytes);
+        if ( 0 == my_rank ) {
+            printf("\nAverage time (us), %d processes\n", comm_sz);
+            printf("%10s %12s", "bytes", "MPI_Bcast");
+            for (alg=MB_AUTO; alg<=MB_CHAIN; alg++) {
+                printf(" %12.12s", mb_names[alg]);
+            }
+            printf("\n");
+        }
+        for (n = 8; n <= maxbytes; n = (n*4 > maxbytes && n < maxbytes ? maxbytes : n*4)) {
+            const long r = (64L*1024*1024) / n;
+            const int reps = (r < 3 ? 3 : (r > 1000 ? 1000 : r));
+            const double t_mpi = bench(buf, n, reps, -1);
+            if ( 0 == my_rank ) {
+                printf("%10ld %12.2f", n, 1e6 * t_mpi);
+            }
+            for (alg=MB_AUTO; alg<=MB_CHAIN; alg++) {
+                const double t = bench(buf, n, reps, alg);
+                if ( 0 == my_rank ) {
+                    printf(" %12.2f", 1e6 * t);
+                }
+            }
+            if ( 0 == my_rank ) {
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+        free(buf);
+    }
+
     MPI_Finalize();
 
     return 0;
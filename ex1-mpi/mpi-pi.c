@@ -16,35 +16,65 @@
  *
  * --------------------------------------------------------------------------
  *
+ * This program computes the approximate value of PI using a Monte
+ * Carlo method: it generates random points in the unit square, and
+ * counts how many of them fall inside the quarter of circle of
+ * radius 1 centered at the origin. Random numbers are produced by the
+ * counter-based generator of philox.h, with the same batches of
+ * 2*PHILOX_BATCH points used by ex1-openmp/omp-pi.c: process p
+ * handles batches nbatches*p/P, ... nbatches*(p+1)/P - 1 of stream 0,
+ * so that no seeding of the processes is needed, and the result
+ * depends only on npoints and seed (it is the same as omp-pi). The
+ * number of points is a 64-bit integer.
+ *
  * Compile with:
- * mpicc -std=c99 -Wall -Wpedantic mpi-pi.c -lm -o mpi-pi
+ * mpicc -std=c99 -Wall -Wpedantic -O3 -march=native mpi-pi.c -lm -o mpi-pi
  *
  * Run with:
- * mpirun -n 4 ./mpi-pi
+ * mpirun -n 4 ./mpi-pi [npoints [seed]]
  *
  ****************************************************************************/
 #include <mpi.h>
 #include <stdio.h>
-#include <stdlib.h> /* for rand() */
-#include <time.h>   /* for time() */
-#include <math.h>   /* for fabs() */
+#include <stdlib.h>   /* for strtoull() */
+#include <inttypes.h> /* for PRIu64 */
+#include <math.h>     /* for fabs() */
+#include "philox.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-/* Generate |n| random points within the square with corners (-1, -1),
-   (1, 1); return the number of points that fall inside the circle
-   centered ad the origin with radius 1 */
-int generate_points( int n ) 
+/* Number of points generated by one call of philox4x32_batch() */
+#define BATCH (2*PHILOX_BATCH)
+
+/* Return how many of the first |n| points (n <= BATCH) of the batch
+   of random words |r| fall inside the circle. Point k uses words 0
+   and 1 of block k for k < PHILOX_BATCH, words 2 and 3 of block
+   k - PHILOX_BATCH otherwise; coordinates are scaled by 2^-32. */
+int count_inside( const uint32_t *r, int n )
 {
-  int i, n_inside = 0;
-  for (i=0; i<n; i++) {
-    const double x = (rand()/(double)RAND_MAX * 2.0) - 1.0;
-    const double y = (rand()/(double)RAND_MAX * 2.0) - 1.0;
-    if ( x*x + y*y < 1.0 ) {
-      n_inside++;
-    }
+  const double scale = 1.0 / 4294967296.0; /* 2^-32 */
+  int k, n_inside = 0;
+  for (k=0; k<n; k++) {
+    const int w = (k < PHILOX_BATCH ? 0 : 2*PHILOX_BATCH) + k % PHILOX_BATCH;
+    const double x = r[w] * scale, y = r[w + PHILOX_BATCH] * scale;
+    n_inside += ( x*x + y*y <= 1.0 );
+  }
+  return n_inside;
+}
+
+/* Generate the points of batches [bstart, bend) of stream 0 of the
+   generator with key |seed|, out of a total of |n| points; return
+   the number of points that fall inside the circle centered at the
+   origin with radius 1 */
+uint64_t generate_points( uint64_t bstart, uint64_t bend, uint64_t n, uint64_t seed )
+{
+  uint64_t b, n_inside = 0;
+  uint32_t r[4*PHILOX_BATCH];
+  for (b=bstart; b<bend; b++) {
+    philox4x32_batch(seed, 0, b*PHILOX_BATCH, r);
+    n_inside += count_inside(r, (n - b*BATCH < BATCH ? n - b*BATCH : BATCH));
   }
   return n_inside;
 }
@@ -52,53 +82,65 @@ int generate_points( int n )
 int main( int argc, char *argv[] )
 {
   int my_rank, comm_sz;
-  int inside = 0, npoints = 1000000;
+  uint64_t inside = 0, npoints = 1000000, seed = 1;
   double pi_approx;
 
   MPI_Init( &argc, &argv );	
   MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
   MPI_Comm_size( MPI_COMM_WORLD, &comm_sz );
 
+  if ( argc > 3 ) {
+    if ( 0 == my_rank ) {
+      fprintf(stderr, "Usage: %s [npoints [seed]]\n", argv[0]);
+    }
+    MPI_Finalize();
+    return EXIT_FAILURE;
+  }
+
   if ( argc > 1 ) {
-    npoints = atoi(argv[1]);
+    npoints = strtoull(argv[1], NULL, 10);
   }
 
-  /* Each process initializes the pseudo-random number generator; if
-     we don't do this (or something similar), each process would
-     produce the exact same sequence of pseudo-random numbers! */
-  srand(time(NULL));
+  if ( argc > 2 ) {
+    seed = strtoull(argv[2], NULL, 10);
+  }
 
-  /* [TODO] This is not a true parallel version; the master does
-     everything */
+  if ( npoints < 1 ) {
+    if ( 0 == my_rank ) {
+      fprintf(stderr, "FATAL: npoints must be positive\n");
+    }
+    MPI_Finalize();
+    return EXIT_FAILURE;
+  }
+
+  /* The generator is counter-based: each process computes its own
+     part of the stream, without seeding; the batch boundaries do not
+     depend on the number of processes */
+  const uint64_t nbatches = (npoints + BATCH - 1) / BATCH;
+  const uint64_t bstart = nbatches * my_rank / comm_sz;
+  const uint64_t bend = nbatches * (my_rank + 1) / comm_sz;
+
+  const double tstart = MPI_Wtime();
+  const uint64_t local_inside = generate_points(bstart, bend, npoints, seed);
 
   if (0 == my_rank) {
-    const int start = npoints * my_rank / comm_sz;
-    const int end = (my_rank + 1) * npoints / comm_sz;
-    const int size = end - start;
-    inside = generate_points(size);
+    inside = local_inside;
     for (int p = 1; p < comm_sz; p++) {
-      int remote_inside;
-      MPI_Recv(&remote_inside, 1, MPI_INT, p, MPI_ANY_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      uint64_t remote_inside;
+      MPI_Recv(&remote_inside, 1, MPI_UINT64_T, p, MPI_ANY_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
       inside += remote_inside;
     }
-    pi_approx = 4.0 * inside / (double)npoints;
+    const double elapsed = MPI_Wtime() - tstart;
+    const double p = inside / (double)npoints;
+    const double sigma = 4.0 * sqrt(p * (1.0 - p) / npoints);
+    pi_approx = 4.0 * p;
     printf("PI approximation is %f (true value=%f, rel error=%.3f%%)\n", pi_approx, M_PI, 100.0*fabs(pi_approx-M_PI)/M_PI);
-
+    printf("Statistical error (1 sigma): %g (%.2f sigma from the true value)\n", sigma, fabs(pi_approx-M_PI)/sigma);
+    printf("%" PRIu64 " points, elapsed time %f, %.2f Msamples/s\n", npoints, elapsed, 1.0e-6 * npoints / elapsed);
   } else {
-    const int start = npoints * my_rank / comm_sz;
-    const int end = (my_rank + 1) * npoints / comm_sz;
-    const int size = end - start;
-    int local_inside = generate_points(size);
-    printf("Proc %d calculate\n", my_rank);
-    MPI_Send(&local_inside, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+    MPI_Send(&local_inside, 1, MPI_UINT64_T, 0, 0, MPI_COMM_WORLD);
   }
 
-  //if ( 0 == my_rank ) {
-  //  inside = generate_points(npoints);
-  //  pi_approx = 4.0 * inside / (double)npoints;
-  //  printf("PI approximation is %f (true value=%f, rel error=%.3f%%)\n", pi_approx, M_PI, 100.0*fabs(pi_approx-M_PI)/M_PI);
-  //}
-
   MPI_Finalize();
   return 0;
 }
@@ -6,50 +6,389 @@
  * Written in 2017 by Moreno Marzolla <moreno.marzolla(at)unibo.it>
  * Last modified in 2018 by Moreno Marzolla
  *
- * To the extent possible under law, the author(s) have dedicated all 
- * copyright and related and neighboring rights to this software to the 
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
  * public domain worldwide. This software is distributed without any warranty.
  *
  * You should have received a copy of the CC0 Public Domain Dedication
- * along with this software. If not, see 
- * <http://creativecommons.org/publicdomain/zero/1.0/>. 
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
  *
  * --------------------------------------------------------------------------
  *
+ * Process 0 sends an integer v = 0 to process 1, that increments it
+ * and sends it to process 2, and so on; the last process sends it back
+ * to process 0. This is repeated K times, after which process 0 must
+ * have v = K * comm_sz.
+ *
+ * Then the program measures latency and bandwidth of four
+ * communication patterns, for message sizes from |minbytes| to
+ * |maxbytes| (doubling each time):
+ *
+ * ring      a message goes once around the ring; the latency is the
+ *           time per hop
+ * pingpong  process 0 and process comm_sz-1 (the farthest apart, and
+ *           on different nodes if the processes are placed by node)
+ *           exchange a message back and forth; the latency is half
+ *           the round trip time
+ * alltoall  every process sends a message to every other process
+ * halo      every process exchanges a message with its left and right
+ *           neighbors on a periodic 1D domain, as in a stencil code
+ *
+ * Each pattern is run in three modes: blocking (MPI_Send(),
+ * MPI_Recv(), MPI_Sendrecv()), nonblocking (MPI_Isend(), MPI_Irecv()
+ * and MPI_Waitall()), and persistent (requests created once per
+ * message size with MPI_Send_init() and MPI_Recv_init(), then started
+ * at every iteration with MPI_Startall()). The buffers are allocated
+ * once, for the largest message, with MPI_Alloc_mem(), that lets the
+ * MPI library use memory already registered (pinned) for RDMA, and
+ * are reused for all the messages; -M allocates them with malloc()
+ * instead, to see whether this makes a difference.
+ *
+ * For the exchange patterns (alltoall, halo) the bandwidth is the
+ * number of bytes sent per process divided by the time of one
+ * exchange, which is that of the slowest process. The results are
+ * printed in CSV format.
+ *
  * Compile with:
  * mpicc -std=c99 -Wall -Wpedantic mpi-ring.c -o mpi-ring
  *
  * Run with:
- * mpirun -n 4 ./mpi-ring
+ * mpirun -n 4 ./mpi-ring [-p pattern] [-m mode] [-s minbytes] [-S maxbytes] [-r reps] [-M] [K]
+ *
+ * Example (characterize the shared-memory transport):
+ * mpirun -n 2 ./mpi-ring -p pingpong -S 16777216 > pingpong.csv
  *
  ****************************************************************************/
 
+/* The following #define is required by getopt() */
+#define _XOPEN_SOURCE 600
+
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h> /* for getopt() */
+
+typedef enum { RING, PINGPONG, ALLTOALL, HALO, NPATTERNS } pattern_t;
+const char *pattern_names[] = { "ring", "pingpong", "alltoall", "halo" };
+
+typedef enum { BLOCKING, NONBLOCKING, PERSISTENT, NMODES } comm_mode_t;
+const char *mode_names[] = { "blocking", "nonblocking", "persistent" };
+
+/* One send or receive of a message to/from |peer|. The operations of
+   the ring and pingpong patterns must be done in order; those of the
+   exchange patterns are (send, receive) pairs that can proceed
+   concurrently. */
+typedef struct {
+  int send; /* 1 = send, 0 = receive */
+  int peer;
+  int tag;
+  int slot; /* the message uses slot |slot| of the buffer */
+} op_t;
+
+typedef struct {
+  pattern_t pattern;
+  int concurrent;   /* the operations can proceed concurrently */
+  int nops;
+  op_t ops[4];      /* ring, pingpong and halo */
+  op_t *all_ops;    /* alltoall: 2*(comm_sz-1) operations */
+} plan_t;
+
+/* Operations of this process for |pattern| */
+void plan_init( plan_t *p, pattern_t pattern, int my_rank, int comm_sz )
+{
+  const int next = (my_rank + 1) % comm_sz;
+  const int prev = (my_rank - 1 + comm_sz) % comm_sz;
+  op_t *o = p->ops;
+  int k;
+
+  p->pattern = pattern;
+  p->concurrent = (ALLTOALL == pattern || HALO == pattern);
+  p->nops = 0;
+  p->all_ops = NULL;
+  switch (pattern) {
+  case RING:
+    if ( 0 == my_rank ) {
+      o[p->nops++] = (op_t){1, next, 0, 0};
+      o[p->nops++] = (op_t){0, prev, 0, 0};
+    } else {
+      o[p->nops++] = (op_t){0, prev, 0, 0};
+      o[p->nops++] = (op_t){1, next, 0, 0};
+    }
+    break;
+  case PINGPONG:
+    if ( 0 == my_rank ) {
+      o[p->nops++] = (op_t){1, comm_sz - 1, 0, 0};
+      o[p->nops++] = (op_t){0, comm_sz - 1, 0, 0};
+    } else if ( comm_sz - 1 == my_rank ) {
+      o[p->nops++] = (op_t){0, 0, 0, 0};
+      o[p->nops++] = (op_t){1, 0, 0, 0};
+    }
+    break;
+  case HALO:
+    /* tag 0 travels to the right, tag 1 to the left, so that the two
+       messages are not confused when next == prev */
+    o[p->nops++] = (op_t){1, next, 0, 0};
+    o[p->nops++] = (op_t){0, prev, 0, 0};
+    o[p->nops++] = (op_t){1, prev, 1, 1};
+    o[p->nops++] = (op_t){0, next, 1, 1};
+    break;
+  default: /* ALLTOALL */
+    p->all_ops = (op_t*)malloc(2 * comm_sz * sizeof(op_t));
+    for (k=1; k<comm_sz; k++) {
+      p->all_ops[p->nops++] = (op_t){1, (my_rank + k) % comm_sz, 0, k-1};
+      p->all_ops[p->nops++] = (op_t){0, (my_rank - k + comm_sz) % comm_sz, 0, k-1};
+    }
+  }
+}
+
+op_t *plan_ops( plan_t *p )
+{
+  return (p->all_ops ? p->all_ops : p->ops);
+}
+
+void plan_free( plan_t *p )
+{
+  free(p->all_ops);
+}
+
+/* Run |reps| iterations of plan |p| with messages of |n| bytes in
+   |mode|; |sbuf| and |rbuf| have a slot of |n| bytes for each
+   operation. Returns the time of one iteration on this process. */
+double run( plan_t *p, comm_mode_t mode, char *sbuf, char *rbuf, int n, int reps )
+{
+  const op_t *ops = plan_ops(p);
+  MPI_Request *req = (MPI_Request*)malloc((p->nops + 1) * sizeof(*req));
+  double tstart, elapsed;
+  int r, k;
+
+  if ( PERSISTENT == mode ) {
+    for (k=0; k<p->nops; k++) {
+      const op_t *o = &ops[k];
+      if ( o->send ) {
+        MPI_Send_init(sbuf + (long)o->slot * n, n, MPI_BYTE, o->peer, o->tag, MPI_COMM_WORLD, &req[k]);
+      } else {
+        MPI_Recv_init(rbuf + (long)o->slot * n, n, MPI_BYTE, o->peer, o->tag, MPI_COMM_WORLD, &req[k]);
+      }
+    }
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  tstart = MPI_Wtime();
+  for (r=0; r<reps; r++) {
+    if ( p->concurrent ) {
+      switch (mode) {
+      case BLOCKING:
+        /* the operations come in (send, receive) pairs */
+        for (k=0; k<p->nops; k += 2) {
+          MPI_Sendrecv(sbuf + (long)ops[k].slot * n, n, MPI_BYTE, ops[k].peer, ops[k].tag,
+                       rbuf + (long)ops[k+1].slot * n, n, MPI_BYTE, ops[k+1].peer, ops[k+1].tag,
+                       MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+        break;
+      case NONBLOCKING:
+        for (k=0; k<p->nops; k++) {
+          const op_t *o = &ops[k];
+          if ( o->send ) {
+            MPI_Isend(sbuf + (long)o->slot * n, n, MPI_BYTE, o->peer, o->tag, MPI_COMM_WORLD, &req[k]);
+          } else {
+            MPI_Irecv(rbuf + (long)o->slot * n, n, MPI_BYTE, o->peer, o->tag, MPI_COMM_WORLD, &req[k]);
+          }
+        }
+        MPI_Waitall(p->nops, req, MPI_STATUSES_IGNORE);
+        break;
+      default: /* PERSISTENT */
+        MPI_Startall(p->nops, req);
+        MPI_Waitall(p->nops, req, MPI_STATUSES_IGNORE);
+      }
+    } else {
+      for (k=0; k<p->nops; k++) {
+        const op_t *o = &ops[k];
+        char *buf = (o->send ? sbuf : rbuf);
+        switch (mode) {
+        case BLOCKING:
+          if ( o->send ) {
+            MPI_Send(buf, n, MPI_BYTE, o->peer, o->tag, MPI_COMM_WORLD);
+          } else {
+            MPI_Recv(buf, n, MPI_BYTE, o->peer, o->tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+          }
+          break;
+        case NONBLOCKING:
+          if ( o->send ) {
+            MPI_Isend(buf, n, MPI_BYTE, o->peer, o->tag, MPI_COMM_WORLD, &req[k]);
+          } else {
+            MPI_Irecv(buf, n, MPI_BYTE, o->peer, o->tag, MPI_COMM_WORLD, &req[k]);
+          }
+          MPI_Wait(&req[k], MPI_STATUS_IGNORE);
+          break;
+        default: /* PERSISTENT */
+          MPI_Start(&req[k]);
+          MPI_Wait(&req[k], MPI_STATUS_IGNORE);
+        }
+      }
+    }
+  }
+  elapsed = (MPI_Wtime() - tstart) / reps;
+
+  if ( PERSISTENT == mode ) {
+    for (k=0; k<p->nops; k++) {
+      MPI_Request_free(&req[k]);
+    }
+  }
+  free(req);
+  return elapsed;
+}
+
+/* Send v = 0 around the ring K times, each process incrementing it;
+   returns the final value on process 0 */
+int token_ring( int K )
+{
+  int v = 0, my_rank, comm_sz;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+  const int next = (my_rank + 1) % comm_sz;
+  const int prev = (my_rank - 1 + comm_sz) % comm_sz;
+
+  while (K > 0) {
+    if ( 0 == my_rank ) {
+      v++;
+      MPI_Send(&v, 1, MPI_INT, next, 0, MPI_COMM_WORLD);
+      MPI_Recv(&v, 1, MPI_INT, prev, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    } else {
+      MPI_Recv(&v, 1, MPI_INT, prev, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      v++;
+      MPI_Send(&v, 1, MPI_INT, next, 0, MPI_COMM_WORLD);
+    }
+    K--;
+  }
+  return v;
+}
 
 int main( int argc, char *argv[] )
 {
   int v, my_rank, comm_sz, K = 10;
+  int pattern = -1, mode = -1, reps = 0, use_malloc = 0;
+  long minbytes = 1, maxbytes = 4*1024*1024;
+  char *sbuf, *rbuf;
+  int opt, pt, m;
 
-  MPI_Init( &argc, &argv );	
+  MPI_Init( &argc, &argv );
   MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
   MPI_Comm_size( MPI_COMM_WORLD, &comm_sz );
 
-  if ( argc > 1 ) {
-    K = atoi(argv[1]);
+  while ( (opt = getopt(argc, argv, "p:m:s:S:r:M")) != -1 ) {
+    switch (opt) {
+    case 'p':
+      for (pattern=0; pattern<NPATTERNS && strcmp(optarg, pattern_names[pattern]); pattern++) ;
+      break;
+    case 'm':
+      for (mode=0; mode<NMODES && strcmp(optarg, mode_names[mode]); mode++) ;
+      break;
+    case 's':
+      minbytes = atol(optarg);
+      break;
+    case 'S':
+      maxbytes = atol(optarg);
+      break;
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    case 'M':
+      use_malloc = 1;
+      break;
+    default:
+      pattern = NPATTERNS; /* print usage */
+    }
+  }
+  if ( pattern >= NPATTERNS || mode >= NMODES || minbytes < 0 || maxbytes < minbytes ) {
+    if ( 0 == my_rank ) {
+      fprintf(stderr, "Usage: %s [-p ring|pingpong|alltoall|halo] [-m blocking|nonblocking|persistent] [-s minbytes] [-S maxbytes] [-r reps] [-M] [K]\n", argv[0]);
+    }
+    MPI_Finalize();
+    return EXIT_FAILURE;
+  }
+  if ( optind < argc ) {
+    K = atoi(argv[optind]);
   }
-  /* [TODO] Rest of the code here... */
 
+  v = token_ring(K);
   if (my_rank == 0) {
-    v = 0;
+    printf("# Token ring: v=%d, expected %d: %s\n", v, K * comm_sz, (v == K * comm_sz ? "OK" : "FAILED"));
+  }
+
+  /* Buffers for the largest message, with one slot per peer for
+     alltoall (and at least two for halo) */
+  const int nslots = (comm_sz > 2 ? comm_sz - 1 : 2);
+  const MPI_Aint bufsize = (MPI_Aint)nslots * (maxbytes > 0 ? maxbytes : 1);
+  if ( use_malloc ) {
+    sbuf = (char*)malloc(bufsize);
+    rbuf = (char*)malloc(bufsize);
+  } else {
+    MPI_Alloc_mem(bufsize, MPI_INFO_NULL, &sbuf);
+    MPI_Alloc_mem(bufsize, MPI_INFO_NULL, &rbuf);
+  }
+  /* touch the buffers, so that page faults are not measured */
+  memset(sbuf, my_rank, bufsize);
+  memset(rbuf, 0, bufsize);
 
-    while (K > 0) {
+  if (my_rank == 0) {
+    printf("pattern,mode,alloc,procs,bytes,reps,latency_us,bandwidth_MBps\n");
+  }
+  for (pt=0; pt<NPATTERNS; pt++) {
+    plan_t plan;
+    if ( (pattern >= 0 && pt != pattern) || ((RING == pt || PINGPONG == pt) && comm_sz < 2) ) {
+      continue;
+    }
+    plan_init(&plan, (pattern_t)pt, my_rank, comm_sz);
+    for (m=0; m<NMODES; m++) {
+      long n;
+      if ( mode >= 0 && m != mode ) {
+        continue;
+      }
+      for (n=minbytes; n<=maxbytes; n = (n > 0 ? 2*n : 1)) {
+        /* about 64 MB moved per process, between 10 and 1000 iterations */
+        const long rr = 64L*1024*1024 / (n * plan.nops + 1);
+        const int nreps = (reps > 0 ? reps : (rr < 10 ? 10 : (rr > 1000 ? 1000 : rr)));
+        double t, latency, bytes;
 
+        run(&plan, (comm_mode_t)m, sbuf, rbuf, n, 2); /* warm up */
+        t = run(&plan, (comm_mode_t)m, sbuf, rbuf, n, nreps);
+        MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        switch (pt) {
+        case RING:
+          latency = t / comm_sz;
+          bytes = n;
+          break;
+        case PINGPONG:
+          latency = t / 2;
+          bytes = n;
+          break;
+        case HALO:
+          latency = t;
+          bytes = 2.0 * n;
+          break;
+        default: /* ALLTOALL */
+          latency = t;
+          bytes = (double)n * (comm_sz - 1);
+        }
+        if (my_rank == 0) {
+          printf("%s,%s,%s,%d,%ld,%d,%.3f,%.2f\n", pattern_names[pt], mode_names[m],
+                 (use_malloc ? "malloc" : "MPI_Alloc_mem"), comm_sz, n, nreps,
+                 1e6 * latency, bytes / latency * 1e-6);
+        }
+      }
     }
+    plan_free(&plan);
+  }
 
+  if ( use_malloc ) {
+    free(sbuf);
+    free(rbuf);
   } else {
-
+    MPI_Free_mem(sbuf);
+    MPI_Free_mem(rbuf);
   }
 
   MPI_Finalize();
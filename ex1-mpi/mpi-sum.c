@@ -15,29 +15,120 @@
  *
  * --------------------------------------------------------------------------
  *
+ * Each process sums its part of the array with sum(), that is
+ * multithreaded (OpenMP) and vectorized: every thread sums a
+ * contiguous chunk using NACC independent vector accumulators, so
+ * that the additions do not wait for each other, and the partial
+ * results are combined pairwise (sum_pairwise()). Pairwise summation
+ * keeps the rounding error O(log n) instead of O(n), and the partial
+ * results are always combined in the same order, so the result does
+ * not depend on the scheduling of the threads.
+ *
+ * Since each process uses all the cores given to it, run one process
+ * per node (or per socket) and one thread per core, e.g., on nodes
+ * with two sockets of 8 cores:
+ *
+ * OMP_NUM_THREADS=8 mpirun -n 4 --map-by ppr:1:socket --bind-to socket ./mpi-sum
+ *
+ * The program prints the time of the computation (the slowest
+ * process), so that the scaling can be measured by varying the number
+ * of processes and of threads:
+ *
+ * for p in 1 2 4; do for t in 1 2 4 8; do
+ *   OMP_NUM_THREADS=$t mpirun -n $p ./mpi-sum 100000000
+ * done; done
+ *
+ * If |chunk| > 0, the master sends the part of each process as a
+ * sequence of messages of |chunk| elements with MPI_Isend(), and each
+ * process sums one chunk while receiving the next one (see
+ * recv_sum_pipelined()), instead of waiting for the whole part before
+ * starting; the total time of the two versions can be compared.
+ *
  * Compile with:
- * mpicc -std=c99 -Wall -Wpedantic mpi-sum.c -o mpi-sum
+ * mpicc -std=c99 -Wall -Wpedantic -O3 -march=native -fopenmp mpi-sum.c -o mpi-sum
  *
  * Run with:
- * mpirun -n 4 ./mpi-sum
+ * mpirun -n 4 ./mpi-sum [n [chunk]]
  *
  ****************************************************************************/
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h> /* for memcpy() */
+#include <omp.h>
 
-/* Compute the sum of all elements of array |v| of length |n| */
-float sum(float *v, int n)
+typedef float v8f __attribute__((vector_size(32)));
+#define VLEN ((int)(sizeof(v8f)/sizeof(float)))
+#define NACC 4       /* independent vector accumulators */
+#define BLKLEN 4096  /* arrays up to this length are summed directly */
+
+/* Sum of the elements of |v| of length |n| <= BLKLEN, with NACC*VLEN
+   partial sums */
+float sum_block(const float *v, int n)
 {
+  v8f acc[NACC];
   float sum = 0;
-  int i;
+  int i, k;
 
-  for (i=0; i<n; i++) {
+  memset(acc, 0, sizeof(acc));
+  for (i=0; i + NACC*VLEN <= n; i += NACC*VLEN) {
+    for (k=0; k<NACC; k++) {
+      v8f t;
+      memcpy(&t, v + i + k*VLEN, sizeof(t)); /* v may be unaligned */
+      acc[k] += t;
+    }
+  }
+  for (k=NACC/2; k>0; k /= 2) {
+    int j;
+    for (j=0; j<k; j++) {
+      acc[j] += acc[j + k];
+    }
+  }
+  for (k=VLEN/2; k>0; k /= 2) {
+    int j;
+    for (j=0; j<k; j++) {
+      acc[0][j] += acc[0][j + k];
+    }
+  }
+  sum = acc[0][0];
+  for ( ; i<n; i++) {
     sum += v[i];
   }
   return sum;
 }
 
+/* Pairwise sum of the elements of |v| of length |n| */
+float sum_pairwise(const float *v, int n)
+{
+  if ( n <= BLKLEN ) {
+    return sum_block(v, n);
+  } else {
+    const int h = n / 2;
+    return sum_pairwise(v, h) + sum_pairwise(v + h, n - h);
+  }
+}
+
+/* Compute the sum of all elements of array |v| of length |n| */
+float sum(const float *v, int n)
+{
+  const int nthreads = omp_get_max_threads();
+  float *partial = (float*)calloc(nthreads, sizeof(*partial));
+  float s;
+
+#pragma omp parallel default(none) shared(v, n, partial)
+  {
+    const int my_id = omp_get_thread_num();
+    const int nt = omp_get_num_threads();
+    const int start = (long)n * my_id / nt;
+    const int end = (long)n * (my_id + 1) / nt;
+    partial[my_id] = sum_pairwise(v + start, end - start);
+  }
+  /* partial[] is zero beyond the size of the team, if smaller */
+  s = sum_pairwise(partial, nthreads);
+  free(partial);
+  return s;
+}
+
 /* Fill array v of length n; store into *expected_sum the sum of the
    content of v */
 void fill(float *v, int n, float *expected_sum)
@@ -56,13 +147,52 @@ void fill(float *v, int n, float *expected_sum)
   }
 }
 
+/* Receive the |size| elements of this process from rank 0 in chunks
+   of |chunk| elements (one message per chunk) and return their sum.
+   While chunk c is being summed, chunk c+1 is received into the other
+   buffer (double buffering), so that communication and computation
+   overlap; |t_comp| gets the time spent computing. */
+float recv_sum_pipelined(int size, int chunk, double *t_comp)
+{
+  const int nchunks = (size + chunk - 1) / chunk;
+  float *buf[2];
+  MPI_Request req[2];
+  float s = 0;
+  int c;
+
+  buf[0] = (float*)malloc(chunk * sizeof(float));
+  buf[1] = (float*)malloc(chunk * sizeof(float));
+  *t_comp = 0.0;
+  if ( nchunks > 0 ) {
+    const int len = (size < chunk ? size : chunk);
+    MPI_Irecv(buf[0], len, MPI_FLOAT, 0, 0, MPI_COMM_WORLD, &req[0]);
+  }
+  for (c=0; c<nchunks; c++) {
+    const int cur = c % 2;
+    const int len = (size - c*chunk < chunk ? size - c*chunk : chunk);
+    MPI_Wait(&req[cur], MPI_STATUS_IGNORE);
+    if ( c + 1 < nchunks ) {
+      const int next_len = (size - (c+1)*chunk < chunk ? size - (c+1)*chunk : chunk);
+      MPI_Irecv(buf[1 - cur], next_len, MPI_FLOAT, 0, c + 1, MPI_COMM_WORLD, &req[1 - cur]);
+    }
+    const double t0 = MPI_Wtime();
+    s += sum(buf[cur], len);
+    *t_comp += MPI_Wtime() - t0;
+  }
+  free(buf[0]);
+  free(buf[1]);
+  return s;
+}
+
 int main( int argc, char *argv[] )
 {
-  int my_rank, comm_sz;
-  float *master_array = NULL, s, expected;
-  int n = 1024*1024;
+  int my_rank, comm_sz, provided;
+  float *master_array = NULL, s = 0, expected = 0;
+  int n = 1024*1024, chunk = 0;
+  double tstart, t_sum, t_sum_max, elapsed;
 
-  MPI_Init( &argc, &argv );	
+  /* Only the master thread calls MPI functions */
+  MPI_Init_thread( &argc, &argv, MPI_THREAD_FUNNELED, &provided );
   MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
   MPI_Comm_size( MPI_COMM_WORLD, &comm_sz );
 
@@ -70,25 +200,51 @@ int main( int argc, char *argv[] )
     n = atoi(argv[1]);
   }
 
+  if ( argc > 2 ) {
+    chunk = atoi(argv[2]);
+  }
+
   /* The master initializes the array */
   if ( 0 == my_rank ) {
     master_array = (float*)malloc( n * sizeof(float) );
     fill(master_array, n, &expected);
   }
 
+  MPI_Barrier(MPI_COMM_WORLD);
+  tstart = MPI_Wtime();
+
   /* Comunicazione porzioni array */
   if (0 == my_rank) {
+    MPI_Request *req = NULL;
+    int nreq = 0;
+
+    if ( chunk > 0 ) {
+      /* Post the sends of all the chunks at once, then compute while
+         they proceed */
+      const int max_chunks = (n / comm_sz + 1 + chunk - 1) / chunk;
+      req = (MPI_Request*)malloc(comm_sz * max_chunks * sizeof(*req));
+    }
     for (int p = 1; p < comm_sz; p++) {
-      const int start = p * n / comm_sz;
-      const int end = (p + 1) * n / comm_sz;
+      const int start = (long)p * n / comm_sz;
+      const int end = (long)(p + 1) * n / comm_sz;
       const int size = end - start;
 
-      printf("Proc 0 send [%d, %d]\n", start, end);
-
-      MPI_Send(master_array + start, size, MPI_FLOAT, p, 0, MPI_COMM_WORLD);
+      if ( chunk > 0 ) {
+        for (int c = 0; c*chunk < size; c++) {
+          const int len = (size - c*chunk < chunk ? size - c*chunk : chunk);
+          MPI_Isend(master_array + start + c*chunk, len, MPI_FLOAT, p, c, MPI_COMM_WORLD, &req[nreq++]);
+        }
+      } else {
+        MPI_Send(master_array + start, size, MPI_FLOAT, p, 0, MPI_COMM_WORLD);
+      }
     }
 
+    t_sum = MPI_Wtime();
     s = sum(master_array, n / comm_sz);
+    t_sum = MPI_Wtime() - t_sum;
+
+    MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE);
+    free(req);
 
     for (int p = 1; p < comm_sz; p++) {
       float remote_s;
@@ -96,30 +252,40 @@ int main( int argc, char *argv[] )
       s += remote_s;
     }
   } else {
-      const int start = my_rank * n / comm_sz;
-      const int end = (my_rank + 1) * n / comm_sz;
+      const int start = (long)my_rank * n / comm_sz;
+      const int end = (long)(my_rank + 1) * n / comm_sz;
       const int size = end - start;
-      float *local_array = (float *)malloc(sizeof(float) * size);
+      float local_s;
 
-      printf("Proc %d receive [%d, %d]\n", my_rank, start, end);
-      MPI_Recv(local_array, size, MPI_FLOAT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      if ( chunk > 0 ) {
+        local_s = recv_sum_pipelined(size, chunk, &t_sum);
+      } else {
+        float *local_array = (float *)malloc(sizeof(float) * size);
 
-      float local_s = sum(local_array, size);
+        MPI_Recv(local_array, size, MPI_FLOAT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        t_sum = MPI_Wtime();
+        local_s = sum(local_array, size);
+        t_sum = MPI_Wtime() - t_sum;
+        free(local_array);
+      }
 
       MPI_Send(&local_s, 1, MPI_FLOAT, 0, 0, MPI_COMM_WORLD);
-      free(local_array);
   }
 
+  elapsed = MPI_Wtime() - tstart;
+  MPI_Reduce(&t_sum, &t_sum_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
   if ( 0 == my_rank ) {
-    /* [TODO] This is not a true parallel version; the master does
-       everything */
-    s = sum(master_array, n);
     printf("Sum=%f, expected=%g\n", s, expected);
     if (s == expected) {
       printf("Test OK\n");
     } else {
       printf("Test FAILED\n");
     }
+    printf("%d processes x %d threads, n=%d\n", comm_sz, omp_get_max_threads(), n);
+    printf("Local sum time %f s (%.2f GB/s per process), total time %f s\n",
+           t_sum_max, (double)n / comm_sz * sizeof(float) / t_sum_max * 1e-9, elapsed);
   }
 
   free(master_array);
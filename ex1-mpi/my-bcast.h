@@ -0,0 +1,345 @@
+/* */
+/****************************************************************************
+ *
+ * my-bcast.h - Broadcast using point-to-point communications
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * my_Bcast() has the same arguments and the same semantics as
+ * MPI_Bcast(), and is built only from point-to-point operations. It
+ * uses one of three algorithms, on P processes and a message of n
+ * bytes:
+ *
+ * MB_BINOMIAL  binomial tree: log2(P) steps, each one sending the
+ *              whole message; best for short messages, where the
+ *              latency dominates.
+ *
+ * MB_SCATTER_ALLGATHER
+ *              the message is split into P blocks, that are scattered
+ *              along a binomial tree, and then collected by every
+ *              process with an allgather on a ring (van de Geijn).
+ *              Each process sends about 2n bytes, independently of P.
+ *
+ * MB_CHAIN     the processes form a chain, and the message is split
+ *              into segments of MB_SEGMENT bytes: while process i
+ *              forwards segment s to process i+1, it receives segment
+ *              s+1 from process i-1. For large n the time approaches
+ *              that of sending n bytes once.
+ *
+ * With MB_AUTO the algorithm is chosen from n and P (see
+ * mb_choose()). In addition, if the processes are spread across
+ * several nodes, the broadcast is done in two levels: first among one
+ * process (the leader) per node, then within each node, so that the
+ * message crosses the network only once per node. The nodes are found
+ * with MPI_Comm_split_type(MPI_COMM_TYPE_SHARED); the communicators
+ * are created on the first call on a communicator and cached as an
+ * attribute of it, so they are freed when the communicator is (for
+ * MPI_COMM_WORLD, in MPI_Finalize()).
+ *
+ * Derived datatypes are supported; if the data are not contiguous in
+ * memory, they are packed before and unpacked after the broadcast.
+ *
+ ****************************************************************************/
+
+#ifndef MY_BCAST_H
+#define MY_BCAST_H
+
+#include <mpi.h>
+#include <stdlib.h>
+
+typedef enum { MB_AUTO, MB_BINOMIAL, MB_SCATTER_ALLGATHER, MB_CHAIN } mb_alg_t;
+
+const char *mb_names[] = { "auto", "binomial", "scatter-allgather", "chain" };
+
+#define MB_SEGMENT (128*1024) /* segment size of MB_CHAIN, in bytes */
+#define MB_TAG 0
+
+/* Communicators cached on each communicator passed to my_Bcast() */
+typedef struct {
+    MPI_Comm comm;      /* duplicate of the user communicator */
+    MPI_Comm node;      /* processes on the same node */
+    MPI_Comm leaders;   /* rank 0 of each node; MPI_COMM_NULL elsewhere */
+    int nnodes;
+    int *node_of;       /* node_of[r] = rank in leaders of the node of rank r */
+    int *node_rank_of;  /* node_rank_of[r] = rank of r in its node */
+} mb_topo_t;
+
+int mb_keyval = MPI_KEYVAL_INVALID;
+
+int mb_topo_delete( MPI_Comm comm, int keyval, void *attr, void *extra )
+{
+    mb_topo_t *t = (mb_topo_t*)attr;
+    (void)comm; (void)keyval; (void)extra;
+    MPI_Comm_free(&t->comm);
+    MPI_Comm_free(&t->node);
+    if ( t->leaders != MPI_COMM_NULL ) {
+        MPI_Comm_free(&t->leaders);
+    }
+    free(t->node_of);
+    free(t->node_rank_of);
+    free(t);
+    return MPI_SUCCESS;
+}
+
+/* Return the topology of |comm|, creating it on the first call; this
+   is a collective operation the first time */
+mb_topo_t *mb_topo( MPI_Comm comm )
+{
+    mb_topo_t *t;
+    int flag, rank, size, node_rank, leader_rank = 0;
+    int mine[2], *all;
+    int r;
+
+    if ( MPI_KEYVAL_INVALID == mb_keyval ) {
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, mb_topo_delete, &mb_keyval, NULL);
+    }
+    MPI_Comm_get_attr(comm, mb_keyval, &t, &flag);
+    if ( flag ) {
+        return t;
+    }
+
+    t = (mb_topo_t*)malloc(sizeof(*t));
+    MPI_Comm_dup(comm, &t->comm);
+    MPI_Comm_rank(t->comm, &rank);
+    MPI_Comm_size(t->comm, &size);
+    MPI_Comm_split_type(t->comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &t->node);
+    MPI_Comm_rank(t->node, &node_rank);
+    MPI_Comm_split(t->comm, (0 == node_rank ? 0 : MPI_UNDEFINED), rank, &t->leaders);
+    if ( t->leaders != MPI_COMM_NULL ) {
+        MPI_Comm_rank(t->leaders, &leader_rank);
+        MPI_Comm_size(t->leaders, &t->nnodes);
+    }
+    /* tell the other processes of the node the index of the node */
+    MPI_Bcast(&leader_rank, 1, MPI_INT, 0, t->node);
+    MPI_Bcast(&t->nnodes, 1, MPI_INT, 0, t->node);
+    mine[0] = leader_rank;
+    mine[1] = node_rank;
+    all = (int*)malloc(2 * size * sizeof(*all));
+    MPI_Allgather(mine, 2, MPI_INT, all, 2, MPI_INT, t->comm);
+    t->node_of = (int*)malloc(size * sizeof(*t->node_of));
+    t->node_rank_of = (int*)malloc(size * sizeof(*t->node_rank_of));
+    for (r=0; r<size; r++) {
+        t->node_of[r] = all[2*r];
+        t->node_rank_of[r] = all[2*r + 1];
+    }
+    free(all);
+    MPI_Comm_set_attr(comm, mb_keyval, t);
+    return t;
+}
+
+/* Binomial tree broadcast of |n| bytes from |root| */
+void mb_binomial( char *buf, int n, int root, MPI_Comm comm )
+{
+    int rank, size, vrank, mask;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    vrank = (rank - root + size) % size;
+    /* receive from the parent, that is vrank without its lowest set bit */
+    for (mask = 1; mask < size; mask <<= 1) {
+        if ( vrank & mask ) {
+            MPI_Recv(buf, n, MPI_BYTE, (rank - mask + size) % size, MB_TAG, comm, MPI_STATUS_IGNORE);
+            break;
+        }
+    }
+    /* send to the children vrank + m, for the bits m below that one */
+    for (mask >>= 1; mask > 0; mask >>= 1) {
+        if ( vrank + mask < size ) {
+            MPI_Send(buf, n, MPI_BYTE, (rank + mask) % size, MB_TAG, comm);
+        }
+    }
+}
+
+/* Bytes [*start, *start + *len) of the blocks b, ... b+nb-1, when |n|
+   bytes are split into blocks of |bs| bytes (the last ones may be
+   shorter or empty) */
+void mb_blocks( int n, int bs, int b, int nb, int *start, int *len )
+{
+    long s = (long)b * bs;
+    long e = s + (long)nb * bs;
+    if ( s > n ) s = n;
+    if ( e > n ) e = n;
+    *start = s;
+    *len = e - s;
+}
+
+/* Scatter along a binomial tree, then allgather on a ring */
+void mb_scatter_allgather( char *buf, int n, int root, MPI_Comm comm )
+{
+    int rank, size, vrank, mask, i, start, len;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    vrank = (rank - root + size) % size;
+    const int bs = (n + size - 1) / size;
+
+    /* Scatter: the process of relative rank v, whose lowest set bit is
+       m, receives the blocks v, ... v+m-1 from v-m (the root gets all
+       of them), and passes the upper halves to its children */
+    for (mask = 1; mask < size; mask <<= 1) {
+        if ( vrank & mask ) {
+            const int nb = (vrank + mask < size ? mask : size - vrank);
+            mb_blocks(n, bs, vrank, nb, &start, &len);
+            MPI_Recv(buf + start, len, MPI_BYTE, (rank - mask + size) % size, MB_TAG, comm, MPI_STATUS_IGNORE);
+            break;
+        }
+    }
+    for (mask >>= 1; mask > 0; mask >>= 1) {
+        if ( vrank + mask < size ) {
+            const int nb = (vrank + 2*mask < size ? mask : size - vrank - mask);
+            mb_blocks(n, bs, vrank + mask, nb, &start, &len);
+            MPI_Send(buf + start, len, MPI_BYTE, (rank + mask) % size, MB_TAG, comm);
+        }
+    }
+
+    /* Allgather: at step i, send block vrank-i to the next process and
+       receive block vrank-i-1 from the previous one */
+    const int next = (rank + 1) % size, prev = (rank - 1 + size) % size;
+    for (i=0; i<size-1; i++) {
+        int sstart, slen, rstart, rlen;
+        mb_blocks(n, bs, (vrank - i + size) % size, 1, &sstart, &slen);
+        mb_blocks(n, bs, (vrank - i - 1 + size) % size, 1, &rstart, &rlen);
+        MPI_Sendrecv(buf + sstart, slen, MPI_BYTE, next, MB_TAG,
+                     buf + rstart, rlen, MPI_BYTE, prev, MB_TAG,
+                     comm, MPI_STATUS_IGNORE);
+    }
+}
+
+/* Pipelined broadcast along the chain root, root+1, ... */
+void mb_chain( char *buf, int n, int root, MPI_Comm comm )
+{
+    int rank, size, vrank, s;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    vrank = (rank - root + size) % size;
+    const int prev = (rank - 1 + size) % size, next = (rank + 1) % size;
+    const int nseg = (n + MB_SEGMENT - 1) / MB_SEGMENT;
+    MPI_Request *req = (MPI_Request*)malloc((nseg + 1) * sizeof(*req));
+    int nreq = 0;
+
+    for (s=0; s<nseg; s++) {
+        const int start = s * MB_SEGMENT;
+        const int len = (n - start < MB_SEGMENT ? n - start : MB_SEGMENT);
+        if ( vrank > 0 ) {
+            MPI_Recv(buf + start, len, MPI_BYTE, prev, MB_TAG, comm, MPI_STATUS_IGNORE);
+        }
+        if ( vrank < size - 1 ) {
+            MPI_Isend(buf + start, len, MPI_BYTE, next, MB_TAG, comm, &req[nreq++]);
+        }
+    }
+    MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE);
+    free(req);
+}
+
+/* Algorithm used by MB_AUTO for |n| bytes on |size| processes. The
+   binomial tree sends the whole message log2(P) times in sequence,
+   scatter-allgather about 2n bytes with P-1+log2(P) messages, and the
+   chain n bytes plus (P-2) segments: the tree wins when the latency
+   dominates, scatter-allgather on medium messages when log2(P) > 2,
+   and the chain on long messages. */
+mb_alg_t mb_choose( int n, int size )
+{
+    if ( n <= 8192 || size <= 2 ) {
+        return MB_BINOMIAL;
+    } else if ( n <= 512*1024 ) {
+        return (size >= 8 ? MB_SCATTER_ALLGATHER : MB_BINOMIAL);
+    } else {
+        return MB_CHAIN;
+    }
+}
+
+/* Broadcast |n| bytes from |root| on |comm| with algorithm |alg| */
+void mb_flat( char *buf, int n, int root, MPI_Comm comm, mb_alg_t alg )
+{
+    int size;
+
+    MPI_Comm_size(comm, &size);
+    if ( size < 2 || n == 0 ) {
+        return;
+    }
+    if ( MB_AUTO == alg ) {
+        alg = mb_choose(n, size);
+    }
+    switch (alg) {
+    case MB_SCATTER_ALLGATHER:
+        mb_scatter_allgather(buf, n, root, comm);
+        break;
+    case MB_CHAIN:
+        mb_chain(buf, n, root, comm);
+        break;
+    default:
+        mb_binomial(buf, n, root, comm);
+    }
+}
+
+/* Same as my_Bcast(), using algorithm |alg| */
+int my_Bcast_alg( void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm, mb_alg_t alg )
+{
+    mb_topo_t *t = mb_topo(comm);
+    MPI_Aint lb, extent, true_lb, true_extent;
+    int rank, type_size, n;
+    char *buf = (char*)buffer;
+
+    MPI_Comm_rank(t->comm, &rank);
+    MPI_Type_size(datatype, &type_size);
+    MPI_Type_get_extent(datatype, &lb, &extent);
+    MPI_Type_get_true_extent(datatype, &true_lb, &true_extent);
+    n = count * type_size;
+    /* the elements are type_size bytes long with no gaps, and (if
+       there are more than one) are also type_size bytes apart */
+    const int contiguous = (0 == true_lb && true_extent == type_size &&
+                            (1 == count || (0 == lb && extent == type_size)));
+    if ( ! contiguous ) {
+        int pos = 0;
+        MPI_Pack_size(count, datatype, t->comm, &n);
+        buf = (char*)malloc(n);
+        if ( rank == root ) {
+            MPI_Pack(buffer, count, datatype, buf, n, &pos, t->comm);
+        }
+    }
+
+    if ( t->nnodes > 1 ) {
+        /* Within the node of the root, so that its leader has the
+           data; then among the leaders; then within the other nodes */
+        const int root_node = t->node_of[root];
+        const int my_node = t->node_of[rank];
+        if ( my_node == root_node ) {
+            mb_flat(buf, n, t->node_rank_of[root], t->node, alg);
+        }
+        if ( t->leaders != MPI_COMM_NULL ) {
+            mb_flat(buf, n, root_node, t->leaders, alg);
+        }
+        if ( my_node != root_node ) {
+            mb_flat(buf, n, 0, t->node, alg);
+        }
+    } else {
+        mb_flat(buf, n, root, t->comm, alg);
+    }
+
+    if ( ! contiguous ) {
+        int pos = 0;
+        if ( rank != root ) {
+            MPI_Unpack(buf, n, &pos, buffer, count, datatype, t->comm);
+        }
+        free(buf);
+    }
+    return MPI_SUCCESS;
+}
+
+/* Broadcast |count| elements of type |datatype| in |buffer| from
+   process |root| to all the processes of |comm|, like MPI_Bcast() */
+int my_Bcast( void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm )
+{
+    return my_Bcast_alg(buffer, count, datatype, root, comm, MB_AUTO);
+}
+
+#endif
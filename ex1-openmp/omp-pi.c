@@ -16,69 +16,225 @@
  *
  * --------------------------------------------------------------------------
  *
- * This program implements a serial algorithm for computing the
- * approximate value of PI using a Monte Carlo method.
+ * This program computes the approximate value of PI using a Monte Carlo
+ * method: it generates random points in the unit square, and counts how
+ * many of them fall inside the quarter of circle of radius 1 centered
+ * at the origin; the fraction of points inside approaches PI/4. Random
+ * numbers are produced by the counter-based generator of philox.h: each
+ * 128-bit random block provides the coordinates of two points, and
+ * points are generated in batches of 2*PHILOX_BATCH. Batches are
+ * distributed among the OpenMP threads, so that each thread uses a
+ * disjoint part of the stream; the result depends only on npoints and
+ * seed, not on the number of threads. The number of points is a 64-bit
+ * integer.
+ *
+ * The program prints the estimate, the statistical error (standard
+ * deviation of the estimate, 4*sqrt(p*(1-p)/npoints), where p is the
+ * fraction of points inside), and the number of samples per second.
+ *
+ * With -e the points are produced by one of the estimators of qmc.h
+ * (mc, strat, anti, halton, sobol) in |nrep| independent replicates
+ * (-r, default 16), and the statistical error is estimated from the
+ * spread of the replicates. The program also reports how many plain
+ * Monte Carlo points would be needed to obtain the same error.
  *
  * Compile with:
  *
- * gcc -std=c99 -fopenmp -Wall -Wpedantic omp-pi.c -o omp-pi -lm
+ * gcc -std=c99 -fopenmp -Wall -Wpedantic -O3 -march=native omp-pi.c -o omp-pi -lm
  *
  * Run with:
  *
- * OMP_NUM_THREADS=4 ./omp-pi 20000
+ * OMP_NUM_THREADS=4 ./omp-pi [-e method [-r nrep]] [npoints [seed]]
+ *
+ * Example:
+ *
+ * OMP_NUM_THREADS=4 ./omp-pi 1000000000
+ * OMP_NUM_THREADS=4 ./omp-pi -e sobol 1000000
+ *
+ * -O3 is required for GCC to vectorize the generator and the loop of
+ * count_inside().
  *
  ****************************************************************************/
-/* The rand_r() function is available only if _XOPEN_SOURCE is defined */
-#define _XOPEN_SOURCE
+
+/* The following #define is required by getopt() */
+#define _XOPEN_SOURCE 600
+
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h> /* for PRIu64 */
 #include <math.h> /* for fabs */
+#include <unistd.h> /* for getopt() */
+#include "philox.h"
+#include "qmc.h"
+
+/* Number of points generated by one call of philox4x32_batch() */
+#define BATCH (2*PHILOX_BATCH)
 
-/* Generate |n| random points within the square with corners (-1, -1),
-   (1, 1); return the number of points that fall inside the circle
-   centered ad the origin with radius 1. */
-unsigned int generate_points( unsigned int n )
+/* Returns 1 iff the point with coordinates (x, y) * 2^-32 falls
+   inside the circle */
+int inside( uint32_t x, uint32_t y )
 {
-    unsigned int i, ninside = 0;
-    /* The C function rand() is not thread-safe, and therefore can not
-       be used with OpenMP. We use rand_r() with an explicit per-thread seed. */
-    unsigned int my_seed = 17 + 19 * omp_get_thread_num();
-
-#pragma omp parallel for reduction(+:ninside) default(none) private(my_seed) shared(n)
-    for (i = 0; i < n; i++) {
-        /* Generate two random values in the range [-1, 1] */
-        const double x = (2.0 * rand_r(&my_seed)/(double)RAND_MAX) - 1.0;
-        const double y = (2.0 * rand_r(&my_seed)/(double)RAND_MAX) - 1.0;
-        if ( x*x + y*y <= 1.0 ) {
-            ninside++;
-        }
+    const double scale = 1.0 / 4294967296.0; /* 2^-32 */
+    const double fx = x * scale, fy = y * scale;
+    return ( fx*fx + fy*fy <= 1.0 );
+}
+
+/* Return how many of the first |n| points (n <= BATCH) of the batch
+   of random words |r| fall inside the circle. Point k uses words 0
+   and 1 of block k for k < PHILOX_BATCH, words 2 and 3 of block
+   k - PHILOX_BATCH otherwise. */
+int count_inside( const uint32_t *r, int n )
+{
+    const int n0 = (n < PHILOX_BATCH ? n : PHILOX_BATCH);
+    int k, ninside = 0;
+    for (k = 0; k < n0; k++) {
+        ninside += inside(r[k], r[PHILOX_BATCH + k]);
+    }
+    for (k = 0; k < n - n0; k++) {
+        ninside += inside(r[2*PHILOX_BATCH + k], r[3*PHILOX_BATCH + k]);
+    }
+    return ninside;
+}
+
+/* Generate |n| random points within the unit square, using the
+   stream 0 of the generator with key |seed|; return the number of
+   points that fall inside the circle centered at the origin with
+   radius 1. */
+uint64_t generate_points( uint64_t n, uint64_t seed )
+{
+    const uint64_t nbatches = (n + BATCH - 1) / BATCH;
+    uint64_t b, ninside = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:ninside) default(none) shared(n, nbatches, seed)
+    for (b = 0; b < nbatches; b++) {
+        uint32_t r[4*PHILOX_BATCH];
+        philox4x32_batch(seed, 0, b*PHILOX_BATCH, r);
+        ninside += count_inside(r, (n - b*BATCH < BATCH ? n - b*BATCH : BATCH));
     }
     return ninside;
 }
 
+/* Count the points of |q| that fall inside the circle; hits[r] is
+   set to the count of replicate r. Each thread processes a contiguous
+   range of points. */
+void estimate_points( const qmc_t *q, uint64_t *hits )
+{
+    const uint64_t n = qmc_npoints(q);
+    int r;
+
+    for (r = 0; r < q->nrep; r++) {
+        hits[r] = 0;
+    }
+#pragma omp parallel default(none) shared(q, n, hits)
+    {
+        const int me = omp_get_thread_num(), p = omp_get_num_threads();
+        const uint64_t start = n * me / p, end = n * (me + 1) / p;
+        uint64_t *my_hits = (uint64_t*)calloc(q->nrep, sizeof(*my_hits));
+        uint64_t i;
+        qmc_iter_t it;
+        int r;
+
+        qmc_seek(q, &it, start);
+        for (i = start; i < end; i++) {
+            double x, y;
+            const int rep = qmc_next(&it, &x, &y);
+            my_hits[rep] += ( x*x + y*y <= 1.0 );
+        }
+        for (r = 0; r < q->nrep; r++) {
+#pragma omp atomic
+            hits[r] += my_hits[r];
+        }
+        free(my_hits);
+    }
+}
+
 int main( int argc, char *argv[] )
 {
-    unsigned int npoints = 10000;
-    int ninside;
+    uint64_t npoints = 10000, ninside, seed = 1;
     const double PI_EXACT = 3.14159265358979323846;
+    qmc_kind_t kind = QMC_MC;
+    int use_qmc = 0, nrep = 16, opt;
+
+    while ( (opt = getopt(argc, argv, "e:r:")) != -1 ) {
+        switch (opt) {
+        case 'e':
+            use_qmc = 1;
+            if ( qmc_parse(optarg, &kind) ) {
+                fprintf(stderr, "FATAL: unknown method %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            nrep = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-e mc|strat|anti|halton|sobol [-r nrep]] [npoints [seed]]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
 
-    if ( argc > 2 ) {
-        fprintf(stderr, "Usage: %s [npoints]\n", argv[0]);
+    if ( argc > optind + 2 ) {
+        fprintf(stderr, "Usage: %s [-e mc|strat|anti|halton|sobol [-r nrep]] [npoints [seed]]\n", argv[0]);
         return EXIT_FAILURE;
     }
 
-    if ( argc > 1 ) {
-        npoints = atol(argv[1]);
+    if ( argc > optind ) {
+        npoints = strtoull(argv[optind], NULL, 10);
+    }
+
+    if ( argc > optind + 1 ) {
+        seed = strtoull(argv[optind + 1], NULL, 10);
+    }
+
+    if ( npoints < 1 ) {
+        fprintf(stderr, "FATAL: npoints must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    if ( use_qmc ) {
+        qmc_t q;
+        double mean, err;
+
+        if ( nrep < 2 ) {
+            fprintf(stderr, "FATAL: at least two replicates are required\n");
+            return EXIT_FAILURE;
+        }
+        qmc_init(&q, kind, npoints, nrep, seed);
+        if ( q.n < 1 ) {
+            fprintf(stderr, "FATAL: too few points\n");
+            return EXIT_FAILURE;
+        }
+        uint64_t *hits = (uint64_t*)malloc(nrep * sizeof(*hits));
+        npoints = qmc_npoints(&q);
+        printf("Generating %" PRIu64 " points (%s, %d replicates of %" PRIu64 ")...\n", npoints, qmc_names[kind], nrep, q.n);
+        const double tstart = omp_get_wtime();
+        estimate_points(&q, hits);
+        const double elapsed = omp_get_wtime() - tstart;
+        qmc_result(&q, hits, &mean, &err);
+        const double pi_approx = 4.0 * mean, sigma = 4.0 * err;
+        /* standard deviation of plain Monte Carlo with the same points */
+        const double sigma_mc = 4.0 * sqrt(mean * (1.0 - mean) / npoints);
+        printf("PI approximation %f, exact %f, error %f%%\n", pi_approx, PI_EXACT, 100.0*fabs(pi_approx - PI_EXACT)/PI_EXACT);
+        printf("Statistical error (1 sigma, from the replicates): %g (%.2f sigma from the exact value)\n", sigma, fabs(pi_approx - PI_EXACT)/sigma);
+        printf("Monte Carlo error with the same points: %g; Monte Carlo would need %.3g points\n", sigma_mc, npoints * (sigma_mc/sigma) * (sigma_mc/sigma));
+        printf("Elapsed time: %f\n", elapsed);
+        printf("Throughput: %.2f Msamples/s\n", 1.0e-6 * npoints / elapsed);
+        free(hits);
+        return EXIT_SUCCESS;
     }
 
-    printf("Generating %u points...\n", npoints);
+    printf("Generating %" PRIu64 " points...\n", npoints);
     const double tstart = omp_get_wtime();
-    ninside = generate_points(npoints);
+    ninside = generate_points(npoints, seed);
     const double elapsed = omp_get_wtime() - tstart;
-    double pi_approx = 4.0 * ninside / (double)npoints;
+    const double p = ninside / (double)npoints;
+    const double pi_approx = 4.0 * p;
+    const double sigma = 4.0 * sqrt(p * (1.0 - p) / npoints);
     printf("PI approximation %f, exact %f, error %f%%\n", pi_approx, PI_EXACT, 100.0*fabs(pi_approx - PI_EXACT)/PI_EXACT);
+    printf("Statistical error (1 sigma): %g (%.2f sigma from the exact value)\n", sigma, fabs(pi_approx - PI_EXACT)/sigma);
     printf("Elapsed time: %f\n", elapsed);
+    printf("Throughput: %.2f Msamples/s\n", 1.0e-6 * npoints / elapsed);
 
     return EXIT_SUCCESS;
 }
@@ -21,18 +21,22 @@
  * only; the task is to parallelize the computation so that the GPU is
  * used.
  *
+ * One row every |every| steps is written to a binary (P4) PBM image
+ * by a separate thread (see pbm-writer.h); the state is copied back
+ * from the device only for those rows.
+ *
  * Compile with:
- * nvcc cuda-rule30.cu -o cuda-rule30
+ * nvcc cuda-rule30.cu -o cuda-rule30 -lpthread
  *
  * Run with:
- * /cuda-rule30 1024 1024
+ * /cuda-rule30 [width [steps [every]]]
  *
  ****************************************************************************/
 
 #include "hpc.h"
 #include <stdio.h>
 #include <stdlib.h>
-
+#include "pbm-writer.h"
 
 #define BLKSIZE 1024
 
@@ -98,29 +102,17 @@ void init_domain( cell_t *cur, int ext_n )
   cur[ext_n/2] = 1;
 }
 
-/**
- * Dump the current state of the CA to PBM file |out|. |cur| points to
- * an array of length |ext_n| that includes two ghost cells.
- */
-void dump_state( FILE *out, const cell_t *cur, int ext_n )
-{
-  int i;
-  for (i=1; i < ext_n-1; i++) {
-    fprintf(out, "%d ", cur[i]);
-  }
-  fprintf(out, "\n");
-}
-
 int main( int argc, char* argv[] )
 {
   const char *outname = "rule30.pbm";
-  FILE *out;
-  int width = 1024, steps = 1024, s;
+  char comment[128];
+  pbm_writer_t *out;
+  int width = 1024, steps = 1024, every = 1, s;
   cell_t *cur;
   cell_t *d_cur, *d_next;
 
-  if ( argc > 3 ) {
-    fprintf(stderr, "Usage: %s [width [steps]]\n", argv[0]);
+  if ( argc > 4 ) {
+    fprintf(stderr, "Usage: %s [width [steps [every]]]\n", argv[0]);
     return EXIT_FAILURE;
   }
 
@@ -132,6 +124,15 @@ int main( int argc, char* argv[] )
     steps = atoi(argv[2]);
   }
 
+  if ( argc > 3 ) {
+    every = atoi(argv[3]);
+  }
+
+  if ( every < 1 ) {
+    fprintf(stderr, "every must be positive\n");
+    return EXIT_FAILURE;
+  }
+
   if (width % BLKSIZE) {
     fprintf(stderr, "width must be multiple of BLKSIZE\n");
     return EXIT_FAILURE;
@@ -141,14 +142,12 @@ int main( int argc, char* argv[] )
   const size_t ext_size = ext_width * sizeof(*cur); /* includes ghost cells */
 
   /* Create the output file */
-  out = fopen(outname, "w");
+  snprintf(comment, sizeof(comment), "produced by %s %d %d", argv[0], width, steps);
+  out = pbm_open(outname, width, steps, every, comment);
   if ( !out ) {
     fprintf(stderr, "FATAL: cannot create file \"%s\"\n", outname);
     return EXIT_FAILURE;
   }
-  fprintf(out, "P1\n");
-  fprintf(out, "# produced by %s %d %d\n", argv[0], width, steps);
-  fprintf(out, "%d %d\n", width, steps);
 
   /* Allocate space for the cur[] and next[] arrays */
   cur = (cell_t*)malloc(ext_size);
@@ -163,8 +162,11 @@ int main( int argc, char* argv[] )
   /* Evolve the CA */
   for (s=0; s<steps; s++) {
 
-    /* Dump the current state */
-    dump_state(out, cur, ext_width);
+    /* Dump the current state, if this row is sampled */
+    if ( pbm_wants(out) ) {
+      CudaSafeCall(cudaMemcpy(cur, d_cur, ext_size, cudaMemcpyDeviceToHost));
+    }
+    pbm_put_row(out, cur + 1);
 
     /* Fill ghost cells */
     /*
@@ -178,8 +180,6 @@ int main( int argc, char* argv[] )
     step_kernel<<<(width + BLKSIZE - 1) / BLKSIZE, BLKSIZE>>>(d_cur, d_next, ext_width);
     CudaCheckError();
 
-    CudaSafeCall(cudaMemcpy(cur, d_cur, ext_size, cudaMemcpyDeviceToHost));
-
     /* swap cur and next */
     cell_t *tmp = d_cur;
     d_cur = d_next;
@@ -190,7 +190,10 @@ int main( int argc, char* argv[] )
   cudaFree(d_cur);
   cudaFree(d_next);
 
-  fclose(out);
+  if ( pbm_close(out) != 0 ) {
+    fprintf(stderr, "FATAL: error writing \"%s\"\n", outname);
+    return EXIT_FAILURE;
+  }
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,215 @@
+/* */
+/****************************************************************************
+ *
+ * pbm-writer.h - Streaming writer of binary (P4) PBM images
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Writing a cellular automaton as an ASCII (P1) PBM image, with one
+ * fprintf() per cell, is often slower than computing it, and produces
+ * a file of two bytes per cell. A binary (P4) PBM image stores 8
+ * cells per byte (the first cell of each group in the most
+ * significant bit, 1 = black, each row padded to a whole byte).
+ *
+ * This header writes P4 images one row at a time. pbm_put_row() packs
+ * a row of cells (one byte per cell, nonzero = 1) into a slot of a
+ * ring buffer and returns at once; a separate I/O thread writes the
+ * completed rows to the file, as many consecutive rows as possible in
+ * a single fwrite(), through a large stdio buffer. The computation
+ * only waits if the I/O thread falls behind by more than the whole
+ * ring (PBM_RING_BYTES bytes).
+ *
+ * The writer can keep only one row (generation) every |every|:
+ * pbm_wants() tells whether the next row will be kept, so that the
+ * caller can avoid fetching the rows that would be discarded.
+ *
+ *   pbm_writer_t *w = pbm_open("out.pbm", width, nrows, every, "comment");
+ *   for (...) {
+ *     if ( pbm_wants(w) ) { ... fetch row ... }
+ *     pbm_put_row(w, row);
+ *   }
+ *   pbm_close(w);
+ *
+ * Only the thread that calls pbm_open() may use the writer. With
+ * -std=c99, define _XOPEN_SOURCE to 600 before including any header;
+ * link with -lpthread.
+ *
+ ****************************************************************************/
+
+#ifndef PBM_WRITER_H
+#define PBM_WRITER_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PBM_RING_BYTES (16*1024*1024)
+#define PBM_BUFSIZE (4*1024*1024)
+
+typedef struct {
+  FILE *f;
+  char *buf;              /* stdio buffer of f */
+  int width;
+  int every;
+  long gen;               /* number of rows given to pbm_put_row() */
+  size_t rowbytes;        /* (width + 7) / 8 */
+  unsigned char *ring;    /* nslots rows of rowbytes bytes */
+  int nslots;
+  int head;               /* next slot to fill */
+  int tail;               /* next slot to write */
+  int count;              /* filled slots not yet written */
+  int done;               /* no more rows will be added */
+  int error;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty, not_full;
+  pthread_t thread;
+} pbm_writer_t;
+
+/* Body of the I/O thread: write the filled slots, in batches of
+   consecutive slots, until the writer is closed */
+void *pbm_io_thread( void *arg )
+{
+  pbm_writer_t *w = (pbm_writer_t*)arg;
+
+  pthread_mutex_lock(&w->mutex);
+  for (;;) {
+    int n;
+    while ( 0 == w->count && !w->done ) {
+      pthread_cond_wait(&w->not_empty, &w->mutex);
+    }
+    if ( 0 == w->count ) {
+      break;
+    }
+    /* the slots tail, ... tail+n-1 are contiguous in the ring */
+    n = (w->tail + w->count <= w->nslots ? w->count : w->nslots - w->tail);
+    pthread_mutex_unlock(&w->mutex);
+    if ( fwrite(w->ring + w->tail * w->rowbytes, w->rowbytes, n, w->f) != (size_t)n ) {
+      w->error = 1;
+    }
+    pthread_mutex_lock(&w->mutex);
+    w->tail = (w->tail + n) % w->nslots;
+    w->count -= n;
+    pthread_cond_signal(&w->not_full);
+  }
+  pthread_mutex_unlock(&w->mutex);
+  return NULL;
+}
+
+/* Create file |fname| with an image of |width| columns, that will
+   hold one row every |every| of the |nrows| rows given to
+   pbm_put_row(); |comment| may be NULL. Returns NULL if the file can
+   not be created. */
+pbm_writer_t *pbm_open( const char *fname, int width, int nrows, int every, const char *comment )
+{
+  pbm_writer_t *w;
+  FILE *f = fopen(fname, "wb");
+
+  if ( !f ) {
+    return NULL;
+  }
+  w = (pbm_writer_t*)malloc(sizeof(*w));
+  w->f = f;
+  w->buf = (char*)malloc(PBM_BUFSIZE);
+  setvbuf(f, w->buf, _IOFBF, PBM_BUFSIZE);
+  fprintf(f, "P4\n");
+  if ( comment ) {
+    fprintf(f, "# %s\n", comment);
+  }
+  fprintf(f, "%d %d\n", width, (nrows + every - 1) / every);
+
+  w->width = width;
+  w->every = every;
+  w->gen = 0;
+  w->rowbytes = (width + 7) / 8;
+  /* no more slots than rows to write, at least one */
+  w->nslots = PBM_RING_BYTES / w->rowbytes;
+  w->nslots = (w->nslots > (nrows + every - 1) / every ? (nrows + every - 1) / every : w->nslots);
+  w->nslots = (w->nslots < 1 ? 1 : w->nslots);
+  w->ring = (unsigned char*)malloc(w->nslots * w->rowbytes);
+  w->head = w->tail = w->count = 0;
+  w->done = w->error = 0;
+  pthread_mutex_init(&w->mutex, NULL);
+  pthread_cond_init(&w->not_empty, NULL);
+  pthread_cond_init(&w->not_full, NULL);
+  pthread_create(&w->thread, NULL, pbm_io_thread, w);
+  return w;
+}
+
+/* Nonzero iff the next row given to pbm_put_row() will be written */
+int pbm_wants( const pbm_writer_t *w )
+{
+  return (0 == w->gen % w->every);
+}
+
+/* Add the row of |width| cells |cells| (one byte per cell, nonzero =
+   black) to the image, or skip it if it is not one of the sampled
+   rows */
+void pbm_put_row( pbm_writer_t *w, const void *cells )
+{
+  const unsigned char *c = (const unsigned char*)cells;
+  unsigned char *row;
+  const int keep = pbm_wants(w);
+  int i, b;
+
+  w->gen++;
+  if ( !keep ) {
+    return;
+  }
+
+  pthread_mutex_lock(&w->mutex);
+  while ( w->count == w->nslots ) {
+    pthread_cond_wait(&w->not_full, &w->mutex);
+  }
+  pthread_mutex_unlock(&w->mutex);
+
+  /* the I/O thread does not touch the head slot until it is counted */
+  row = w->ring + w->head * w->rowbytes;
+  for (b=0; b<(int)w->rowbytes; b++) {
+    unsigned char v = 0;
+    const int lim = (8*b + 8 <= w->width ? 8 : w->width - 8*b);
+    for (i=0; i<lim; i++) {
+      v |= (c[8*b + i] != 0) << (7 - i);
+    }
+    row[b] = v;
+  }
+
+  pthread_mutex_lock(&w->mutex);
+  w->head = (w->head + 1) % w->nslots;
+  w->count++;
+  pthread_cond_signal(&w->not_empty);
+  pthread_mutex_unlock(&w->mutex);
+}
+
+/* Write the remaining rows and close the file; returns 0 on success,
+   -1 if some write failed */
+int pbm_close( pbm_writer_t *w )
+{
+  int result;
+  int closed;
+
+  pthread_mutex_lock(&w->mutex);
+  w->done = 1;
+  pthread_cond_signal(&w->not_empty);
+  pthread_mutex_unlock(&w->mutex);
+  pthread_join(w->thread, NULL);
+
+  closed = fclose(w->f);
+  result = (w->error || closed != 0 ? -1 : 0);
+  pthread_mutex_destroy(&w->mutex);
+  pthread_cond_destroy(&w->not_empty);
+  pthread_cond_destroy(&w->not_full);
+  free(w->ring);
+  free(w->buf);
+  free(w);
+  return result;
+}
+
+#endif
@@ -16,14 +16,20 @@
  * --------------------------------------------------------------------------
  *
  * Compile with:
- * gcc -ansi -Wall -Wpedantic bbox-gen.c -o bbox-gen
+ * gcc -std=c99 -Wall -Wpedantic bbox-gen.c -o bbox-gen
  *
  * To generate 1000 random rectangles, run:
  * ./bbox-gen 1000 > bbox-1000.in
  *
+ * With -b the rectangles are written in the binary columnar format of
+ * colfile.h (fields x1, y1, x2, y2), that mpi-bbox reads in parallel:
+ * ./bbox-gen -b 1000000 > bbox-1000000.bin
+ *
  ****************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "colfile.h"
 
 float randab(float a, float b)
 {
@@ -32,19 +38,43 @@ float randab(float a, float b)
 
 int main( int argc, char* argv[] )
 {
-    int i, n;
-    if ( argc != 2 ) {
-        printf("Usage: %s n\n", argv[0]);
+    int i, n, binary;
+    float *cols[4];
+    binary = ( argc == 3 && 0 == strcmp(argv[1], "-b") );
+    if ( argc != 2 + binary ) {
+        printf("Usage: %s [-b] n\n", argv[0]);
         return -1;
     }
-    n = atoi( argv[1] );
-    printf("%d\n", n);
+    n = atoi( argv[1 + binary] );
+    if ( binary ) {
+        for (i=0; i<4; i++) {
+            cols[i] = (float*)malloc(n * sizeof(float));
+        }
+    } else {
+        printf("%d\n", n);
+    }
     for (i=0; i<n; i++) {
         float x1 = randab(0, 1000);
         float y1 = randab(0, 1000);
         float x2 = x1 + randab(10, 100);
         float y2 = y1 + randab(10, 100);
-        printf("%f %f %f %f\n", x1, y1, x2, y2);
+        if ( binary ) {
+            cols[0][i] = x1;
+            cols[1][i] = y1;
+            cols[2][i] = x2;
+            cols[3][i] = y2;
+        } else {
+            printf("%f %f %f %f\n", x1, y1, x2, y2);
+        }
+    }
+    if ( binary ) {
+        if ( colfile_write(stdout, 4, n, cols) ) {
+            fprintf(stderr, "Write error\n");
+            return -1;
+        }
+        for (i=0; i<4; i++) {
+            free(cols[i]);
+        }
     }
     return 0;
 }
@@ -0,0 +1,141 @@
+/* */
+/****************************************************************************
+ *
+ * colfile.h - Binary columnar files of floats
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * A columnar file holds |nfields| arrays of |n| floats each (e.g., the
+ * x, y, r coordinates of n circles). The file starts with a 16-byte
+ * header:
+ *
+ *   char    magic[4]  "FCOL"
+ *   int32_t nfields
+ *   int64_t n
+ *
+ * followed by the arrays one after the other: element i of field k is
+ * at offset 16 + (k*n + i)*4. All values use the byte order of the
+ * machine that wrote the file.
+ *
+ * Since the position of every value is known in advance, each MPI
+ * process can read just the part it needs with MPI-IO, in parallel
+ * with the others, instead of having a single process parse a text
+ * file and send the data to the others. colfile_write() is used by the
+ * generators; colfile_open() and colfile_read_at() are only defined
+ * when mpi.h has been included before this file.
+ *
+ * This file is used by ex2-mpi (bbox-gen.c, mpi-bbox.c) and ex3-mpi
+ * (circles-gen.c, mpi-circles.c); keep the copies in sync.
+ *
+ ****************************************************************************/
+
+#ifndef COLFILE_H
+#define COLFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+#define COLFILE_MAGIC "FCOL"
+
+typedef struct {
+  char magic[4];
+  int32_t nfields;
+  int64_t n;
+} colfile_header_t;
+
+/* Offset of element |i| of field |k| in a file with |n| elements per
+   field */
+int64_t colfile_offset( int64_t n, int k, int64_t i )
+{
+  return (int64_t)sizeof(colfile_header_t) + ((int64_t)k * n + i) * (int64_t)sizeof(float);
+}
+
+/* Write |nfields| arrays cols[0], ... cols[nfields-1] of |n| floats to
+   |out|; returns 0 on success */
+int colfile_write( FILE *out, int nfields, int64_t n, float **cols )
+{
+  colfile_header_t h;
+  int k;
+
+  memcpy(h.magic, COLFILE_MAGIC, sizeof(h.magic));
+  h.nfields = nfields;
+  h.n = n;
+  if ( fwrite(&h, sizeof(h), 1, out) != 1 ) {
+    return 1;
+  }
+  for (k=0; k<nfields; k++) {
+    if ( fwrite(cols[k], sizeof(float), n, out) != (size_t)n ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#ifdef MPI_VERSION
+
+/* Open |fname| for reading on all the processes of |comm| (this is a
+   collective operation), and read the header. Returns 0 if the file is
+   a columnar file with |nfields| fields, storing the handle in |fh|
+   and the number of elements per field in |n|; returns 1 if the file
+   exists but is not such a file (e.g., it is a text file), 2 if it is
+   such a file but is truncated, or holds more than INT_MAX elements
+   per field, and -1 if it can not be opened. The handle must be
+   closed with MPI_File_close(). */
+int colfile_open( MPI_Comm comm, const char *fname, int nfields, MPI_File *fh, int64_t *n )
+{
+  colfile_header_t h;
+  MPI_Offset size;
+
+  if ( MPI_File_open(comm, fname, MPI_MODE_RDONLY, MPI_INFO_NULL, fh) != MPI_SUCCESS ) {
+    return -1;
+  }
+  memset(&h, 0, sizeof(h));
+  MPI_File_read_at_all(*fh, 0, &h, sizeof(h), MPI_BYTE, MPI_STATUS_IGNORE);
+  if ( memcmp(h.magic, COLFILE_MAGIC, sizeof(h.magic)) || h.nfields != nfields || h.n < 0 ) {
+    MPI_File_close(fh);
+    return 1;
+  }
+  MPI_File_get_size(*fh, &size);
+  if ( h.n > INT_MAX || size < colfile_offset(h.n, nfields, 0) ) {
+    MPI_File_close(fh);
+    return 2;
+  }
+  *n = h.n;
+  return 0;
+}
+
+/* Read the elements start, ... start+count-1 of each field k of the
+   open file |fh|, that has |n| elements per field, into cols[k]. This
+   is a collective operation; every process reads its own range.
+   Returns 0 on success, 1 if some of the elements could not be read
+   by this process. */
+int colfile_read_at( MPI_File fh, int nfields, int64_t n, int64_t start, int count, float **cols )
+{
+  MPI_Status status;
+  int k, got, result = 0;
+  for (k=0; k<nfields; k++) {
+    if ( MPI_File_read_at_all(fh, (MPI_Offset)colfile_offset(n, k, start), cols[k], count, MPI_FLOAT, &status) != MPI_SUCCESS ) {
+      result = 1;
+      continue;
+    }
+    MPI_Get_count(&status, MPI_FLOAT, &got);
+    if ( got != count ) {
+      result = 1;
+    }
+  }
+  return result;
+}
+
+#endif
+
+#endif
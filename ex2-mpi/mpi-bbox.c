@@ -16,32 +16,53 @@
  *
  * --------------------------------------------------------------------------
  *
+ * The input file is either a text file (the number N of rectangles,
+ * then one rectangle x1 y1 x2 y2 per line), that is read by the
+ * master and scattered to the other processes, or a binary columnar
+ * file (see colfile.h) produced by "bbox-gen -b"; in this case every
+ * process reads its own part of the rectangles with MPI-IO. A text
+ * file is distributed with one MPI_Scatterv() per coordinate.
+ *
+ * Each process computes the (min, max, sum, count) tuple of each
+ * coordinate of its rectangles, and the tuples are reduced with a
+ * single collective (see reduce-kit.h). With -r reps the program also
+ * measures, over |reps| repetitions, the latency of the reduction done
+ * with four MPI_Reduce() calls, with the fused reduction, and with the
+ * hierarchical (node, then global) fused reduction, and for text
+ * input the latency of four MPI_Scatterv() calls and of a single
+ * collective that sends all the coordinates (rk_scatter_fields() in
+ * reduce-kit.h), which is slower at these sizes.
+ *
  * Compile with:
  * mpicc -std=c99 -Wall -Wpedantic mpi-bbox.c -lm -o mpi-bbox
  *
  * Run with:
- * mpirun -n 4 ./mpi-bbox bbox-1000.in
+ * mpirun -n 4 ./mpi-bbox [-r reps] bbox-1000.in
  *
  ****************************************************************************/
 
+/* The following #define is required by getopt() */
+#define _XOPEN_SOURCE 600
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h> /* for fminf() */
+#include <unistd.h> /* for getopt() */
 #include <mpi.h>
+#include "colfile.h"
+#include "reduce-kit.h"
 
 /* Compute the bounding box of |n| rectangles whose opposite vertices
    have coordinates (|x1[i]|, |y1[i]|), (|x2[i]|, |y2[i]|). The
    opposite corners of the bounding box will be stored in (|xb1|,
-   |yb1|), (|xb2|, |yb2|) */   
+   |yb1|), (|xb2|, |yb2|); if n == 0 the box is empty (xb1 > xb2) */
 void bbox( const float *x1, const float *y1, const float* x2, const float *y2, int n,
     float *xb1, float *yb1, float *xb2, float *yb2 )
 {
   int i;
-  *xb1 = x1[0];
-  *yb1 = y1[0];
-  *xb2 = x2[0];
-  *yb2 = y2[0];
-  for (i=1; i<n; i++) {
+  *xb1 = *yb1 = HUGE_VALF;
+  *xb2 = *yb2 = -HUGE_VALF;
+  for (i=0; i<n; i++) {
     *xb1 = fminf( *xb1, x1[i] );
     *yb1 = fminf( *yb1, y1[i] );
     *xb2 = fmaxf( *xb2, x2[i] );
@@ -49,31 +70,76 @@ void bbox( const float *x1, const float *y1, const float* x2, const float *y2, i
   }
 }
 
+/* Compute the tuples st[0], ... st[3] of the coordinates x1, y1, x2,
+   y2 of the |n| rectangles; the bounding box has corners (st[0].min,
+   st[1].min), (st[2].max, st[3].max) */
+void bbox_stats( const float *x1, const float *y1, const float* x2, const float *y2, int n, rk_stats_t st[4] )
+{
+  int i;
+  rk_stats_init(st, 4);
+  for (i=0; i<n; i++) {
+    rk_stats_add(&st[0], x1[i]);
+    rk_stats_add(&st[1], y1[i]);
+    rk_stats_add(&st[2], x2[i]);
+    rk_stats_add(&st[3], y2[i]);
+  }
+}
+
 int main( int argc, char* argv[] )
 {
   float *x1, *y1, *x2, *y2;
-  float xb1, yb1, xb2, yb2;
-  int N;
+  int N, reps = 0, opt;
   int my_rank, comm_sz;
+  rk_t rk;
+  rk_stats_t st[4], local_st[4], node_st[4];
 
   MPI_Init(&argc, &argv);
   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
 
-  if ( (0 == my_rank) && (argc != 2) ) {
-    printf("Usage: %s [inputfile]\n", argv[0]);
+  while ( (opt = getopt(argc, argv, "r:")) != -1 ) {
+    switch (opt) {
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    default:
+      optind = argc; /* print the usage message */
+    }
+  }
+
+  if ( (0 == my_rank) && (argc - optind != 1) ) {
+    printf("Usage: %s [-r reps] inputfile\n", argv[0]);
     MPI_Abort(MPI_COMM_WORLD, -1);
   }
+  const char *fname = argv[optind];
+
+  rk_init(&rk, MPI_COMM_WORLD);
 
   x1 = y1 = x2 = y2 = NULL;
 
-  /* [TODO] This is not a true parallel version since the master
-     does everything */
-  if ( 0 == my_rank ) {
-    FILE *in = fopen(argv[1], "r");
+  int *displs = (int*) malloc(comm_sz * sizeof(*displs));
+  int *sendcounts = (int*) malloc(comm_sz * sizeof(*sendcounts));
+  float *local_x1, *local_y1, *local_x2, *local_y2;
+  MPI_File fh;
+  int64_t n64;
+
+  const double tstart = MPI_Wtime();
+  const int status = colfile_open(MPI_COMM_WORLD, fname, 4, &fh, &n64);
+  const int binary = (0 == status);
+
+  if ( (0 == my_rank) && (2 == status) ) {
+    fprintf(stderr, "FATAL: %s is truncated, or holds too many rectangles\n", fname);
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  if ( binary ) {
+    N = n64;
+  } else if ( 0 == my_rank ) {
+    /* [TODO] This is not a true parallel version since the master
+       does everything */
+    FILE *in = fopen(fname, "r");
     int i;
     if ( !in ) {
-      fprintf(stderr, "Cannot open %s for reading\n", argv[1]);
+      fprintf(stderr, "Cannot open %s for reading\n", fname);
       MPI_Abort(MPI_COMM_WORLD, -1);
     }
     fscanf(in, "%d", &N);
@@ -87,43 +153,104 @@ int main( int argc, char* argv[] )
     fclose(in);
   }
 
-  MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-  int *displs = (int*) malloc(comm_sz * sizeof(*displs));
-  int *sendcounts = (int*) malloc(comm_sz * sizeof(*sendcounts));
-  float local_xb1, local_yb1, local_xb2, local_yb2;
-  float *local_x1, *local_y1, *local_x2, *local_y2;
+  if ( ! binary ) {
+    MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  }
 
   for (int i = 0; i < comm_sz; i++) {
-    const int start = N * i / comm_sz;
-    const int end = N * (i + 1) / comm_sz;
+    const int start = N * (long)i / comm_sz;
+    const int end = N * (long)(i + 1) / comm_sz;
     const int size = end - start;
     displs[i] = start;
     sendcounts[i] = size;
   }
 
   const int local_n = sendcounts[my_rank];
-  printf("local sendcounts: %d of %d\n", local_n, N);
   local_x1 = (float*) malloc(local_n * sizeof(*local_x1));
   local_y1 = (float*) malloc(local_n * sizeof(*local_y1));
   local_x2 = (float*) malloc(local_n * sizeof(*local_x2));
   local_y2 = (float*) malloc(local_n * sizeof(*local_y2));
-  printf("Finish allocate malloc\n");
 
-  MPI_Scatterv(x1, sendcounts, displs, MPI_FLOAT, local_x1, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  MPI_Scatterv(y1, sendcounts, displs, MPI_FLOAT, local_y1, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  MPI_Scatterv(x2, sendcounts, displs, MPI_FLOAT, local_x2, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  MPI_Scatterv(y2, sendcounts, displs, MPI_FLOAT, local_y2, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+  float * const cols[4] = { x1, y1, x2, y2 };
+  float *local_cols[4] = { local_x1, local_y1, local_x2, local_y2 };
+  if ( binary ) {
+    /* each process reads its own slice of every field */
+    if ( colfile_read_at(fh, 4, n64, displs[my_rank], local_n, local_cols) ) {
+      fprintf(stderr, "FATAL: process %d could not read its part of %s\n", my_rank, fname);
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    MPI_File_close(&fh);
+  } else {
+    MPI_Scatterv(x1, sendcounts, displs, MPI_FLOAT, local_x1, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Scatterv(y1, sendcounts, displs, MPI_FLOAT, local_y1, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Scatterv(x2, sendcounts, displs, MPI_FLOAT, local_x2, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Scatterv(y2, sendcounts, displs, MPI_FLOAT, local_y2, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+  }
+  const double tload = MPI_Wtime() - tstart;
+
+  bbox_stats(local_x1, local_y1, local_x2, local_y2, local_n, local_st);
+  rk_reduce(&rk, local_st, st, 4);
+
+  if (0 == my_rank) {
+    printf("bbox: %f %f %f %f\n", st[0].min, st[1].min, st[2].max, st[3].max);
+    printf("%d rectangles, average size %f x %f\n", (int)st[0].count,
+           (st[2].sum - st[0].sum) / st[0].count, (st[3].sum - st[1].sum) / st[1].count);
+    printf("%d rectangles (%s input), loaded and distributed in %f s\n", N, (binary ? "binary" : "text"), tload);
+  }
 
-  bbox(local_x1, local_y1, local_x2, local_y2, local_n, &local_xb1, &local_yb1, &local_xb2, &local_yb2);
+  if ( reps > 0 ) {
+    float lb[4], b[4];
+    double t[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    int k;
 
-  MPI_Reduce(&local_xb1, &xb1, 1, MPI_FLOAT, MPI_MIN, 0, MPI_COMM_WORLD);
-  MPI_Reduce(&local_yb1, &yb1, 1, MPI_FLOAT, MPI_MIN, 0, MPI_COMM_WORLD);
-  MPI_Reduce(&local_xb2, &xb2, 1, MPI_FLOAT, MPI_MAX, 0, MPI_COMM_WORLD);
-  MPI_Reduce(&local_yb2, &yb2, 1, MPI_FLOAT, MPI_MAX, 0, MPI_COMM_WORLD);
+    bbox(local_x1, local_y1, local_x2, local_y2, local_n, &lb[0], &lb[1], &lb[2], &lb[3]);
+    for (k=0; k<reps; k++) {
+      double t0;
+      MPI_Barrier(MPI_COMM_WORLD);
+      t0 = MPI_Wtime();
+      MPI_Reduce(&lb[0], &b[0], 1, MPI_FLOAT, MPI_MIN, 0, MPI_COMM_WORLD);
+      MPI_Reduce(&lb[1], &b[1], 1, MPI_FLOAT, MPI_MIN, 0, MPI_COMM_WORLD);
+      MPI_Reduce(&lb[2], &b[2], 1, MPI_FLOAT, MPI_MAX, 0, MPI_COMM_WORLD);
+      MPI_Reduce(&lb[3], &b[3], 1, MPI_FLOAT, MPI_MAX, 0, MPI_COMM_WORLD);
+      t[0] += MPI_Wtime() - t0;
+      MPI_Barrier(MPI_COMM_WORLD);
+      t0 = MPI_Wtime();
+      rk_reduce(&rk, local_st, st, 4);
+      t[1] += MPI_Wtime() - t0;
+      MPI_Barrier(MPI_COMM_WORLD);
+      t0 = MPI_Wtime();
+      rk_reduce_hier(&rk, local_st, st, node_st, 4);
+      t[2] += MPI_Wtime() - t0;
+      if ( ! binary ) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        t0 = MPI_Wtime();
+        MPI_Scatterv(x1, sendcounts, displs, MPI_FLOAT, local_x1, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        MPI_Scatterv(y1, sendcounts, displs, MPI_FLOAT, local_y1, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        MPI_Scatterv(x2, sendcounts, displs, MPI_FLOAT, local_x2, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        MPI_Scatterv(y2, sendcounts, displs, MPI_FLOAT, local_y2, local_n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        t[3] += MPI_Wtime() - t0;
+        MPI_Barrier(MPI_COMM_WORLD);
+        t0 = MPI_Wtime();
+        rk_scatter_fields(&rk, cols, 4, sendcounts, displs, local_cols);
+        t[4] += MPI_Wtime() - t0;
+      }
+    }
+    if ( 0 == my_rank ) {
+      if ( b[0] != st[0].min || b[1] != st[1].min || b[2] != st[2].max || b[3] != st[3].max ) {
+        printf("Check FAILED: the reductions differ\n");
+      }
+      printf("Average latency over %d repetitions, %d processes:\n", reps, comm_sz);
+      printf("  4 x MPI_Reduce          %10.2f us\n", 1e6 * t[0] / reps);
+      printf("  fused reduce            %10.2f us\n", 1e6 * t[1] / reps);
+      printf("  hierarchical fused      %10.2f us\n", 1e6 * t[2] / reps);
+      if ( ! binary ) {
+        printf("  4 x MPI_Scatterv        %10.2f us\n", 1e6 * t[3] / reps);
+        printf("  rk_scatter_fields       %10.2f us\n", 1e6 * t[4] / reps);
+      }
+    }
+  }
 
   if (0 == my_rank) {
-    printf("bbox: %f %f %f %f\n", xb1, yb1, xb2, yb2);
     free(x1);
     free(y1);
     free(x2);
@@ -137,6 +264,7 @@ int main( int argc, char* argv[] )
   free(local_y1);
   free(local_x2);
   free(local_y2);
+  rk_free(&rk);
 
   MPI_Finalize();
 
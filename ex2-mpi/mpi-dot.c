@@ -16,38 +16,227 @@
  *
  * --------------------------------------------------------------------------
  *
+ * The local dot products are computed by dot(), that is
+ * multithreaded (OpenMP) and vectorized in the same way as sum() in
+ * ex1-mpi/mpi-sum.c: each thread handles a contiguous chunk with NACC
+ * independent vector accumulators, and the partial results are
+ * combined pairwise, always in the same order. Run one process per
+ * node (or socket) and one thread per core, e.g.:
+ *
+ * OMP_NUM_THREADS=8 mpirun -n 4 --map-by ppr:1:socket --bind-to socket ./mpi-dot 100000000
+ *
+ * The time of the local computation (the slowest process) is printed
+ * to measure the scaling with the number of processes and threads.
+ *
+ * The program then computes the dot product again with
+ * dot_pipelined(), that overlaps the distribution of the vectors with
+ * the computation, using chunks of |chunk| elements per process
+ * (chunk=0 skips it), and reports the speedup over the blocking
+ * version and the overlap efficiency: the fraction of the time of the
+ * pipelined version spent computing by the slowest process (100% means
+ * that the communication is completely hidden).
+ *
  * Compile with:
- * mpicc -std=c99 -Wall -Wpedantic mpi-dot.c -lm -o mpi-dot
+ * mpicc -std=c99 -Wall -Wpedantic -O3 -march=native -fopenmp mpi-dot.c -lm -o mpi-dot
  *
  * Run with:
- * mpirun -n 4 ./mpi-dot
+ * mpirun -n 4 ./mpi-dot [n [chunk]]
  *
  ****************************************************************************/
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h> /* for fabs() */
+#include <string.h> /* for memcpy() */
+#include <omp.h>
+
+typedef double v4d __attribute__((vector_size(32)));
+#define VLEN ((int)(sizeof(v4d)/sizeof(double)))
+#define NACC 4       /* independent vector accumulators */
+#define BLKLEN 2048  /* vectors up to this length are handled directly */
+
+/* Dot product of |x| and |y| of length |n| <= BLKLEN, with NACC*VLEN
+   partial sums */
+double dot_block( const double* x, const double* y, int n )
+{
+  v4d acc[NACC];
+  double s;
+  int i, k;
+
+  memset(acc, 0, sizeof(acc));
+  for (i=0; i + NACC*VLEN <= n; i += NACC*VLEN) {
+    for (k=0; k<NACC; k++) {
+      v4d vx, vy;
+      memcpy(&vx, x + i + k*VLEN, sizeof(vx)); /* x, y may be unaligned */
+      memcpy(&vy, y + i + k*VLEN, sizeof(vy));
+      acc[k] += vx * vy;
+    }
+  }
+  for (k=NACC/2; k>0; k /= 2) {
+    int j;
+    for (j=0; j<k; j++) {
+      acc[j] += acc[j + k];
+    }
+  }
+  s = (acc[0][0] + acc[0][2]) + (acc[0][1] + acc[0][3]);
+  for ( ; i<n; i++) {
+    s += x[i] * y[i];
+  }
+  return s;
+}
+
+/* Pairwise dot product of |x| and |y| of length |n| */
+double dot_pairwise( const double* x, const double* y, int n )
+{
+  if ( n <= BLKLEN ) {
+    return dot_block(x, y, n);
+  } else {
+    const int h = n / 2;
+    return dot_pairwise(x, y, h) + dot_pairwise(x + h, y + h, n - h);
+  }
+}
+
+/* Pairwise sum of the |n| >= 1 values |v| */
+double sum_pairwise( const double* v, int n )
+{
+  if ( 1 == n ) {
+    return v[0];
+  } else {
+    const int h = n / 2;
+    return sum_pairwise(v, h) + sum_pairwise(v + h, n - h);
+  }
+}
 
 /*
  * Compute sum { x[i] * y[i] }, i=0, ... n-1
  */
 double dot( const double* x, const double* y, int n )
 {
-  double s = 0.0;
-  int i;
-  for (i=0; i<n; i++) {
-    s += x[i] * y[i];
+  const int nthreads = omp_get_max_threads();
+  double *partial = (double*)calloc(nthreads, sizeof(*partial));
+  double s;
+
+#pragma omp parallel default(none) shared(x, y, n, partial)
+  {
+    const int my_id = omp_get_thread_num();
+    const int nt = omp_get_num_threads();
+    const int start = (long)n * my_id / nt;
+    const int end = (long)n * (my_id + 1) / nt;
+    partial[my_id] = dot_pairwise(x + start, y + start, end - start);
   }
+  /* partial[] is zero beyond the size of the team, if smaller */
+  s = sum_pairwise(partial, nthreads);
+  free(partial);
   return s;
 }
 
+/* Layout of round |c| of the pipeline: the part of process p is
+   split into chunks of |chunk| elements, and round c sends chunk c of
+   every process (which may be empty) */
+void round_layout( int n, int comm_sz, int chunk, int c, int *counts, int *displs )
+{
+  int p;
+  for (p=0; p<comm_sz; p++) {
+    const long start = (long)n * p / comm_sz + (long)c * chunk;
+    const long end = (long)n * (p + 1) / comm_sz;
+    displs[p] = (start < end ? start : end);
+    counts[p] = (start + chunk < end ? chunk : end - displs[p]);
+  }
+}
+
+/*
+ * Same result as scattering x and y and reducing the local dot
+ * products, but in rounds: while a process computes on the chunk
+ * received in round c, the chunks of round c+1 are being scattered
+ * with MPI_Iscatterv() into the other buffer (double buffering), and
+ * the result of each round is reduced with MPI_Ireduce() while the
+ * next rounds proceed. Each process only needs buffers for two
+ * chunks. Since MPI may progress nonblocking operations only inside
+ * MPI calls, the computation is done in slices of PROGRESS_LEN
+ * elements with a call to MPI_Testall() after each one. The result is
+ * returned on rank 0; the time spent computing is stored in |t_comp|.
+ */
+#define PROGRESS_LEN 65536
+
+double dot_pipelined( const double* x, const double* y, int n, int chunk, double *t_comp )
+{
+  int my_rank, comm_sz, nrounds, c, b;
+  int *counts[2], *displs[2];
+  double *bufx[2], *bufy[2];
+  double partial[2], round_result[2], result = 0.0;
+  MPI_Request scatter_req[2][2], reduce_req[2];
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+  const int max_local = (n + comm_sz - 1) / comm_sz;
+  nrounds = (max_local + chunk - 1) / chunk;
+  *t_comp = 0.0;
+  for (b=0; b<2; b++) {
+    counts[b] = (int*)malloc(comm_sz * sizeof(int));
+    displs[b] = (int*)malloc(comm_sz * sizeof(int));
+    bufx[b] = (double*)malloc(chunk * sizeof(double));
+    bufy[b] = (double*)malloc(chunk * sizeof(double));
+    reduce_req[b] = MPI_REQUEST_NULL;
+  }
+
+  if (nrounds > 0) {
+    round_layout(n, comm_sz, chunk, 0, counts[0], displs[0]);
+    MPI_Iscatterv(x, counts[0], displs[0], MPI_DOUBLE, bufx[0], counts[0][my_rank], MPI_DOUBLE, 0, MPI_COMM_WORLD, &scatter_req[0][0]);
+    MPI_Iscatterv(y, counts[0], displs[0], MPI_DOUBLE, bufy[0], counts[0][my_rank], MPI_DOUBLE, 0, MPI_COMM_WORLD, &scatter_req[0][1]);
+  }
+  for (c=0; c<nrounds; c++) {
+    const int cur = c % 2, next = 1 - cur;
+    const int local_n = counts[cur][my_rank];
+    int i;
+
+    MPI_Waitall(2, scatter_req[cur], MPI_STATUSES_IGNORE);
+    if (c + 1 < nrounds) {
+      round_layout(n, comm_sz, chunk, c + 1, counts[next], displs[next]);
+      MPI_Iscatterv(x, counts[next], displs[next], MPI_DOUBLE, bufx[next], counts[next][my_rank], MPI_DOUBLE, 0, MPI_COMM_WORLD, &scatter_req[next][0]);
+      MPI_Iscatterv(y, counts[next], displs[next], MPI_DOUBLE, bufy[next], counts[next][my_rank], MPI_DOUBLE, 0, MPI_COMM_WORLD, &scatter_req[next][1]);
+    }
+    /* the reduction of round c-2 used the same slot */
+    MPI_Wait(&reduce_req[cur], MPI_STATUS_IGNORE);
+    if (c >= 2) {
+      result += round_result[cur];
+    }
+    partial[cur] = 0.0;
+    const double t0 = MPI_Wtime();
+    for (i=0; i<local_n; i += PROGRESS_LEN) {
+      const int len = (local_n - i < PROGRESS_LEN ? local_n - i : PROGRESS_LEN);
+      int flag;
+      partial[cur] += dot(bufx[cur] + i, bufy[cur] + i, len);
+      if (c + 1 < nrounds) {
+        MPI_Testall(2, scatter_req[next], &flag, MPI_STATUSES_IGNORE);
+      }
+    }
+    *t_comp += MPI_Wtime() - t0;
+    MPI_Ireduce(&partial[cur], &round_result[cur], 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD, &reduce_req[cur]);
+  }
+  /* add the results of the last two rounds, in order */
+  for (c=(nrounds > 2 ? nrounds - 2 : 0); c<nrounds; c++) {
+    MPI_Wait(&reduce_req[c % 2], MPI_STATUS_IGNORE);
+    result += round_result[c % 2];
+  }
+
+  for (b=0; b<2; b++) {
+    free(counts[b]);
+    free(displs[b]);
+    free(bufx[b]);
+    free(bufy[b]);
+  }
+  return result;
+}
+
 int main(int argc, char* argv[])
 {
   double *x = NULL, *y = NULL, result = 0.0;
-  int n = 1000;
-  int my_rank, comm_sz;
+  int n = 1000, chunk = 65536;
+  int my_rank, comm_sz, provided;
+  double tstart, t_scatter, t_scatter_max, t_dot, t_dot_max, t_blocking;
 
-  MPI_Init(&argc, &argv);
+  /* Only the master thread calls MPI functions */
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
 
@@ -55,8 +244,10 @@ int main(int argc, char* argv[])
     n = atoi(argv[1]);
   }
 
-  /* [TODO] This is not a true parallel version, since the master
-     does everything */
+  if (argc > 2) {
+    chunk = atoi(argv[2]);
+  }
+
   if (0 == my_rank) {
     /* The master allocates the vectors */
     int i;
@@ -73,8 +264,8 @@ int main(int argc, char* argv[])
   sendCounts = (int*) malloc(comm_sz * sizeof(int));
   displs = (int*) malloc(comm_sz * sizeof(int));
   for (int i = 0; i < comm_sz; i++) {
-    const int start = n * i / comm_sz;
-    const int end = n * (i + 1) / comm_sz;
+    const int start = (long)n * i / comm_sz;
+    const int end = (long)n * (i + 1) / comm_sz;
     const int size = end - start;
     sendCounts[i] = size;
     displs[i] = start;
@@ -83,13 +274,25 @@ int main(int argc, char* argv[])
   const int local_n = sendCounts[my_rank];
   localx = (double*) malloc(local_n * sizeof(double));
   localy = (double*) malloc(local_n * sizeof(double));
+  /* touch the buffers, so that the scatter time does not include
+     page faults */
+  memset(localx, 0, local_n * sizeof(double));
+  memset(localy, 0, local_n * sizeof(double));
 
+  MPI_Barrier(MPI_COMM_WORLD);
+  tstart = MPI_Wtime();
   MPI_Scatterv(x, sendCounts, displs, MPI_DOUBLE, localx, local_n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Scatterv(y, sendCounts, displs, MPI_DOUBLE, localy, local_n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  t_scatter = MPI_Wtime() - tstart;
 
+  t_dot = MPI_Wtime();
   double local_result = dot(localx, localy, local_n);
+  t_dot = MPI_Wtime() - t_dot;
 
   MPI_Reduce(&local_result, &result, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  t_blocking = MPI_Wtime() - tstart;
+  MPI_Reduce(&t_dot, &t_dot_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&t_scatter, &t_scatter_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
   if (0 == my_rank) {
     printf("Dot product: %f\n", result);
@@ -98,6 +301,27 @@ int main(int argc, char* argv[])
     } else {
       printf("Check failed: got %f, expected %f\n", result, (double)n);
     }
+    printf("%d processes x %d threads, n=%d\n", comm_sz, omp_get_max_threads(), n);
+    printf("Local dot time %f s (%.2f GB/s per process)\n",
+           t_dot_max, 2.0 * n / comm_sz * sizeof(double) / t_dot_max * 1e-9);
+    printf("Scatter + dot + reduce: %f s (scatter %f s)\n", t_blocking, t_scatter_max);
+  }
+
+  if (chunk > 0) {
+    double t_pipe, t_comp, t_comp_max, result_pipe;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    tstart = MPI_Wtime();
+    result_pipe = dot_pipelined(x, y, n, chunk, &t_comp);
+    t_pipe = MPI_Wtime() - tstart;
+    MPI_Reduce(&t_comp, &t_comp_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (0 == my_rank) {
+      printf("Pipelined, chunk=%d: %f s (compute %f s), result %s\n", chunk, t_pipe, t_comp_max,
+             (fabs(result_pipe - n) < 1e-5 ? "OK" : "failed"));
+      /* Overlap efficiency: fraction of the time spent computing; it
+         is 100% when all the communication is hidden */
+      printf("Speedup %.2f, overlap efficiency %.0f%%\n", t_blocking / t_pipe, 100.0 * t_comp_max / t_pipe);
+    }
   }
 
   free(x); /* if x == NULL, does nothing */
@@ -17,18 +17,63 @@
  * --------------------------------------------------------------------------
  *
  * Compile with
- * mpicc -std=c99 -Wall -Wpedantic mpi-mandelbrot.c -o mpi-mandelbrot
+ * mpicc -std=c99 -Wall -Wpedantic -O2 -march=native mpi-mandelbrot.c -o mpi-mandelbrot -lm
  *
  * run with:
- * mpirun -n 4 ./mpi-mandelbrot
+ * mpirun -n 4 ./mpi-mandelbrot [-g | -d [-b rows] [-p depth]] [-c classic|smooth|hist] [-s counts | -r counts] [-m] [ysize]
  *
- * The master creates a file "mandelbrot.ppm" with the final image.
+ * By default each process draws a contiguous band of ysize/comm_sz
+ * rows, and writes it to the output file with collective MPI-IO; no
+ * process needs memory for the whole image, so very large images
+ * (e.g., 64K x 36K) can be produced. With -g the bands are instead
+ * gathered by the master, which writes the image. Since the rows
+ * crossing the Mandelbrot set take much longer to compute, the
+ * processes owning the central bands are the slowest. With -d, the
+ * master acts as a dynamic scheduler: it hands out blocks of |rows|
+ * rows (default 16) on demand, keeping up to |depth| blocks (default
+ * 2) queued at each worker, and writes the completed blocks directly
+ * to the output file. In both cases the program reports the busy
+ * time and peak resident set size of each process, and the imbalance
+ * ratio.
+ *
+ * Drawing is done in two passes: the compute pass stores a
+ * fractional iteration count for each pixel, and the shading pass
+ * turns the counts into colors. -c selects the coloring: "classic"
+ * (default) uses the integer part of the count to index the palette,
+ * "smooth" interpolates the palette with the fractional count, and
+ * "hist" spreads the colors evenly over the escaping pixels
+ * (histogram equalization). With -s the counts are also saved to
+ * file |counts| (xsize * ysize floats, no header); -r reads them from
+ * that file instead of computing them, so that the image can be
+ * shaded again with a different coloring without iterating. The
+ * compute and shading throughput are reported separately. -c hist,
+ * -s and -r are not available with -d.
+ *
+ * With -m, the band of each process (or each block, with -d) is
+ * drawn by Mariani-Silver subdivision: rectangles whose border has a
+ * uniform count are filled without iterating their interior (see
+ * ms_rect()). The image is the same, and the fraction of pixels that
+ * have actually been iterated is reported. Regions outside the set
+ * are filled only with classic coloring and without -s, since the
+ * fractional counts of their interior are not known. With -d, the
+ * blocks must be much taller than the default 16 rows (e.g., -b 64)
+ * for the subdivision to pay off.
+ *
+ * The master creates a file "mandelbrotMPI.ppm" with the final image.
  *
  ****************************************************************************/
+/* The following #define is required by getopt() */
+#define _XOPEN_SOURCE 600
+
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <unistd.h> /* for getopt() */
+#include <string.h> /* for strlen() */
+#include <math.h>
+#include <sys/resource.h> /* for getrusage() */
+#include "mandel-simd.h"
 
 const int MAXIT = 1000;
 
@@ -211,85 +256,397 @@ const int colors[][3] = {
 
 const int NCOLORS = sizeof(colors)/sizeof(colors[0]);
 
-/*
- * Iterate the recurrence:
- *
- * z_0 = 0;
- * z_{n+1} = z_n^2 + cx + i*cy;
- *
- * Returns the first n such that z_n > |bound|, or |MAXIT| if z_n is below
- * |bound| after |MAXIT| iterations.
- */
-int iterate( float cx, float cy )
+/* Coloring schemes applied by shade_pixels() */
+enum {
+  SHADE_CLASSIC, /* colors[v % NCOLORS], v = integer iteration count */
+  SHADE_SMOOTH,  /* palette interpolated with the fractional count */
+  SHADE_HIST     /* histogram equalization of the fractional count */
+};
+
+/* Largest fractional part of an iteration count; it must be small
+   enough that v + MAX_FRAC does not round to v + 1 for v <= MAXIT */
+const float MAX_FRAC = 0.999f;
+
+/* Modes of the compute pass */
+enum {
+  MS_OFF,    /* every pixel is iterated */
+  MS_INSIDE, /* Mariani-Silver subdivision, only regions inside the set are filled */
+  MS_ALL     /* Mariani-Silver subdivision, all uniform regions are filled */
+};
+
+/* A band of consecutive rows of the image */
+typedef struct {
+  float *mu;        /* fractional counts of the band, row by row */
+  int ystart;       /* first row of the band */
+  int xsize, ysize; /* size of the whole image */
+  int mode;         /* MS_OFF, MS_INSIDE or MS_ALL */
+  long niterated;   /* number of pixels that have been iterated */
+} band_t;
+
+#define MU(b, x, y) ((b)->mu[(size_t)((y) - (b)->ystart) * (b)->xsize + (x)])
+
+/* Coordinates of pixel (x, y) */
+float coord_x( int x, int xsize ) { return -2.5 + 3.5 * (float)x / (xsize - 1); }
+float coord_y( int y, int ysize ) { return 1 - 2.0 * (float)y / (ysize - 1); }
+
+/* Compute the fractional iteration counts of the |n| pixels (x +
+   i*dx, y + i*dy), i = 0, ... n-1, of band |b|. If point c escapes at
+   iteration v, its count is v + f, where f = 1 - log2(log2(|z_v|)) is
+   clamped to [0, MAX_FRAC], so that the integer part is still the
+   escape iteration; f varies continuously with c, which removes the
+   color bands. Points that do not escape within MAXIT iterations get
+   the count MAXIT. The escape iterations are computed MANDEL_VLEN
+   points at a time (see mandel-simd.h). */
+void compute_span( band_t *b, int x, int y, int dx, int dy, int n )
 {
-  float x = 0.0f, y = 0.0f, xnew, ynew;
-  int it;
-  for ( it = 0; (it < MAXIT) && (x*x + y*y <= 2.0*2.0); it++ ) {
-    xnew = x*x - y*y + cx;
-    ynew = 2.0*x*y + cy;
-    x = xnew;
-    y = ynew;
-  }
-  return it;
+  int i;
+
+  if ( n < 1 ) {
+    return;
+  }
+  float *cx = (float*)malloc(n * sizeof(*cx));
+  float *cy = (float*)malloc(n * sizeof(*cy));
+  float *zz = (float*)malloc(n * sizeof(*zz));
+  int *it = (int*)malloc(n * sizeof(*it));
+
+  i = 0;
+  do { /* n > 0 */
+    cx[i] = coord_x(x + i*dx, b->xsize);
+    cy[i] = coord_y(y + i*dy, b->ysize);
+  } while (++i < n);
+  mandel_iterate_n_esc_ps(cx, cy, it, zz, n, MAXIT);
+  for (i=0; i<n; i++) {
+    float m = MAXIT;
+    if (it[i] < MAXIT) {
+      /* log2(|z|) = log2(|z|^2)/2 */
+      float f = 1.0f - log2f(0.5f * log2f(zz[i]));
+      f = (f < 0.0f ? 0.0f : (f > MAX_FRAC ? MAX_FRAC : f));
+      m = it[i] + f;
+    }
+    MU(b, x + i*dx, y + i*dy) = m;
+  }
+  b->niterated += n;
+  free(cx);
+  free(cy);
+  free(zz);
+  free(it);
 }
 
-/* Draw the rows of the Mandelbrot set from |ystart| (inclusive) to
-   |yend| (excluded) to the bitmap pointed to by |p|. Note that |p|
-   must point to the beginning of the bitmap where the portion of
-   image will be stored; in other words, this function writes to
-   pixels p[0], p[1], ... */
-void draw_lines( int ystart, int yend, pixel_t* p, int xsize, int ysize )
+/* Returns 1 iff pixel (x, y) lies in the main cardioid or in the
+   period-2 bulb */
+int in_main_bulbs( const band_t *b, int x, int y )
+{
+  const double cre = coord_x(x, b->xsize), cim = coord_y(y, b->ysize);
+  const double q = (cre - 0.25)*(cre - 0.25) + cim*cim;
+  return (q*(q + (cre - 0.25)) <= 0.25*cim*cim ||
+          (cre + 1.0)*(cre + 1.0) + cim*cim <= 0.0625);
+}
+
+/* Mariani-Silver subdivision of the rectangle of band |b| with
+   corners (x0, y0) and (x1, y1) (both included), whose border has
+   already been computed. If the integer parts of the counts of all
+   border pixels are the same value v, the interior can not contain a
+   different count (the points whose count is at least v form a
+   connected set containing the Mandelbrot set, those whose count is
+   less than v a connected unbounded one), unless it contains the
+   whole set, i.e., c = 0. If v < MAXIT (only with MS_ALL) the
+   interior is filled with v; the fractional part is lost, so this is
+   only done with classic coloring. If v == MAXIT, only the pixels in
+   the main cardioid or in the period-2 bulb are filled, since a
+   channel of escaping points thinner than a pixel may cross the
+   border between two border pixels; the others are computed. If the
+   border is not uniform, the rectangle is split in four by a
+   horizontal and a vertical line, that are computed, and each part is
+   processed in the same way; rectangles with a side of at most
+   MS_MINSIZE pixels are computed directly. See also
+   ex2-openmp/omp-mandelbrot-ms.c. */
+const int MS_MINSIZE = 8;
+
+void ms_rect( band_t *b, int x0, int y0, int x1, int y1 )
 {
   int x, y;
-  for ( y = ystart; y < yend; y++) {
-    for ( x = 0; x < xsize; x++ ) {
-      const float cx = -2.5 + 3.5 * (float)x / (xsize - 1);
-      const float cy = 1 - 2.0 * (float)y / (ysize - 1);
-      const int v = iterate(cx, cy);
-      if (v < MAXIT) {
-        p->r = colors[v % NCOLORS][0];
-        p->g = colors[v % NCOLORS][1];
-        p->b = colors[v % NCOLORS][2];
-      } else {
-        p->r = p->g = p->b = 0;
+
+  if ( x1 - x0 < 2 || y1 - y0 < 2 ) {
+    return; /* no interior */
+  }
+
+  const int v = MU(b, x0, y0);
+  int uniform = ! (coord_x(x0, b->xsize) < 0.0f && coord_x(x1, b->xsize) > 0.0f &&
+                   coord_y(y1, b->ysize) < 0.0f && coord_y(y0, b->ysize) > 0.0f);
+  for (x=x0; x<=x1 && uniform; x++) {
+    uniform = ((int)MU(b, x, y0) == v && (int)MU(b, x, y1) == v);
+  }
+  for (y=y0+1; y<y1 && uniform; y++) {
+    uniform = ((int)MU(b, x0, y) == v && (int)MU(b, x1, y) == v);
+  }
+
+  if ( uniform && v < MAXIT && MS_ALL == b->mode ) {
+    for (y=y0+1; y<y1; y++) {
+      for (x=x0+1; x<x1; x++) {
+        MU(b, x, y) = v;
       }
-      p++;
     }
+  } else if ( uniform && v == MAXIT ) {
+    for (y=y0+1; y<y1; y++) {
+      int start = x0+1;
+      for (x=x0+1; x<=x1; x++) {
+        if ( x == x1 || in_main_bulbs(b, x, y) ) {
+          compute_span(b, start, y, 1, 0, x - start);
+          start = x + 1;
+          if ( x < x1 ) {
+            MU(b, x, y) = MAXIT;
+          }
+        }
+      }
+    }
+  } else if ( x1 - x0 <= MS_MINSIZE || y1 - y0 <= MS_MINSIZE ) {
+    for (y=y0+1; y<y1; y++) {
+      compute_span(b, x0+1, y, 1, 0, x1-x0-1);
+    }
+  } else {
+    const int xm = (x0 + x1)/2, ym = (y0 + y1)/2;
+    compute_span(b, x0+1, ym, 1, 0, x1-x0-1);
+    compute_span(b, xm, y0+1, 0, 1, ym-y0-1);
+    compute_span(b, xm, ym+1, 0, 1, y1-ym-1);
+    ms_rect(b, x0, y0, xm, ym);
+    ms_rect(b, xm, y0, x1, ym);
+    ms_rect(b, x0, ym, xm, y1);
+    ms_rect(b, xm, ym, x1, y1);
   }
 }
 
-int main( int argc, char *argv[] )
+/* Compute pass: store in |mu| the fractional iteration counts of the
+   rows from |ystart| (inclusive) to |yend| (excluded); as for the
+   bitmap, mu[0] corresponds to the first pixel of row |ystart|. With
+   |mode| MS_INSIDE or MS_ALL the band is the initial rectangle of the
+   Mariani-Silver subdivision (see ms_rect()), otherwise every pixel
+   is computed; in all cases the integer parts of the counts are the
+   same. Returns the number of pixels that have been iterated. */
+long compute_lines( int ystart, int yend, float* mu, int xsize, int ysize, int mode )
 {
-  int my_rank, comm_sz;
-  FILE *out = NULL;
-  const char* fname="mandelbrotMPI.ppm";
-  pixel_t *bitmap = NULL;
-  int xsize, ysize;
+  band_t b = { mu, ystart, xsize, ysize, mode, 0 };
+  int y;
+
+  if ( MS_OFF == mode || yend - ystart < 3 ) {
+    for ( y = ystart; y < yend; y++) {
+      compute_span(&b, 0, y, 1, 0, xsize);
+    }
+  } else {
+    compute_span(&b, 0, ystart, 1, 0, xsize);
+    compute_span(&b, 0, yend-1, 1, 0, xsize);
+    compute_span(&b, 0, ystart+1, 0, 1, yend-ystart-2);
+    compute_span(&b, xsize-1, ystart+1, 0, 1, yend-ystart-2);
+    ms_rect(&b, 0, ystart, xsize-1, yend-1);
+  }
+  return b.niterated;
+}
+
+/* Build the table used by SHADE_HIST from the counts |hist[v]| of
+   the pixels that escape at iteration v, for v = 0, ... MAXIT-1:
+   cdf[v] is the fraction of escaping pixels whose integer count is
+   less than v (cdf[0] = 0, cdf[MAXIT] = 1). */
+void build_cdf( const long *hist, float *cdf )
+{
+  long total = 0, partial = 0;
+  int v;
+
+  for (v=0; v<MAXIT; v++) {
+    total += hist[v];
+  }
+  for (v=0; v<=MAXIT; v++) {
+    cdf[v] = (total > 0 ? (float)partial / total : 0.0f);
+    if (v < MAXIT) {
+      partial += hist[v];
+    }
+  }
+}
+
+/* Shading pass: convert the |n| fractional iteration counts |mu|
+   into the colors of pixels p[0], ... p[n-1], with the coloring
+   scheme |shading|; |cdf| is only used by SHADE_HIST. Each count is
+   mapped to a position t along the palette (the integer count for
+   SHADE_CLASSIC, the fractional count for SHADE_SMOOTH, the
+   equalized count scaled to the palette size for SHADE_HIST), and
+   the color is interpolated between the palette entries floor(t) and
+   floor(t)+1. The arithmetic is done MANDEL_VLEN pixels at a time;
+   only the palette lookups and the stores are done lane by lane. With
+   SHADE_CLASSIC the image is identical to the one produced by
+   coloring the integer counts directly. */
+void shade_pixels( const float *mu, pixel_t *p, size_t n, int shading, const float *cdf )
+{
+  size_t i;
+  int k, c;
+
+  for (i=0; i<n; i += MANDEL_VLEN) {
+    const int len = (n - i < MANDEL_VLEN ? n - i : MANDEL_VLEN);
+    mandel_vf t, fv, f, lo, hi, val;
+    mandel_vi v, inside, ilo, ihi, rgb[3];
+
+    /* v is the integer part of t, fv its value as a float; the last,
+       partial vector is padded with points inside the set */
+    for (k=0; k<MANDEL_VLEN; k++) {
+      t[k] = (k < len ? mu[i+k] : MAXIT);
+      v[k] = t[k];
+    }
+    inside = (v >= MAXIT);
+    v &= ~inside; /* keeps table indexes in range */
+    for (k=0; k<MANDEL_VLEN; k++) {
+      fv[k] = v[k];
+    }
+    if ( SHADE_HIST == shading ) {
+      f = t - fv;
+      for (k=0; k<MANDEL_VLEN; k++) {
+        lo[k] = cdf[v[k]];
+        hi[k] = cdf[v[k] + 1];
+      }
+      t = (lo + f*(hi - lo)) * (float)(NCOLORS - 1);
+      for (k=0; k<MANDEL_VLEN; k++) {
+        v[k] = t[k];
+        fv[k] = v[k];
+      }
+    } else if ( SHADE_CLASSIC == shading ) {
+      t = fv;
+    }
+    f = t - fv;
+    ilo = v % NCOLORS;
+    ihi = (v + 1) % NCOLORS;
+    for (c=0; c<3; c++) {
+      for (k=0; k<MANDEL_VLEN; k++) {
+        lo[k] = colors[ilo[k]][c];
+        hi[k] = colors[ihi[k]][c];
+      }
+      val = lo + f*(hi - lo) + 0.5f;
+      for (k=0; k<MANDEL_VLEN; k++) {
+        rgb[c][k] = val[k];
+      }
+      rgb[c] &= ~inside;
+    }
+    for (k=0; k<len; k++) {
+      p[i+k].r = rgb[0][k];
+      p[i+k].g = rgb[1][k];
+      p[i+k].b = rgb[2][k];
+    }
+  }
+}
+
+/* How the bitmap is obtained from the fractional iteration counts */
+typedef struct {
+  int shading;        /* SHADE_CLASSIC, SHADE_SMOOTH or SHADE_HIST */
+  const char *mu_in;  /* if not NULL, read the counts from this file instead of computing them */
+  const char *mu_out; /* if not NULL, save the counts to this file */
+  int ms_mode;        /* MS_OFF, MS_INSIDE or MS_ALL, see compute_lines() */
+} draw_opts_t;
+
+/* Read (if |writing| is 0) or write the fractional iteration counts
+   |mu| of the |size| rows starting at row |start| from/to file
+   |fname|, with collective MPI-IO. The file holds the counts of the
+   whole xsize * ysize image, as raw native floats, row by row. */
+void mu_file_io( const char *fname, int writing, float *mu, int start, int size, int xsize, int ysize )
+{
+  MPI_File fh;
+  MPI_Offset fsize;
+  MPI_Datatype row_t;
+  const MPI_Offset row_len = (MPI_Offset)xsize * sizeof(*mu);
+  const int amode = (writing ? MPI_MODE_CREATE | MPI_MODE_WRONLY : MPI_MODE_RDONLY);
+  int my_rank;
 
-  MPI_Init(&argc, &argv);
   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
-  MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+  if ( MPI_SUCCESS != MPI_File_open(MPI_COMM_WORLD, fname, amode, MPI_INFO_NULL, &fh) ) {
+    if ( 0 == my_rank ) {
+      fprintf(stderr, "Error: cannot open %s\n", fname);
+    }
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  if ( writing ) {
+    MPI_File_set_size(fh, row_len * ysize);
+  } else {
+    MPI_File_get_size(fh, &fsize);
+    if ( fsize != row_len * ysize ) {
+      if ( 0 == my_rank ) {
+        fprintf(stderr, "Error: %s does not contain the counts of a %d x %d image\n", fname, xsize, ysize);
+      }
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+  }
+  MPI_Type_contiguous(xsize, MPI_FLOAT, &row_t);
+  MPI_Type_commit(&row_t);
+  if ( writing ) {
+    MPI_File_write_at_all(fh, row_len * start, mu, size, row_t, MPI_STATUS_IGNORE);
+  } else {
+    MPI_File_read_at_all(fh, row_len * start, mu, size, row_t, MPI_STATUS_IGNORE);
+  }
+  MPI_Type_free(&row_t);
+  MPI_File_close(&fh);
+}
+
+/* Draw the rows from |start| (inclusive) to |end| (excluded) to
+   |bitmap|, as specified by |opts|: the fractional iteration counts
+   are computed (or read), possibly saved, and then shaded. SHADE_HIST
+   requires the histogram of the whole image, which is obtained by
+   adding up the histograms of the bands of all processes; this
+   function must therefore be called by all processes. The time spent
+   computing (or reading) the counts is stored in |busy|, the time
+   spent shading in |shade|, the number of pixels iterated in
+   |niterated|. */
+void draw_band( int start, int end, pixel_t *bitmap, int xsize, int ysize, const draw_opts_t *opts, double *busy, double *shade, long *niterated )
+{
+  const size_t npix = (size_t)xsize * (end - start);
+  float *mu = (float*)malloc(npix * sizeof(*mu));
+  float *cdf = NULL;
+  size_t i;
 
-  if ( argc > 1 ) {
-    ysize = atoi(argv[1]);
+  *niterated = 0;
+  double tstart = MPI_Wtime();
+  if ( opts->mu_in ) {
+    mu_file_io(opts->mu_in, 0, mu, start, end - start, xsize, ysize);
   } else {
-    ysize = 1024;
+    *niterated = compute_lines(start, end, mu, xsize, ysize, opts->ms_mode);
   }
+  *busy = MPI_Wtime() - tstart;
 
-  xsize = ysize * 1.777777778;
+  if ( opts->mu_out ) {
+    mu_file_io(opts->mu_out, 1, mu, start, end - start, xsize, ysize);
+  }
 
-  if ( 0 == my_rank ) {
-    out = fopen(fname, "w");
-    if ( !out ) {
-      fprintf(stderr, "Error: cannot create %s\n", fname);
-      MPI_Abort(MPI_COMM_WORLD, -1);
+  tstart = MPI_Wtime();
+  if ( SHADE_HIST == opts->shading ) {
+    long *hist = (long*)calloc(MAXIT, sizeof(*hist));
+    cdf = (float*)malloc((MAXIT + 1) * sizeof(*cdf));
+    for (i=0; i<npix; i++) {
+      if ( mu[i] < MAXIT ) {
+        hist[(int)mu[i]]++;
+      }
     }
+    MPI_Allreduce(MPI_IN_PLACE, hist, MAXIT, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    build_cdf(hist, cdf);
+    free(hist);
+  }
+  shade_pixels(mu, bitmap, npix, opts->shading, cdf);
+  *shade = MPI_Wtime() - tstart;
 
-    /* Write the header of the output file */
-    fprintf(out, "P6\n");
-    fprintf(out, "%d %d\n", xsize, ysize);
-    fprintf(out, "255\n");
+  free(cdf);
+  free(mu);
+}
+
+/* Tags used by the dynamic scheduler */
+#define TAG_WORK   1
+#define TAG_RESULT 2
+
+/* Static partitioning: each process draws one contiguous band of
+   rows, and the bands are gathered to the master, which writes the
+   whole bitmap to |out| (only meaningful on the master). The bands
+   are drawn by draw_band() with options |opts|, which stores the
+   compute and shading times in |busy| and |shade| and the number of
+   pixels iterated in |niterated|. */
+void render_gather( FILE *out, int xsize, int ysize, const draw_opts_t *opts, double *busy, double *shade, long *niterated )
+{
+  int my_rank, comm_sz;
+  pixel_t *bitmap = NULL;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
 
+  if ( 0 == my_rank ) {
     /* Allocate the complete bitmap */
     bitmap = (pixel_t*)malloc(xsize*ysize*sizeof(*bitmap));
   }
@@ -312,19 +669,371 @@ int main( int argc, char *argv[] )
     recvcounts[i] = my_send_size;
   }
 
-  draw_lines(start, end, local_bitmap, xsize, ysize);
+  draw_band(start, end, local_bitmap, xsize, ysize, opts, busy, shade, niterated);
 
   MPI_Gatherv(local_bitmap, send_size, MPI_BYTE, bitmap, recvcounts, displs, MPI_BYTE, 0, MPI_COMM_WORLD);
 
   if(0 == my_rank) {
     fwrite(bitmap, sizeof(*bitmap), xsize*ysize, out);
-    fclose(out);
     free(bitmap);
   }
 
   free(local_bitmap);
   free(recvcounts);
   free(displs);
+}
+
+/* Static partitioning with parallel output: each process draws one
+   contiguous band of rows, and writes it directly to file |fname|
+   with collective MPI-IO, just after the header |hdr| (which is
+   written by the master). No process ever holds more than its own
+   band (plus its fractional iteration counts, see draw_band()). The
+   compute and shading times are stored in |busy| and |shade|, the
+   number of pixels iterated in |niterated|. */
+void render_mpiio( const char *fname, const char *hdr, int xsize, int ysize, const draw_opts_t *opts, double *busy, double *shade, long *niterated )
+{
+  int my_rank, comm_sz;
+  MPI_File fh;
+  MPI_Datatype row_t;
+  const MPI_Offset hdr_len = strlen(hdr);
+  const MPI_Offset row_len = (MPI_Offset)xsize * sizeof(pixel_t);
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+  const int start = ysize * (long)my_rank / comm_sz;
+  const int end = ysize * (long)(my_rank + 1) / comm_sz;
+  const int size = end - start;
+  pixel_t *local_bitmap = (pixel_t *) malloc((size_t)xsize * size * sizeof(pixel_t));
+
+  draw_band(start, end, local_bitmap, xsize, ysize, opts, busy, shade, niterated);
+
+  if ( MPI_SUCCESS != MPI_File_open(MPI_COMM_WORLD, fname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) ) {
+    if ( 0 == my_rank ) {
+      fprintf(stderr, "Error: cannot create %s\n", fname);
+    }
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  /* truncate any previous content of the file */
+  MPI_File_set_size(fh, hdr_len + row_len * ysize);
+  if ( 0 == my_rank ) {
+    MPI_File_write_at(fh, 0, hdr, hdr_len, MPI_CHAR, MPI_STATUS_IGNORE);
+  }
+  /* a band may exceed 2^31 bytes, so it is written as |size| rows */
+  MPI_Type_contiguous(row_len, MPI_BYTE, &row_t);
+  MPI_Type_commit(&row_t);
+  MPI_File_write_at_all(fh, hdr_len + row_len * start, local_bitmap, size, row_t, MPI_STATUS_IGNORE);
+  MPI_Type_free(&row_t);
+  MPI_File_close(&fh);
+
+  free(local_bitmap);
+}
+
+/* Dynamic scheduling, master side. The image is split into blocks of
+   |blk| rows; each worker is initially given |depth| blocks, and
+   receives a new one every time it sends back a completed block, so
+   that it always has further work queued while the master handles
+   its results. Blocks are written to |out| as soon as they arrive, at
+   offset |hdr_len| + (first row of the block) * (row size). Since
+   messages between two processes are non-overtaking, the results of
+   each worker arrive in the same order in which the blocks were
+   assigned; the master keeps, for each worker, a FIFO queue of the
+   blocks it has been given. A block descriptor is the pair (first
+   row, number of rows); a descriptor with 0 rows tells the worker to
+   stop. The time spent writing the output is stored in |busy|. */
+void dynamic_master( FILE *out, long hdr_len, int xsize, int ysize, int blk, int depth, double *busy )
+{
+  int comm_sz, w, d;
+  const int nblocks = (ysize + blk - 1) / blk;
+  int next = 0, received = 0;
+
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+  int *queue = (int*)malloc(comm_sz * depth * sizeof(*queue)); /* queue[w*depth .. w*depth+depth-1] */
+  int *head = (int*)calloc(comm_sz, sizeof(*head));
+  int *count = (int*)calloc(comm_sz, sizeof(*count));
+  pixel_t *buf = (pixel_t*)malloc(blk * xsize * sizeof(*buf));
+  int desc[2];
+
+  *busy = 0.0;
+  for (d=0; d<depth; d++) {
+    for (w=1; w<comm_sz && next<nblocks; w++) {
+      desc[0] = next * blk;
+      desc[1] = (ysize - desc[0] < blk ? ysize - desc[0] : blk);
+      MPI_Send(desc, 2, MPI_INT, w, TAG_WORK, MPI_COMM_WORLD);
+      queue[w*depth + (head[w] + count[w]) % depth] = next;
+      count[w]++;
+      next++;
+    }
+  }
+  /* workers that got nothing to do can stop immediately */
+  for (w=1; w<comm_sz; w++) {
+    if ( 0 == count[w] ) {
+      desc[0] = desc[1] = 0;
+      MPI_Send(desc, 2, MPI_INT, w, TAG_WORK, MPI_COMM_WORLD);
+    }
+  }
+
+  while ( received < nblocks ) {
+    MPI_Status status;
+    MPI_Probe(MPI_ANY_SOURCE, TAG_RESULT, MPI_COMM_WORLD, &status);
+    w = status.MPI_SOURCE;
+    const int b = queue[w*depth + head[w]];
+    head[w] = (head[w] + 1) % depth;
+    count[w]--;
+    const int ystart = b * blk;
+    const int nrows = (ysize - ystart < blk ? ysize - ystart : blk);
+
+    /* hand out the next block before writing this one, so that the
+       worker does not wait for the I/O */
+    if ( next < nblocks ) {
+      desc[0] = next * blk;
+      desc[1] = (ysize - desc[0] < blk ? ysize - desc[0] : blk);
+      MPI_Send(desc, 2, MPI_INT, w, TAG_WORK, MPI_COMM_WORLD);
+      queue[w*depth + (head[w] + count[w]) % depth] = next;
+      count[w]++;
+      next++;
+    } else if ( 0 == count[w] ) {
+      desc[0] = desc[1] = 0;
+      MPI_Send(desc, 2, MPI_INT, w, TAG_WORK, MPI_COMM_WORLD);
+    }
+
+    MPI_Recv(buf, nrows * xsize * sizeof(pixel_t), MPI_BYTE, w, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    const double tstart = MPI_Wtime();
+    fseek(out, hdr_len + (long)ystart * xsize * sizeof(pixel_t), SEEK_SET);
+    fwrite(buf, sizeof(*buf), (size_t)nrows * xsize, out);
+    *busy += MPI_Wtime() - tstart;
+    received++;
+  }
+
+  free(queue);
+  free(head);
+  free(count);
+  free(buf);
+}
+
+/* Dynamic scheduling, worker side. The worker draws the blocks it
+   receives from the master and sends them back with nonblocking
+   sends; it uses |depth| result buffers, so that up to |depth|
+   results can be in flight while it computes the next block. Each
+   block is the initial rectangle of the subdivision if |opts| enables
+   it, and is shaded as soon as it has been computed (SHADE_HIST is not
+   supported, since it needs the counts of the whole image). The time
+   spent computing is stored in |busy|, the time spent shading in
+   |shade|, the number of pixels iterated in |niterated|, the number
+   of blocks drawn in |nblocks|. */
+void dynamic_worker( int xsize, int ysize, int blk, int depth, const draw_opts_t *opts, double *busy, double *shade, long *niterated, int *nblocks )
+{
+  pixel_t *buf = (pixel_t*)malloc((size_t)depth * blk * xsize * sizeof(*buf));
+  float *mu = (float*)malloc((size_t)blk * xsize * sizeof(*mu));
+  MPI_Request *req = (MPI_Request*)malloc(depth * sizeof(*req));
+  int desc[2], slot = 0, d;
+
+  for (d=0; d<depth; d++) {
+    req[d] = MPI_REQUEST_NULL;
+  }
+  *busy = *shade = 0.0;
+  *niterated = 0;
+  *nblocks = 0;
+  for (;;) {
+    MPI_Recv(desc, 2, MPI_INT, 0, TAG_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if ( 0 == desc[1] ) {
+      break;
+    }
+    pixel_t *p = buf + (size_t)slot * blk * xsize;
+    MPI_Wait(&req[slot], MPI_STATUS_IGNORE); /* wait until the buffer can be reused */
+    double tstart = MPI_Wtime();
+    *niterated += compute_lines(desc[0], desc[0] + desc[1], mu, xsize, ysize, opts->ms_mode);
+    *busy += MPI_Wtime() - tstart;
+    tstart = MPI_Wtime();
+    shade_pixels(mu, p, (size_t)desc[1] * xsize, opts->shading, NULL);
+    *shade += MPI_Wtime() - tstart;
+    MPI_Isend(p, desc[1] * xsize * sizeof(pixel_t), MPI_BYTE, 0, TAG_RESULT, MPI_COMM_WORLD, &req[slot]);
+    slot = (slot + 1) % depth;
+    (*nblocks)++;
+  }
+  MPI_Waitall(depth, req, MPI_STATUSES_IGNORE);
+  free(req);
+  free(buf);
+  free(mu);
+}
+
+int main( int argc, char *argv[] )
+{
+  int my_rank, comm_sz;
+  FILE *out = NULL;
+  const char* fname="mandelbrotMPI.ppm";
+  int xsize, ysize = 1024;
+  int dynamic = 0, gather = 0, blk = 16, depth = 2, nblocks = 0, subdivide = 0, opt;
+  char hdr[64];
+  double busy = 0.0, shade = 0.0;
+  long niterated = 0, tot_iterated = 0;
+  draw_opts_t opts = { SHADE_CLASSIC, NULL, NULL, MS_OFF };
+  struct rusage usage;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+  while ( (opt = getopt(argc, argv, "dgb:p:c:s:r:m")) != -1 ) {
+    switch (opt) {
+    case 'd':
+      dynamic = 1;
+      break;
+    case 'g':
+      gather = 1;
+      break;
+    case 'b':
+      blk = atoi(optarg);
+      break;
+    case 'p':
+      depth = atoi(optarg);
+      break;
+    case 'c':
+      if ( 0 == strcmp(optarg, "classic") ) {
+        opts.shading = SHADE_CLASSIC;
+      } else if ( 0 == strcmp(optarg, "smooth") ) {
+        opts.shading = SHADE_SMOOTH;
+      } else if ( 0 == strcmp(optarg, "hist") ) {
+        opts.shading = SHADE_HIST;
+      } else {
+        if ( 0 == my_rank ) {
+          fprintf(stderr, "Error: unknown coloring \"%s\"\n", optarg);
+        }
+        MPI_Abort(MPI_COMM_WORLD, -1);
+      }
+      break;
+    case 's':
+      opts.mu_out = optarg;
+      break;
+    case 'r':
+      opts.mu_in = optarg;
+      break;
+    case 'm':
+      subdivide = 1;
+      break;
+    default:
+      if ( 0 == my_rank ) {
+        fprintf(stderr, "Usage: %s [-g | -d [-b rows] [-p depth]] [-c classic|smooth|hist] [-s counts | -r counts] [-m] [ysize]\n", argv[0]);
+      }
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+  }
+
+  if ( optind < argc ) {
+    ysize = atoi(argv[optind]);
+  }
+
+  xsize = ysize * 1.777777778;
+
+  if ( blk < 1 || depth < 1 ) {
+    if ( 0 == my_rank ) {
+      fprintf(stderr, "Error: block size and prefetch depth must be positive\n");
+    }
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+
+  /* the dynamic scheduler needs at least one worker */
+  dynamic = dynamic && (comm_sz > 1);
+
+  if ( dynamic && (SHADE_HIST == opts.shading || opts.mu_in || opts.mu_out) ) {
+    if ( 0 == my_rank ) {
+      fprintf(stderr, "Error: -c hist, -s and -r require static partitioning\n");
+    }
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+
+  /* regions outside the set can only be filled if the fractional
+     part of the counts is not needed */
+  if ( subdivide ) {
+    opts.ms_mode = (SHADE_CLASSIC == opts.shading && ! opts.mu_out ? MS_ALL : MS_INSIDE);
+  }
+
+  snprintf(hdr, sizeof(hdr), "P6\n%d %d\n255\n", xsize, ysize);
+
+  /* with gather and dynamic scheduling, only the master writes */
+  if ( 0 == my_rank && (gather || dynamic) ) {
+    out = fopen(fname, "w");
+    if ( !out ) {
+      fprintf(stderr, "Error: cannot create %s\n", fname);
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    /* Write the header of the output file */
+    fputs(hdr, out);
+  }
+
+  const double tstart = MPI_Wtime();
+  if ( dynamic ) {
+    if ( 0 == my_rank ) {
+      dynamic_master(out, strlen(hdr), xsize, ysize, blk, depth, &busy);
+    } else {
+      dynamic_worker(xsize, ysize, blk, depth, &opts, &busy, &shade, &niterated, &nblocks);
+    }
+  } else {
+    if ( gather ) {
+      render_gather(out, xsize, ysize, &opts, &busy, &shade, &niterated);
+    } else {
+      render_mpiio(fname, hdr, xsize, ysize, &opts, &busy, &shade, &niterated);
+    }
+    nblocks = 1;
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  const double elapsed = MPI_Wtime() - tstart;
+
+  /* Report the busy time of each process; the imbalance ratio is the
+     maximum over the average busy time of the processes that draw
+     (all of them with static partitioning, the workers otherwise) */
+  double *all_busy = NULL, *all_shade = NULL;
+  int *all_nblocks = NULL;
+  long *all_rss = NULL;
+  if ( 0 == my_rank ) {
+    all_busy = (double*)malloc(comm_sz * sizeof(*all_busy));
+    all_shade = (double*)malloc(comm_sz * sizeof(*all_shade));
+    all_nblocks = (int*)malloc(comm_sz * sizeof(*all_nblocks));
+    all_rss = (long*)malloc(comm_sz * sizeof(*all_rss));
+  }
+  getrusage(RUSAGE_SELF, &usage); /* ru_maxrss is the peak RSS in KB */
+  MPI_Gather(&busy, 1, MPI_DOUBLE, all_busy, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Gather(&shade, 1, MPI_DOUBLE, all_shade, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Gather(&nblocks, 1, MPI_INT, all_nblocks, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Gather(&usage.ru_maxrss, 1, MPI_LONG, all_rss, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&niterated, &tot_iterated, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+  if ( 0 == my_rank ) {
+    const int first = (dynamic ? 1 : 0);
+    double max_busy = 0.0, sum_busy = 0.0, sum_shade = 0.0;
+    int i;
+
+    if ( out ) {
+      fclose(out);
+    }
+    if ( dynamic ) {
+      printf("Dynamic scheduling, blocks of %d rows, prefetch depth %d\n", blk, depth);
+      printf("Rank 0: %f s writing output, peak RSS %ld KB\n", all_busy[0], all_rss[0]);
+    } else {
+      printf("Static partitioning, %s\n", (gather ? "gather to master" : "MPI-IO output"));
+    }
+    for (i=first; i<comm_sz; i++) {
+      printf("Rank %d: %f s busy, %f s shading, %d blocks, peak RSS %ld KB\n", i, all_busy[i], all_shade[i], all_nblocks[i], all_rss[i]);
+      sum_busy += all_busy[i];
+      sum_shade += all_shade[i];
+      max_busy = (all_busy[i] > max_busy ? all_busy[i] : max_busy);
+    }
+    printf("Imbalance (max/avg busy time): %f\n", max_busy / (sum_busy / (comm_sz - first)));
+    /* throughput of a single process, excluding the time spent in
+       the other pass */
+    if ( ! opts.mu_in ) {
+      printf("Pixels iterated: %ld (%.2f%%)\n", tot_iterated, 100.0 * tot_iterated / ((double)xsize * ysize));
+      printf("Compute throughput: %.2f Mpixel/s per process\n", 1.0e-6 * xsize * ysize / sum_busy);
+    }
+    printf("Shading throughput: %.2f Mpixel/s per process\n", 1.0e-6 * xsize * ysize / sum_shade);
+    printf("Elapsed time: %f\n", elapsed);
+    free(all_busy);
+    free(all_shade);
+    free(all_nblocks);
+    free(all_rss);
+  }
 
   MPI_Finalize();
 
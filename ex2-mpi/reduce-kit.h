@@ -0,0 +1,239 @@
+/* */
+/****************************************************************************
+ *
+ * reduce-kit.h - Fused multi-field reductions for MPI programs
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Reducing several quantities with one collective per quantity (e.g.,
+ * four MPI_Reduce() calls with MPI_MIN and MPI_MAX for a bounding box)
+ * pays the latency of a collective each time. This header keeps, for
+ * each field of the data, a tuple (min, max, sum, count), and reduces
+ * an array of tuples with a single collective, using a derived
+ * datatype for the tuple and a user-defined operator that combines
+ * all the components at once:
+ *
+ *   rk_t rk;
+ *   rk_stats_t local[2], global[2];
+ *   rk_init(&rk, MPI_COMM_WORLD);
+ *   rk_stats_init(local, 2);
+ *   ... rk_stats_add(&local[f], v) for each value v of field f ...
+ *   rk_reduce(&rk, local, global, 2);
+ *   rk_free(&rk);
+ *
+ * rk_reduce_hier() gives the same result in two steps: first among the
+ * processes of each node (MPI_Comm_split_type() with
+ * MPI_COMM_TYPE_SHARED), then among one process per node, so that
+ * only one message per node crosses the network.
+ *
+ * rk_scatter_fields() distributes several arrays of floats (one per
+ * field) with a single collective, using for each process a datatype
+ * that describes its part of every array, so that all the fields
+ * travel in the same message without being copied to a temporary
+ * buffer.
+ *
+ * The result of the reductions is available on rank 0 of the
+ * communicator given to rk_init().
+ *
+ ****************************************************************************/
+
+#ifndef REDUCE_KIT_H
+#define REDUCE_KIT_H
+
+#include <mpi.h>
+#include <math.h>   /* for HUGE_VAL */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h> /* for offsetof() */
+
+typedef struct {
+  double min, max, sum;
+  int64_t count;
+} rk_stats_t;
+
+typedef struct {
+  MPI_Comm comm;
+  MPI_Datatype type;   /* datatype of rk_stats_t */
+  MPI_Op op;
+  MPI_Comm node;       /* processes of comm on the same node */
+  MPI_Comm leaders;    /* rank 0 of each node; MPI_COMM_NULL on the other processes */
+} rk_t;
+
+/* Set |n| tuples to the empty tuple */
+void rk_stats_init( rk_stats_t *s, int n )
+{
+  int i;
+  for (i=0; i<n; i++) {
+    s[i].min = HUGE_VAL;
+    s[i].max = -HUGE_VAL;
+    s[i].sum = 0.0;
+    s[i].count = 0;
+  }
+}
+
+/* Add value |v| to tuple |s| */
+void rk_stats_add( rk_stats_t *s, double v )
+{
+  s->min = (v < s->min ? v : s->min);
+  s->max = (v > s->max ? v : s->max);
+  s->sum += v;
+  s->count++;
+}
+
+/* Combine tuple |in| into |inout| */
+void rk_stats_merge( rk_stats_t *inout, const rk_stats_t *in )
+{
+  inout->min = (in->min < inout->min ? in->min : inout->min);
+  inout->max = (in->max > inout->max ? in->max : inout->max);
+  inout->sum += in->sum;
+  inout->count += in->count;
+}
+
+/* User-defined operator for MPI_Op_create() */
+void rk_op_fn( void *in, void *inout, int *len, MPI_Datatype *type )
+{
+  const rk_stats_t *a = (const rk_stats_t*)in;
+  rk_stats_t *b = (rk_stats_t*)inout;
+  int i;
+  (void)type;
+  for (i=0; i<*len; i++) {
+    rk_stats_merge(&b[i], &a[i]);
+  }
+}
+
+/* Create the datatype, the operator and the communicators used by the
+   reductions on |comm|; this is a collective operation */
+void rk_init( rk_t *rk, MPI_Comm comm )
+{
+  const int blocklens[2] = { 3, 1 };
+  const MPI_Aint displs[2] = { offsetof(rk_stats_t, min), offsetof(rk_stats_t, count) };
+  const MPI_Datatype types[2] = { MPI_DOUBLE, MPI_INT64_T };
+  MPI_Datatype tmp;
+  int rank, node_rank;
+
+  rk->comm = comm;
+  MPI_Type_create_struct(2, blocklens, displs, types, &tmp);
+  MPI_Type_create_resized(tmp, 0, sizeof(rk_stats_t), &rk->type);
+  MPI_Type_free(&tmp);
+  MPI_Type_commit(&rk->type);
+  MPI_Op_create(rk_op_fn, 1, &rk->op);
+
+  /* ranks are ordered as in comm, so rank 0 of comm is rank 0 of its
+     node and of the leaders */
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &rk->node);
+  MPI_Comm_rank(rk->node, &node_rank);
+  MPI_Comm_split(comm, (0 == node_rank ? 0 : MPI_UNDEFINED), rank, &rk->leaders);
+}
+
+void rk_free( rk_t *rk )
+{
+  MPI_Type_free(&rk->type);
+  MPI_Op_free(&rk->op);
+  MPI_Comm_free(&rk->node);
+  if ( rk->leaders != MPI_COMM_NULL ) {
+    MPI_Comm_free(&rk->leaders);
+  }
+}
+
+/* Reduce the arrays of |n| tuples |in| of all the processes into
+   |out| on rank 0, with a single MPI_Reduce() */
+void rk_reduce( const rk_t *rk, const rk_stats_t *in, rk_stats_t *out, int n )
+{
+  MPI_Reduce(in, out, n, rk->type, rk->op, 0, rk->comm);
+}
+
+/* Same as rk_reduce(), first within each node and then among the
+   nodes; |tmp| is scratch space for |n| tuples, provided by the
+   caller so that nothing is allocated at each call */
+void rk_reduce_hier( const rk_t *rk, const rk_stats_t *in, rk_stats_t *out, rk_stats_t *tmp, int n )
+{
+  MPI_Reduce(in, tmp, n, rk->type, rk->op, 0, rk->node);
+  if ( rk->leaders != MPI_COMM_NULL ) {
+    MPI_Reduce(tmp, out, n, rk->type, rk->op, 0, rk->leaders);
+  }
+}
+
+/* Datatype for the elements start, ... start+count-1 of each of the
+   |nfields| arrays cols[0], ... cols[nfields-1]: a struct with one
+   block of |count| floats at the absolute address of each part, to be
+   used with MPI_BOTTOM as the buffer */
+MPI_Datatype rk_fields_type( float * const *cols, int nfields, int start, int count )
+{
+  MPI_Datatype type;
+  int *blocklens = (int*)malloc(nfields * sizeof(*blocklens));
+  MPI_Aint *displs = (MPI_Aint*)malloc(nfields * sizeof(*displs));
+  MPI_Datatype *types = (MPI_Datatype*)malloc(nfields * sizeof(*types));
+  int f;
+
+  for (f=0; f<nfields; f++) {
+    blocklens[f] = count;
+    MPI_Get_address(cols[f] + start, &displs[f]);
+    types[f] = MPI_FLOAT;
+  }
+  MPI_Type_create_struct(nfields, blocklens, displs, types, &type);
+  MPI_Type_commit(&type);
+  free(blocklens);
+  free(displs);
+  free(types);
+  return type;
+}
+
+/* Scatter the |nfields| arrays cols[0], ... cols[nfields-1] of the
+   root (rank 0) with a single collective: process p receives the
+   elements displs[p], ... displs[p]+counts[p]-1 of every field f in
+   local[f]. MPI_Scatterv() can only send parts of one array, so this
+   uses MPI_Alltoallw(), that accepts a different datatype for each
+   process: the root sends to process p the datatype that describes
+   its part of all the fields, and nothing is copied to temporary
+   buffers. |cols| is only used on the root. */
+void rk_scatter_fields( const rk_t *rk, float * const *cols, int nfields, const int *counts, const int *displs, float **local )
+{
+  int rank, size, p;
+  int *sendcounts, *recvcounts, *zeros;
+  MPI_Datatype *sendtypes, *recvtypes;
+
+  MPI_Comm_rank(rk->comm, &rank);
+  MPI_Comm_size(rk->comm, &size);
+  sendcounts = (int*)calloc(size, sizeof(*sendcounts));
+  recvcounts = (int*)calloc(size, sizeof(*recvcounts));
+  zeros = (int*)calloc(size, sizeof(*zeros)); /* byte displacements */
+  sendtypes = (MPI_Datatype*)malloc(size * sizeof(*sendtypes));
+  recvtypes = (MPI_Datatype*)malloc(size * sizeof(*recvtypes));
+  for (p=0; p<size; p++) {
+    sendtypes[p] = recvtypes[p] = MPI_FLOAT;
+  }
+  if ( 0 == rank ) {
+    for (p=0; p<size; p++) {
+      sendcounts[p] = 1;
+      sendtypes[p] = rk_fields_type(cols, nfields, displs[p], counts[p]);
+    }
+  }
+  recvcounts[0] = 1;
+  recvtypes[0] = rk_fields_type(local, nfields, 0, counts[rank]);
+
+  MPI_Alltoallw(MPI_BOTTOM, sendcounts, zeros, sendtypes,
+                MPI_BOTTOM, recvcounts, zeros, recvtypes, rk->comm);
+
+  if ( 0 == rank ) {
+    for (p=0; p<size; p++) {
+      MPI_Type_free(&sendtypes[p]);
+    }
+  }
+  MPI_Type_free(&recvtypes[0]);
+  free(sendcounts);
+  free(recvcounts);
+  free(zeros);
+  free(sendtypes);
+  free(recvtypes);
+}
+
+#endif
@@ -0,0 +1,321 @@
+/* */
+/****************************************************************************
+ *
+ * mandel-simd.h - Vectorized escape-time kernel for the Mandelbrot set
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * This header provides functions that iterate the recurrence
+ *
+ * z_0 = 0;
+ * z_{n+1} = z_n^2 + cx + i*cy;
+ *
+ * on several points at once, using the vector datatypes of GCC. The
+ * vector width is chosen at compile time: with AVX-512 (-march=native
+ * on a machine that supports it) a float vector holds 16 points,
+ * otherwise 8 points (AVX2); double vectors hold half as many
+ * points. Each lane keeps its own iteration count; a lane becomes
+ * inactive as soon as its point escapes, and the loop terminates
+ * when all lanes are inactive.
+ *
+ * Compile the programs that include this file with -O2 -march=native,
+ * otherwise GCC emulates the vector operations with scalar code.
+ *
+ * The same file is used by ex2-mpi/mpi-mandelbrot.c and by
+ * ex2-openmp/omp-mandelbrot-area.c; keep the two copies in sync.
+ *
+ ****************************************************************************/
+
+#ifndef MANDEL_SIMD_H
+#define MANDEL_SIMD_H
+
+#include <string.h> /* for memcpy() */
+
+#if defined(__AVX512F__)
+#define MANDEL_VLEN 16
+#else
+#define MANDEL_VLEN 8
+#endif
+
+/* Number of lanes of the double-precision vectors */
+#define MANDEL_VLEN_D (MANDEL_VLEN/2)
+
+typedef float mandel_vf __attribute__((vector_size(MANDEL_VLEN*sizeof(float))));
+typedef int mandel_vi __attribute__((vector_size(MANDEL_VLEN*sizeof(int))));
+typedef double mandel_vd __attribute__((vector_size(MANDEL_VLEN_D*sizeof(double))));
+typedef long long mandel_vl __attribute__((vector_size(MANDEL_VLEN_D*sizeof(long long))));
+
+/* Returns nonzero iff at least one lane of |*m| is set */
+int mandel_any_i( const mandel_vi *m )
+{
+  int k, r = 0;
+  for (k=0; k<MANDEL_VLEN; k++) {
+    r |= (*m)[k];
+  }
+  return r;
+}
+
+/* Returns nonzero iff at least one lane of |*m| is set */
+int mandel_any_l( const mandel_vl *m )
+{
+  int k;
+  long long r = 0;
+  for (k=0; k<MANDEL_VLEN_D; k++) {
+    r |= (*m)[k];
+  }
+  return (r != 0);
+}
+
+/*
+ * Iterate the recurrence on the MANDEL_VLEN points (cx[k], cy[k]),
+ * using single precision. Store in it[k] the first n such that
+ * |z_n| > 2, or |maxit| if |z_n| is bounded after |maxit|
+ * iterations. Arrays need not be aligned.
+ *
+ * Note that the scalar loop of mpi-mandelbrot.c computes 2.0*x*y in
+ * double precision, while this function stays in single precision;
+ * therefore, a few points close to the boundary of the set may get
+ * slightly different iteration counts.
+ */
+void mandel_iterate_ps( const float *cx, const float *cy, int *it, int maxit )
+{
+  mandel_vf vcx, vcy, x = {0}, y = {0}, xnew;
+  mandel_vi count = {0}, active;
+  int n;
+
+  memcpy(&vcx, cx, sizeof(vcx));
+  memcpy(&vcy, cy, sizeof(vcy));
+  for (n=0; n<maxit; n++) {
+    /* lanes whose point has escaped are 0, the others are -1; once a
+       lane escapes |z| keeps growing (up to inf/NaN), so it never
+       becomes active again */
+    active = (x*x + y*y <= 4.0f);
+    if ( ! mandel_any_i(&active) ) {
+      break;
+    }
+    count -= active;
+    xnew = x*x - y*y + vcx;
+    y = 2.0f*x*y + vcy;
+    x = xnew;
+  }
+  memcpy(it, &count, sizeof(count));
+}
+
+/*
+ * Same as mandel_iterate_ps(), also storing in zz[k] the squared
+ * modulus |z_n|^2 of the first iterate that escapes (zz[k] is
+ * unspecified if it[k] == maxit). This is what is needed to compute
+ * a fractional ("smooth") iteration count. The iteration counts are
+ * identical to those of mandel_iterate_ps().
+ */
+void mandel_iterate_esc_ps( const float *cx, const float *cy, int *it, float *zz, int maxit )
+{
+  mandel_vf vcx, vcy, x = {0}, y = {0}, xnew, mag, last = {0};
+  mandel_vi count = {0}, active, prev = ~count;
+  int n;
+
+  memcpy(&vcx, cx, sizeof(vcx));
+  memcpy(&vcy, cy, sizeof(vcy));
+  for (n=0; n<maxit; n++) {
+    mag = x*x + y*y;
+    /* |z|^2 is recorded as long as the lane was active at the
+       previous iteration, so that the escaping value is kept */
+    last = (mandel_vf)(((mandel_vi)mag & prev) | ((mandel_vi)last & ~prev));
+    active = (mag <= 4.0f);
+    if ( ! mandel_any_i(&active) ) {
+      break;
+    }
+    count -= active;
+    xnew = x*x - y*y + vcx;
+    y = 2.0f*x*y + vcy;
+    x = xnew;
+    prev = active;
+  }
+  memcpy(it, &count, sizeof(count));
+  memcpy(zz, &last, sizeof(last));
+}
+
+/*
+ * Same as mandel_iterate_ps(), using double precision on the
+ * MANDEL_VLEN_D points (cx[k], cy[k]). The arithmetic is the same as
+ * the scalar recurrence, so the iteration counts are identical to
+ * those of a scalar loop compiled without FP contraction (which is
+ * what -std=c99 implies).
+ */
+void mandel_iterate_pd( const double *cx, const double *cy, int *it, int maxit )
+{
+  mandel_vd vcx, vcy, x = {0}, y = {0}, xnew;
+  mandel_vl count = {0}, active;
+  int n, k;
+
+  memcpy(&vcx, cx, sizeof(vcx));
+  memcpy(&vcy, cy, sizeof(vcy));
+  for (n=0; n<maxit; n++) {
+    active = (x*x + y*y <= 4.0);
+    if ( ! mandel_any_l(&active) ) {
+      break;
+    }
+    count -= active;
+    xnew = x*x - y*y + vcx;
+    y = 2.0*x*y + vcy;
+    x = xnew;
+  }
+  for (k=0; k<MANDEL_VLEN_D; k++) {
+    it[k] = count[k];
+  }
+}
+
+/*
+ * Same as mandel_iterate_pd(), with periodicity checking based on
+ * Brent's cycle detection algorithm: the value of z is saved at
+ * iterations 1, 2, 4, 8, ...; if a later iterate of an active lane is
+ * bitwise identical to the saved value, the (floating-point) orbit of
+ * that lane is periodic and will never escape. The lane is then
+ * stopped, its count is set to |maxit|, and cycled[k] is set to 1
+ * (it is 0 for all other lanes). Since the test is exact, the counts
+ * are identical to those of mandel_iterate_pd().
+ */
+void mandel_iterate_pd_brent( const double *cx, const double *cy, int *it, int *cycled, int maxit )
+{
+  mandel_vd vcx, vcy, x = {0}, y = {0}, sx = {0}, sy = {0}, xnew;
+  mandel_vl count = {0}, active, done = {0}, same;
+  int n, k, check = 1;
+
+  memcpy(&vcx, cx, sizeof(vcx));
+  memcpy(&vcy, cy, sizeof(vcy));
+  for (n=0; n<maxit; n++) {
+    /* lanes that detected a cycle are no longer active */
+    active = (x*x + y*y <= 4.0) & ~done;
+    if ( ! mandel_any_l(&active) ) {
+      break;
+    }
+    count -= active;
+    xnew = x*x - y*y + vcx;
+    y = 2.0*x*y + vcy;
+    x = xnew;
+    same = active & (x == sx) & (y == sy);
+    done |= same;
+    if ( n + 1 == check ) {
+      sx = x;
+      sy = y;
+      check *= 2;
+    }
+  }
+  for (k=0; k<MANDEL_VLEN_D; k++) {
+    cycled[k] = (done[k] != 0);
+    it[k] = (cycled[k] ? maxit : count[k]);
+  }
+}
+
+/*
+ * Apply mandel_iterate_ps() to the |n| points (cx[i], cy[i]), storing
+ * the iteration counts in it[i]. |n| need not be a multiple of the
+ * vector width: the last, partial vector is padded with points that
+ * escape immediately.
+ */
+void mandel_iterate_n_ps( const float *cx, const float *cy, int *it, int n, int maxit )
+{
+  int i;
+  for (i=0; i + MANDEL_VLEN <= n; i += MANDEL_VLEN) {
+    mandel_iterate_ps(cx + i, cy + i, it + i, maxit);
+  }
+  if ( i < n ) {
+    float pcx[MANDEL_VLEN], pcy[MANDEL_VLEN];
+    int pit[MANDEL_VLEN], k;
+    for (k=0; i+k<n; k++) {
+      pcx[k] = cx[i+k];
+      pcy[k] = cy[i+k];
+    }
+    for (; k<MANDEL_VLEN; k++) {
+      pcx[k] = pcy[k] = 4.0f;
+    }
+    mandel_iterate_ps(pcx, pcy, pit, maxit);
+    for (k=0; i+k<n; k++) {
+      it[i+k] = pit[k];
+    }
+  }
+}
+
+/* Same as mandel_iterate_n_ps(), using mandel_iterate_esc_ps() */
+void mandel_iterate_n_esc_ps( const float *cx, const float *cy, int *it, float *zz, int n, int maxit )
+{
+  int i;
+  for (i=0; i + MANDEL_VLEN <= n; i += MANDEL_VLEN) {
+    mandel_iterate_esc_ps(cx + i, cy + i, it + i, zz + i, maxit);
+  }
+  if ( i < n ) {
+    float pcx[MANDEL_VLEN], pcy[MANDEL_VLEN], pzz[MANDEL_VLEN];
+    int pit[MANDEL_VLEN], k;
+    for (k=0; i+k<n; k++) {
+      pcx[k] = cx[i+k];
+      pcy[k] = cy[i+k];
+    }
+    for (; k<MANDEL_VLEN; k++) {
+      pcx[k] = pcy[k] = 4.0f;
+    }
+    mandel_iterate_esc_ps(pcx, pcy, pit, pzz, maxit);
+    for (k=0; i+k<n; k++) {
+      it[i+k] = pit[k];
+      zz[i+k] = pzz[k];
+    }
+  }
+}
+
+/* Same as mandel_iterate_n_ps(), in double precision */
+void mandel_iterate_n_pd( const double *cx, const double *cy, int *it, int n, int maxit )
+{
+  int i;
+  for (i=0; i + MANDEL_VLEN_D <= n; i += MANDEL_VLEN_D) {
+    mandel_iterate_pd(cx + i, cy + i, it + i, maxit);
+  }
+  if ( i < n ) {
+    double pcx[MANDEL_VLEN_D], pcy[MANDEL_VLEN_D];
+    int pit[MANDEL_VLEN_D], k;
+    for (k=0; i+k<n; k++) {
+      pcx[k] = cx[i+k];
+      pcy[k] = cy[i+k];
+    }
+    for (; k<MANDEL_VLEN_D; k++) {
+      pcx[k] = pcy[k] = 4.0;
+    }
+    mandel_iterate_pd(pcx, pcy, pit, maxit);
+    for (k=0; i+k<n; k++) {
+      it[i+k] = pit[k];
+    }
+  }
+}
+
+/* Same as mandel_iterate_n_pd(), using mandel_iterate_pd_brent() */
+void mandel_iterate_n_pd_brent( const double *cx, const double *cy, int *it, int *cycled, int n, int maxit )
+{
+  int i;
+  for (i=0; i + MANDEL_VLEN_D <= n; i += MANDEL_VLEN_D) {
+    mandel_iterate_pd_brent(cx + i, cy + i, it + i, cycled + i, maxit);
+  }
+  if ( i < n ) {
+    double pcx[MANDEL_VLEN_D], pcy[MANDEL_VLEN_D];
+    int pit[MANDEL_VLEN_D], pcycled[MANDEL_VLEN_D], k;
+    for (k=0; i+k<n; k++) {
+      pcx[k] = cx[i+k];
+      pcy[k] = cy[i+k];
+    }
+    for (; k<MANDEL_VLEN_D; k++) {
+      pcx[k] = pcy[k] = 4.0;
+    }
+    mandel_iterate_pd_brent(pcx, pcy, pit, pcycled, maxit);
+    for (k=0; i+k<n; k++) {
+      it[i+k] = pit[k];
+      cycled[i+k] = pcycled[k];
+    }
+  }
+}
+
+#endif
@@ -27,14 +27,23 @@
  *
  * ./omp-dynamic [n]
  *
+ * The loop is distributed by the scheduler of omp-sched.h; the
+ * policy is read from the environment variable SCHED (default
+ * "dynamic,1", i.e., an atomic counter). SCHED=critical selects the
+ * original emulation of schedule(dynamic,1), where the shared
+ * counter is protected by a critical section.
+ *
  * Example:
  *
  * OMP_NUM_THREADS=2 ./omp_dynamic
+ * SCHED=steal OMP_NUM_THREADS=8 ./omp-dynamic 100000
  *
  ****************************************************************************/
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "omp-sched.h"
 
 /* Recursive computation of the n-th Fibonacci number, for n=0, 1, 2, ...
    Do not parallelize this function. */
@@ -91,6 +100,11 @@ int main( int argc, char* argv[] )
   int i, n = 1024;
   const int max_n = 512*1024*1024;
   int *vin, *vout;
+  const char *policy = getenv("SCHED");
+  sched_kind_t kind = SCHED_DYNAMIC;
+  long chunk = 1;
+  sched_t sched;
+  int use_critical = (policy && 0 == strcmp(policy, "critical"));
 
   if ( argc > 2 ) {
     fprintf(stderr, "Usage: %s [n]\n", argv[0]);
@@ -106,6 +120,11 @@ int main( int argc, char* argv[] )
     return EXIT_FAILURE;
   }
 
+  if ( policy && ! use_critical && sched_parse(policy, &kind, &chunk) ) {
+    fprintf(stderr, "FATAL: invalid schedule \"%s\"\n", policy);
+    return EXIT_FAILURE;
+  }
+
   /* initialize the input and output arrays */
   vin = (int*)malloc(n * sizeof(vin[0]));
   vout = (int*)malloc(n * sizeof(vout[0]));
@@ -121,21 +140,31 @@ int main( int argc, char* argv[] )
      "schedule(dynamic,1)" clause, i.e., dynamic scheduling with
      block size 1. Do not modify the body of the fib_rec()
      function. */
-  int idx = 0;
+  if ( use_critical ) {
+    int idx = 0;
 #pragma omp parallel shared(idx)
-  {
-    int my_idx;
-    do {
+    {
+      int my_idx;
+      do {
 #pragma omp critical
-      {
-        my_idx = idx;
-        idx++;
-      }
-      if (my_idx < n){
-        vout[my_idx] = fib_rec(vin[my_idx]);
-        printf("vin[%d]=%d vout[%d]=%d\n", my_idx, vin[my_idx], i, vout[my_idx]);
+        {
+          my_idx = idx;
+          idx++;
+        }
+        if (my_idx < n){
+          vout[my_idx] = fib_rec(vin[my_idx]);
+        }
+      } while(my_idx < n);
+    }
+  } else {
+    sched_init(&sched, kind, n, chunk);
+#pragma omp parallel default(none) shared(sched, vin, vout)
+    {
+      long j;
+      SCHED_FOR(&sched, j) {
+        vout[j] = fib_rec(vin[j]);
       }
-    } while(my_idx < n);
+    }
   }
 
   const double elapsed = omp_get_wtime() - tstart;
@@ -151,6 +180,10 @@ int main( int argc, char* argv[] )
   }
   printf("Test OK\n");
   printf("Elapsed time: %f\n", elapsed);
+  if ( ! use_critical ) {
+    sched_report(&sched, stdout);
+    sched_free(&sched);
+  }
 
   free(vin);
   free(vout);
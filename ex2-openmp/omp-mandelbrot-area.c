@@ -17,50 +17,70 @@
  * --------------------------------------------------------------------------
  *
  * Compile with:
- * gcc -fopenmp -std=c99 -Wall -Wpedantic omp-mandelbrot-area.c -o omp-mandelbrot-area
+ * gcc -fopenmp -std=c99 -Wall -Wpedantic -O2 -march=native omp-mandelbrot-area.c -o omp-mandelbrot-area
  * 
  * Run with:
- * ./omp-mandelbrot-area [npoints]
+ * ./omp-mandelbrot-area [npoints [shortcuts]]
+ *
+ * where |shortcuts| selects how points inside the set are detected
+ * without running all MAXIT iterations:
+ *
+ * none   brute force: every point is iterated up to MAXIT times
+ * bulb   points in the main cardioid or in the period-2 bulb are
+ *        recognized analytically, and not iterated at all
+ * cycle  periodicity checking (Brent's algorithm) stops the iteration
+ *        of points whose orbit becomes periodic
+ * all    bulb + cycle (default)
+ *
+ * All modes produce the same area estimate; the program reports how
+ * many points were resolved by each shortcut.
+ *
+ * Rows of the grid are distributed among the threads by the
+ * scheduler of omp-sched.h, selected with the environment variable
+ * SCHED (static, dynamic, guided or steal, optionally followed by
+ * ",chunk"; default "dynamic"). The per-thread statistics of the
+ * scheduler are printed at the end. Example:
+ *
+ * SCHED=steal,2 OMP_NUM_THREADS=4 ./omp-mandelbrot-area 2000 none
  *
  ******************************************************************************/
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "mandel-simd.h"
+#include "omp-sched.h"
 
 const int MAXIT = 10000; /* Higher value = slower to detect points that belong to the Mandelbrot set */
 
-struct d_complex {
-    double re;
-    double im;
-};
-
-/**
- * Performs the iteration z = z*z+c, until ||z|| > 2 when point is
- * known to be outside the Mandelbrot set. If loop count reaches
- * MAXIT, point is considered to be inside the set. Returns 1 iff
- * inside the set.
- */
-int inside(struct d_complex c)
+/* Returns 1 iff c = cre + i*cim lies in the main cardioid */
+int in_cardioid( double cre, double cim )
 {
-    struct d_complex z = {0.0, 0.0}, znew;
-    int it;
+    const double q = (cre - 0.25)*(cre - 0.25) + cim*cim;
+    return (q*(q + (cre - 0.25)) <= 0.25*cim*cim);
+}
 
-    for ( it = 0; (it < MAXIT) && (z.re*z.re + z.im*z.im <= 4.0); it++ ) {
-        znew.re = z.re*z.re - z.im*z.im + c.re;
-        znew.im = 2.0*z.re*z.im + c.im;
-        z = znew;
-    }
-    return (it >= MAXIT);
+/* Returns 1 iff c = cre + i*cim lies in the period-2 bulb, i.e., the
+   disc of radius 1/4 centered at -1 */
+int in_bulb2( double cre, double cim )
+{
+    return ((cre + 1.0)*(cre + 1.0) + cim*cim <= 0.0625);
 }
 
 int main( int argc, char *argv[] )
 {
     int i, j, ninside = 0, npoints = 1000;
+    int n_cardioid = 0, n_bulb = 0, n_cycle = 0, n_maxit = 0;
+    int use_bulb = 1, use_cycle = 1;
     double area, error;
     const double eps = 1.0e-5;
+    const char *policy = getenv("SCHED");
+    sched_kind_t kind = SCHED_DYNAMIC;
+    long chunk = 0;
+    sched_t sched;
 
-    if (argc > 2) {
-        fprintf(stderr, "Usage: %s [npoints]\n", argv[0]);
+    if (argc > 3) {
+        fprintf(stderr, "Usage: %s [npoints [none|bulb|cycle|all]]\n", argv[0]);
         return EXIT_FAILURE;
     }
 
@@ -68,23 +88,79 @@ int main( int argc, char *argv[] )
         npoints = atoi(argv[1]);
     }
 
-    printf("Using a %d x %d grid\n", npoints, npoints);
+    if (argc > 2) {
+        use_bulb = (0 == strcmp(argv[2], "bulb") || 0 == strcmp(argv[2], "all"));
+        use_cycle = (0 == strcmp(argv[2], "cycle") || 0 == strcmp(argv[2], "all"));
+        if ( ! use_bulb && ! use_cycle && strcmp(argv[2], "none") ) {
+            fprintf(stderr, "FATAL: unknown shortcut \"%s\"\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ( policy && sched_parse(policy, &kind, &chunk) ) {
+        fprintf(stderr, "FATAL: invalid schedule \"%s\"\n", policy);
+        return EXIT_FAILURE;
+    }
+
+    printf("Using a %d x %d grid, shortcuts:%s%s\n", npoints, npoints,
+           (use_bulb ? " cardioid/bulb" : ""), (use_cycle ? " cycle" : (use_bulb ? "" : " none")));
 
     /* Loop over grid of points in the complex plane which contains
        the Mandelbrot set, testing each point to see whether it is
        inside or outside the set. */
     const double tstart = omp_get_wtime();
+    sched_init(&sched, kind, npoints, chunk);
+
+    /* Each thread tests one row of the grid at a time. Points that
+       are recognized analytically as belonging to the main cardioid
+       or to the period-2 bulb are counted directly; the others are
+       packed into cre[], cim[] and iterated MANDEL_VLEN_D at a time
+       by mandel_iterate_n_pd(), which performs the same computation
+       of the scalar loop z = z*z+c, until ||z|| > 2 or MAXIT
+       iterations have been done (mandel_iterate_n_pd_brent() also
+       stops when the orbit becomes periodic). A point is considered
+       to be inside the set iff the loop count reaches MAXIT. */
+#pragma omp parallel default(none) shared(npoints, eps, MAXIT, use_bulb, use_cycle, sched) private(i, j) reduction(+:n_cardioid, n_bulb, n_cycle, n_maxit)
+    {
+        double *cre = (double*)malloc(npoints * sizeof(*cre));
+        double *cim = (double*)malloc(npoints * sizeof(*cim));
+        int *it = (int*)malloc(npoints * sizeof(*it));
+        int *cycled = (int*)malloc(npoints * sizeof(*cycled));
 
-    /* [TODO] Parallelize the following loop(s) */
-#pragma omp parallel for schedule(runtime) reduction(+:ninside) default(none) private(j) shared(npoints)
-    for (i=0; i<npoints; i++) {
-        for (j=0; j<npoints; j++) {
-            struct d_complex c;
-            c.re = -2.0 + 2.5*i/(double)(npoints) + eps;
-            c.im = 1.125*j/(double)(npoints) + eps;
-            ninside += inside(c);
+        SCHED_FOR(&sched, i) {
+            const double re = -2.0 + 2.5*i/(double)(npoints) + eps;
+            int n = 0;
+            for (j=0; j<npoints; j++) {
+                const double im = 1.125*j/(double)(npoints) + eps;
+                if ( use_bulb && in_cardioid(re, im) ) {
+                    n_cardioid++;
+                } else if ( use_bulb && in_bulb2(re, im) ) {
+                    n_bulb++;
+                } else {
+                    cre[n] = re;
+                    cim[n] = im;
+                    n++;
+                }
+            }
+            if ( use_cycle ) {
+                mandel_iterate_n_pd_brent(cre, cim, it, cycled, n, MAXIT);
+            } else {
+                mandel_iterate_n_pd(cre, cim, it, n, MAXIT);
+            }
+            for (j=0; j<n; j++) {
+                if ( use_cycle && cycled[j] ) {
+                    n_cycle++;
+                } else if ( it[j] >= MAXIT ) {
+                    n_maxit++;
+                }
+            }
         }
+        free(cre);
+        free(cim);
+        free(it);
+        free(cycled);
     }
+    ninside = n_cardioid + n_bulb + n_cycle + n_maxit;
 
     const double elapsed = omp_get_wtime() - tstart;
 
@@ -94,7 +170,11 @@ int main( int argc, char *argv[] )
 
     printf("Area of Mandlebrot set = %12.8f +/- %12.8f\n", area, error);
     printf("Correct answer should be around 1.50659\n");
+    printf("Points inside: %d (cardioid %d, bulb %d, cycle %d, MAXIT iterations %d)\n",
+           ninside, n_cardioid, n_bulb, n_cycle, n_maxit);
     printf("Elapsed time: %f\n", elapsed);
+    sched_report(&sched, stdout);
+    sched_free(&sched);
     return 0;
 }
 
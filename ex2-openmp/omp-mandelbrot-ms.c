@@ -0,0 +1,312 @@
+/* */
+/****************************************************************************
+ *
+ * omp-mandelbrot-ms.c - Mariani-Silver subdivision of the Mandelbrot set
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * This program draws the same image as ex2-mpi/mpi-mandelbrot.c (a
+ * ysize x (16/9 * ysize) grid covering [-2.5, 1] x [-1, 1], MAXIT
+ * iterations in single precision), without iterating every pixel.
+ * The image is recursively divided into rectangles (Mariani-Silver
+ * algorithm): if all the pixels on the border of a rectangle have the
+ * same iteration count, the interior is filled with that count;
+ * otherwise the rectangle is split in four by a horizontal and a
+ * vertical line, that are computed, and each part is processed in
+ * the same way as an OpenMP task. Rectangles whose side is at most
+ * |minsize| pixels are computed directly.
+ *
+ * The fill is exact for the continuous image: the points whose count
+ * is at least v form a connected set that contains the whole
+ * Mandelbrot set, and the points whose count is less than v form a
+ * connected, unbounded set. Therefore, the interior of a rectangle
+ * whose border has count v can not contain a different count, unless
+ * it contains the whole Mandelbrot set; rectangles containing c = 0
+ * are never filled. On the discrete grid, however, a channel of
+ * escaping points thinner than a pixel may cross the border of a
+ * rectangle that is otherwise inside the set, between two border
+ * pixels. For this reason, in a rectangle whose border is inside the
+ * set only the pixels that lie in the main cardioid or in the
+ * period-2 bulb are filled, and the others are computed; this still
+ * saves most of the work, since the cardioid and the bulb make up
+ * most of the area of the set. With -c the program also computes
+ * every pixel and reports the pixels that differ (none, on all the
+ * sizes we have tried).
+ *
+ * Compile with:
+ * gcc -fopenmp -std=c99 -Wall -Wpedantic -O2 -march=native omp-mandelbrot-ms.c -o omp-mandelbrot-ms
+ *
+ * Run with:
+ * ./omp-mandelbrot-ms [-b] [-c] [-m minsize] [ysize]
+ *
+ * where -b computes every pixel (brute force) and -c checks the
+ * result against brute force. The program reports the fraction of
+ * pixels that have been iterated, and writes the image to
+ * "mandelbrot-ms.ppm".
+ *
+ * Example:
+ * OMP_NUM_THREADS=4 ./omp-mandelbrot-ms -c 2048
+ *
+ ****************************************************************************/
+
+/* The following #define is required by getopt() */
+#define _XOPEN_SOURCE 600
+
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h> /* for getopt() */
+#include "mandel-simd.h"
+
+const int MAXIT = 1000;
+
+typedef struct {
+  uint8_t r;  /* red   */
+  uint8_t g;  /* green */
+  uint8_t b;  /* blue  */
+} pixel_t;
+
+typedef struct {
+  int *it;          /* iteration counts, row by row */
+  int xsize, ysize;
+  int minsize;      /* rectangles with a side of at most minsize pixels are not subdivided */
+  long niterated;   /* number of pixels that have been iterated */
+} image_t;
+
+/* Coordinates of pixel (x, y), computed as in mpi-mandelbrot.c */
+float coord_x( int x, int xsize ) { return -2.5 + 3.5 * (float)x / (xsize - 1); }
+float coord_y( int y, int ysize ) { return 1 - 2.0 * (float)y / (ysize - 1); }
+
+#define IT(img, x, y) ((img)->it[(size_t)(y) * (img)->xsize + (x)])
+
+/* Compute the iteration counts of the |n| pixels (x + i*dx, y + i*dy),
+   i = 0, ... n-1 */
+void compute_span( image_t *img, int x, int y, int dx, int dy, int n )
+{
+  int i;
+
+  if ( n < 1 ) {
+    return;
+  }
+  float *cx = (float*)malloc(n * sizeof(*cx));
+  float *cy = (float*)malloc(n * sizeof(*cy));
+  int *it = (int*)malloc(n * sizeof(*it));
+  i = 0;
+  do { /* n > 0 */
+    cx[i] = coord_x(x + i*dx, img->xsize);
+    cy[i] = coord_y(y + i*dy, img->ysize);
+  } while (++i < n);
+  mandel_iterate_n_ps(cx, cy, it, n, MAXIT);
+  for (i=0; i<n; i++) {
+    IT(img, x + i*dx, y + i*dy) = it[i];
+  }
+#pragma omp atomic
+  img->niterated += n;
+  free(cx);
+  free(cy);
+  free(it);
+}
+
+/* Returns 1 iff pixel (x, y) lies in the main cardioid or in the
+   period-2 bulb (see omp-mandelbrot-area.c) */
+int in_main_bulbs( const image_t *img, int x, int y )
+{
+  const double cre = coord_x(x, img->xsize), cim = coord_y(y, img->ysize);
+  const double q = (cre - 0.25)*(cre - 0.25) + cim*cim;
+  return (q*(q + (cre - 0.25)) <= 0.25*cim*cim ||
+          (cre + 1.0)*(cre + 1.0) + cim*cim <= 0.0625);
+}
+
+/* Process the rectangle with corners (x0, y0) and (x1, y1) (both
+   included), whose border has already been computed */
+void ms_rect( image_t *img, int x0, int y0, int x1, int y1 )
+{
+  int x, y;
+
+  if ( x1 - x0 < 2 || y1 - y0 < 2 ) {
+    return; /* no interior */
+  }
+
+  const int v = IT(img, x0, y0);
+  int uniform = ! (coord_x(x0, img->xsize) < 0.0f && coord_x(x1, img->xsize) > 0.0f &&
+                   coord_y(y1, img->ysize) < 0.0f && coord_y(y0, img->ysize) > 0.0f);
+  for (x=x0; x<=x1 && uniform; x++) {
+    uniform = (IT(img, x, y0) == v && IT(img, x, y1) == v);
+  }
+  for (y=y0+1; y<y1 && uniform; y++) {
+    uniform = (IT(img, x0, y) == v && IT(img, x1, y) == v);
+  }
+
+  if ( uniform && v < MAXIT ) {
+    for (y=y0+1; y<y1; y++) {
+      for (x=x0+1; x<x1; x++) {
+        IT(img, x, y) = v;
+      }
+    }
+  } else if ( uniform ) {
+    /* only the pixels that are known to be inside are filled; the
+       runs of other pixels are computed */
+    for (y=y0+1; y<y1; y++) {
+      int start = x0+1;
+      for (x=x0+1; x<=x1; x++) {
+        if ( x == x1 || in_main_bulbs(img, x, y) ) {
+          compute_span(img, start, y, 1, 0, x - start);
+          start = x + 1;
+          if ( x < x1 ) {
+            IT(img, x, y) = MAXIT;
+          }
+        }
+      }
+    }
+  } else if ( x1 - x0 <= img->minsize || y1 - y0 <= img->minsize ) {
+    for (y=y0+1; y<y1; y++) {
+      compute_span(img, x0+1, y, 1, 0, x1-x0-1);
+    }
+  } else {
+    const int xm = (x0 + x1)/2, ym = (y0 + y1)/2;
+    /* the dividing lines are computed here, so that the four parts
+       do not share any pixel that still has to be written */
+    compute_span(img, x0+1, ym, 1, 0, x1-x0-1);
+    compute_span(img, xm, y0+1, 0, 1, ym-y0-1);
+    compute_span(img, xm, ym+1, 0, 1, y1-ym-1);
+    /* small rectangles are processed by the current task */
+    const int spawn = ((x1 - x0) * (y1 - y0) > 64*64);
+#pragma omp task if(spawn)
+    ms_rect(img, x0, y0, xm, ym);
+#pragma omp task if(spawn)
+    ms_rect(img, xm, y0, x1, ym);
+#pragma omp task if(spawn)
+    ms_rect(img, x0, ym, xm, y1);
+#pragma omp task if(spawn)
+    ms_rect(img, xm, ym, x1, y1);
+  }
+}
+
+/* Compute the whole image by subdivision */
+void draw_ms( image_t *img )
+{
+  const int xsize = img->xsize, ysize = img->ysize;
+
+  compute_span(img, 0, 0, 1, 0, xsize);
+  compute_span(img, 0, ysize-1, 1, 0, xsize);
+  compute_span(img, 0, 1, 0, 1, ysize-2);
+  compute_span(img, xsize-1, 1, 0, 1, ysize-2);
+#pragma omp parallel default(none) shared(img, xsize, ysize)
+#pragma omp single
+  ms_rect(img, 0, 0, xsize-1, ysize-1);
+}
+
+/* Compute every pixel of the image */
+void draw_brute( image_t *img )
+{
+  int y;
+#pragma omp parallel for schedule(dynamic) default(none) shared(img)
+  for (y=0; y<img->ysize; y++) {
+    compute_span(img, 0, y, 1, 0, img->xsize);
+  }
+}
+
+/* Color of a point with |v| iterations; this is the gradient
+   produced by mandelcolor.c, used by mpi-mandelbrot.c */
+void set_color( pixel_t *p, int v )
+{
+  if ( v >= MAXIT ) {
+    p->r = p->g = p->b = 0;
+  } else {
+    const float n = (v % 100) / 99.0f;
+    p->r = (unsigned char)(0x22 * (1.0f-n) + (float)0xca * n);
+    p->g = (unsigned char)(0xce * (1.0f-n) + (float)0xac * n);
+    p->b = (unsigned char)(0x5a * (1.0f-n) + (float)0x0c * n);
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+  const char *fname = "mandelbrot-ms.ppm";
+  int ysize = 1024, minsize = 8, brute = 0, check = 0, opt;
+  image_t img;
+  size_t i, npix;
+  FILE *out;
+
+  while ( (opt = getopt(argc, argv, "bcm:")) != -1 ) {
+    switch (opt) {
+    case 'b': brute = 1; break;
+    case 'c': check = 1; break;
+    case 'm': minsize = atoi(optarg); break;
+    default:
+      fprintf(stderr, "Usage: %s [-b] [-c] [-m minsize] [ysize]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if ( optind < argc ) {
+    ysize = atoi(argv[optind]);
+  }
+
+  img.xsize = ysize * 1.777777778;
+  img.ysize = ysize;
+  img.minsize = (minsize < 2 ? 2 : minsize);
+  img.niterated = 0;
+  if ( ysize < 3 ) {
+    fprintf(stderr, "FATAL: ysize must be at least 3\n");
+    return EXIT_FAILURE;
+  }
+  npix = (size_t)img.xsize * img.ysize;
+  img.it = (int*)malloc(npix * sizeof(*img.it));
+
+  const double tstart = omp_get_wtime();
+  if ( brute ) {
+    draw_brute(&img);
+  } else {
+    draw_ms(&img);
+  }
+  const double elapsed = omp_get_wtime() - tstart;
+
+  printf("%s, %d x %d pixels, minsize %d\n", (brute ? "Brute force" : "Mariani-Silver"), img.xsize, img.ysize, img.minsize);
+  printf("Pixels iterated: %ld (%.2f%%)\n", img.niterated, 100.0 * img.niterated / npix);
+  printf("Elapsed time: %f\n", elapsed);
+
+  if ( check && ! brute ) {
+    image_t ref = img;
+    long ndiff = 0;
+    ref.it = (int*)malloc(npix * sizeof(*ref.it));
+    const double tref = omp_get_wtime();
+    draw_brute(&ref);
+    printf("Brute force time: %f\n", omp_get_wtime() - tref);
+    for (i=0; i<npix; i++) {
+      ndiff += (ref.it[i] != img.it[i]);
+    }
+    printf("Pixels that differ from brute force: %ld\n", ndiff);
+    free(ref.it);
+  }
+
+  pixel_t *bitmap = (pixel_t*)malloc(npix * sizeof(*bitmap));
+  for (i=0; i<npix; i++) {
+    set_color(&bitmap[i], img.it[i]);
+  }
+  out = fopen(fname, "w");
+  if ( !out ) {
+    fprintf(stderr, "FATAL: cannot create %s\n", fname);
+    return EXIT_FAILURE;
+  }
+  fprintf(out, "P6\n");
+  fprintf(out, "%d %d\n", img.xsize, img.ysize);
+  fprintf(out, "255\n");
+  fwrite(bitmap, sizeof(*bitmap), npix, out);
+  fclose(out);
+
+  free(bitmap);
+  free(img.it);
+  return EXIT_SUCCESS;
+}
+
+// vim: set nofoldenable :
@@ -0,0 +1,167 @@
+/* */
+/****************************************************************************
+ *
+ * omp-mandelbrot-simd.c - Benchmark of the vectorized Mandelbrot kernel
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * This program compares the scalar escape-time loops used by
+ * ex2-mpi/mpi-mandelbrot.c (single precision) and by
+ * omp-mandelbrot-area.c (double precision) with the vectorized
+ * kernels of mandel-simd.h. Each version computes the iteration
+ * counts of a ysize x (16/9 * ysize) grid covering the region
+ * [-2.5, 1] x [-1, 1]; rows are distributed among OpenMP threads in
+ * the same way for all versions. For each version the program prints
+ * the throughput in Mpoints/s and in Giterations/s, and the number of
+ * points whose iteration count differs from the scalar version.
+ *
+ * Compile with:
+ * gcc -fopenmp -std=c99 -Wall -Wpedantic -O2 -march=native omp-mandelbrot-simd.c -o omp-mandelbrot-simd
+ *
+ * Run with:
+ * ./omp-mandelbrot-simd [ysize [maxit]]
+ *
+ * Example:
+ * OMP_NUM_THREADS=4 ./omp-mandelbrot-simd 1024 1000
+ *
+ ****************************************************************************/
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mandel-simd.h"
+
+/* Scalar loop of mpi-mandelbrot.c */
+int iterate_float( float cx, float cy, int maxit )
+{
+  float x = 0.0f, y = 0.0f, xnew, ynew;
+  int it;
+  for ( it = 0; (it < maxit) && (x*x + y*y <= 2.0*2.0); it++ ) {
+    xnew = x*x - y*y + cx;
+    ynew = 2.0*x*y + cy;
+    x = xnew;
+    y = ynew;
+  }
+  return it;
+}
+
+/* Scalar loop of omp-mandelbrot-area.c */
+int iterate_double( double cx, double cy, int maxit )
+{
+  double x = 0.0, y = 0.0, xnew, ynew;
+  int it;
+  for ( it = 0; (it < maxit) && (x*x + y*y <= 4.0); it++ ) {
+    xnew = x*x - y*y + cx;
+    ynew = 2.0*x*y + cy;
+    x = xnew;
+    y = ynew;
+  }
+  return it;
+}
+
+enum { SCALAR_FLOAT, SIMD_FLOAT, SCALAR_DOUBLE, SIMD_DOUBLE };
+
+const char *kernel_names[] = { "scalar float", "SIMD float", "scalar double", "SIMD double" };
+
+/* Compute the iteration counts of the whole grid with |kernel|,
+   storing them in it[]. Returns the elapsed time. */
+double run( int kernel, int *it, int xsize, int ysize, int maxit )
+{
+  const double tstart = omp_get_wtime();
+#pragma omp parallel default(none) shared(kernel, it, xsize, ysize, maxit)
+  {
+    float *cxf = (float*)malloc(xsize * sizeof(*cxf));
+    float *cyf = (float*)malloc(xsize * sizeof(*cyf));
+    double *cxd = (double*)malloc(xsize * sizeof(*cxd));
+    double *cyd = (double*)malloc(xsize * sizeof(*cyd));
+    int x, y;
+
+    for (x=0; x<xsize; x++) {
+      cxf[x] = cxd[x] = -2.5 + 3.5 * (double)x / (xsize - 1);
+    }
+#pragma omp for schedule(dynamic)
+    for (y=0; y<ysize; y++) {
+      int *row = it + (size_t)y * xsize;
+      const double cy = 1 - 2.0 * (double)y / (ysize - 1);
+      for (x=0; x<xsize; x++) {
+        cyf[x] = cyd[x] = cy;
+      }
+      switch (kernel) {
+      case SCALAR_FLOAT:
+        for (x=0; x<xsize; x++) {
+          row[x] = iterate_float(cxf[x], cyf[x], maxit);
+        }
+        break;
+      case SIMD_FLOAT:
+        mandel_iterate_n_ps(cxf, cyf, row, xsize, maxit);
+        break;
+      case SCALAR_DOUBLE:
+        for (x=0; x<xsize; x++) {
+          row[x] = iterate_double(cxd[x], cyd[x], maxit);
+        }
+        break;
+      default:
+        mandel_iterate_n_pd(cxd, cyd, row, xsize, maxit);
+      }
+    }
+    free(cxf);
+    free(cyf);
+    free(cxd);
+    free(cyd);
+  }
+  return omp_get_wtime() - tstart;
+}
+
+int main( int argc, char *argv[] )
+{
+  int ysize = 1024, maxit = 1000, kernel;
+  size_t i;
+
+  if ( argc > 3 ) {
+    fprintf(stderr, "Usage: %s [ysize [maxit]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if ( argc > 1 ) {
+    ysize = atoi(argv[1]);
+  }
+  if ( argc > 2 ) {
+    maxit = atoi(argv[2]);
+  }
+
+  const int xsize = ysize * 1.777777778;
+  const size_t npoints = (size_t)xsize * ysize;
+  int *ref = (int*)malloc(npoints * sizeof(*ref));
+  int *it = (int*)malloc(npoints * sizeof(*it));
+
+  printf("Grid %d x %d, maxit=%d, %d float lanes, %d double lanes, %d threads\n",
+         xsize, ysize, maxit, MANDEL_VLEN, MANDEL_VLEN_D, omp_get_max_threads());
+  printf("%-14s %10s %10s %10s %10s\n", "kernel", "time (s)", "Mpoints/s", "Giter/s", "mismatch");
+  for (kernel = SCALAR_FLOAT; kernel <= SIMD_DOUBLE; kernel++) {
+    /* the scalar versions are the reference for the SIMD versions */
+    const int is_scalar = (kernel == SCALAR_FLOAT || kernel == SCALAR_DOUBLE);
+    const double elapsed = run(kernel, is_scalar ? ref : it, xsize, ysize, maxit);
+    const int *cur = (is_scalar ? ref : it);
+    double niter = 0.0;
+    size_t nmismatch = 0;
+
+    for (i=0; i<npoints; i++) {
+      niter += cur[i];
+      nmismatch += (cur[i] != ref[i]);
+    }
+    printf("%-14s %10.4f %10.2f %10.3f %10lu\n", kernel_names[kernel], elapsed,
+           npoints / elapsed / 1.0e6, niter / elapsed / 1.0e9, (unsigned long)nmismatch);
+  }
+
+  free(ref);
+  free(it);
+  return EXIT_SUCCESS;
+}
+
+// vim: set nofoldenable :
@@ -0,0 +1,402 @@
+/* */
+/****************************************************************************
+ *
+ * omp-mandelbrot-tiles.c - Tile-cached Mandelbrot renderer with OpenMP
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * The square [-2.5, 1.5] x [-2, 2] of the complex plane is divided,
+ * at zoom level L, into 2^L x 2^L tiles of TILE x TILE pixels; pixel
+ * (0, 0) of the level is the top left corner of the square. A view is
+ * a rectangle of pixels of some level; rendering a view requires the
+ * escape iteration counts of all the tiles that it overlaps.
+ *
+ * Iteration counts (not colors) of each tile are stored in a cache
+ * directory, in one file per (level, tile x, tile y, maxit) named
+ * "L<level>-X<tx>-Y<ty>-M<maxit>.tile". Therefore, rendering a view
+ * that overlaps views rendered before (pans and zooms by powers of
+ * two) only computes the missing tiles, and recoloring a view with a
+ * different palette does not iterate at all. Missing tiles are
+ * computed in parallel by OpenMP threads, using the vectorized kernel
+ * of mandel-simd.h.
+ *
+ * Tile file format (all integers are little-endian):
+ *
+ *   char[4]   magic "MTIL"
+ *   uint32    level, tx, ty, maxit, tile size
+ *   uint32    encoding: 0 = raw, 1 = run-length
+ *   uint32    number of payload bytes
+ *   payload   raw:  TILE*TILE uint16 counts (uint32 if maxit > 65535)
+ *             RLE:  sequence of (uint16 run length, count) pairs
+ *
+ * RLE is used when it is smaller than the raw encoding, which is
+ * typical of tiles that contain large parts of the set or of its
+ * outer regions.
+ *
+ * The cache can be shared by several processes running at the same
+ * time: each tile is written to a temporary file with a unique name,
+ * that is then atomically renamed to its final name. Readers
+ * therefore see either a complete tile or no tile; files that fail
+ * the validity checks are treated as missing.
+ *
+ * Compile with:
+ * gcc -fopenmp -std=c99 -Wall -Wpedantic -O2 -march=native omp-mandelbrot-tiles.c -o omp-mandelbrot-tiles
+ *
+ * Run with:
+ * ./omp-mandelbrot-tiles [-l level] [-x px] [-y py] [-w width] [-h height] [-i maxit] [-p palette] [-d cachedir] [-o out.ppm]
+ *
+ * where (px, py) is the top left pixel of the view at the given
+ * level, and |palette| is 0 (green-yellow gradient of mpi-mandelbrot,
+ * default) or 1 (16-colors Wikipedia gradient). Example:
+ *
+ * mkdir cache
+ * ./omp-mandelbrot-tiles -l 3 -x 300 -y 700 -w 800 -h 600 -d cache
+ * ./omp-mandelbrot-tiles -l 3 -x 400 -y 700 -w 800 -h 600 -d cache
+ * ./omp-mandelbrot-tiles -l 3 -x 400 -y 700 -w 800 -h 600 -d cache -p 1
+ *
+ * The second command only computes the tiles not used by the first;
+ * the third one computes no tiles at all.
+ *
+ ****************************************************************************/
+
+/* The following #define is required by getopt() and mkstemp() */
+#define _XOPEN_SOURCE 600
+
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h> /* for getopt(), close() */
+#include <sys/stat.h> /* for fchmod() */
+#include "mandel-simd.h"
+
+#define TILE 256
+
+typedef struct {
+  uint8_t r;  /* red   */
+  uint8_t g;  /* green */
+  uint8_t b;  /* blue  */
+} pixel_t;
+
+/* color gradient from https://stackoverflow.com/questions/16500656/which-color-gradient-is-used-to-color-mandelbrot-in-wikipedia */
+const int wiki_colors[][3] = {
+  {66, 30, 15}, /* r, g, b */
+  {25, 7, 26},
+  {9, 1, 47},
+  {4, 4, 73},
+  {0, 7, 100},
+  {12, 44, 138},
+  {24, 82, 177},
+  {57, 125, 209},
+  {134, 181, 229},
+  {211, 236, 248},
+  {241, 233, 191},
+  {248, 201, 95},
+  {255, 170, 0},
+  {204, 128, 0},
+  {153, 87, 0},
+  {106, 52, 3} };
+
+const int NWIKI_COLORS = sizeof(wiki_colors)/sizeof(wiki_colors[0]);
+
+/* Color of a point with |v| iterations */
+void set_color( pixel_t *p, int v, int maxit, int palette )
+{
+  if ( v >= maxit ) {
+    p->r = p->g = p->b = 0;
+  } else if ( palette == 1 ) {
+    p->r = wiki_colors[v % NWIKI_COLORS][0];
+    p->g = wiki_colors[v % NWIKI_COLORS][1];
+    p->b = wiki_colors[v % NWIKI_COLORS][2];
+  } else {
+    /* the gradient produced by mandelcolor.c, used by mpi-mandelbrot.c */
+    const float n = (v % 100) / 99.0f;
+    p->r = (unsigned char)(0x22 * (1.0f-n) + (float)0xca * n);
+    p->g = (unsigned char)(0xce * (1.0f-n) + (float)0xac * n);
+    p->b = (unsigned char)(0x5a * (1.0f-n) + (float)0x0c * n);
+  }
+}
+
+/* Fill |name| with the name of the cache file of the given tile */
+void tile_name( char *name, size_t len, const char *dir, int level, long tx, long ty, int maxit )
+{
+  snprintf(name, len, "%s/L%d-X%ld-Y%ld-M%d.tile", dir, level, tx, ty, maxit);
+}
+
+/* Compute the iteration counts of tile (|tx|, |ty|) of |level|;
+   it[] has TILE*TILE elements. Returns the total number of
+   iterations. */
+double compute_tile( int *it, int level, long tx, long ty, int maxit )
+{
+  const double size = 4.0 / ((double)TILE * ((long)1 << level)); /* pixel size */
+  double cre[TILE], cim[TILE], niter = 0.0;
+  int x, y;
+
+  for (y=0; y<TILE; y++) {
+    for (x=0; x<TILE; x++) {
+      cre[x] = -2.5 + size * ((double)tx * TILE + x + 0.5);
+      cim[x] = 2.0 - size * ((double)ty * TILE + y + 0.5);
+    }
+    mandel_iterate_n_pd(cre, cim, it + y*TILE, TILE, maxit);
+    for (x=0; x<TILE; x++) {
+      niter += it[y*TILE + x];
+    }
+  }
+  return niter;
+}
+
+/* Append the |nbytes| low-order bytes of |v| to |buf| in little-endian
+   order; return the new end of the buffer */
+unsigned char *put_le( unsigned char *buf, uint32_t v, int nbytes )
+{
+  int i;
+  for (i=0; i<nbytes; i++) {
+    *buf++ = (v >> (8*i)) & 0xff;
+  }
+  return buf;
+}
+
+uint32_t get_le( const unsigned char *buf, int nbytes )
+{
+  uint32_t v = 0;
+  int i;
+  for (i=nbytes-1; i>=0; i--) {
+    v = (v << 8) | buf[i];
+  }
+  return v;
+}
+
+/* Number of header bytes of a tile file */
+#define HDR_LEN (4 + 7*4)
+
+/* Save tile |it| to the cache. Returns 0 on success. */
+int save_tile( const int *it, const char *dir, int level, long tx, long ty, int maxit )
+{
+  const int vbytes = (maxit > 65535 ? 4 : 2);
+  const size_t raw_len = (size_t)TILE * TILE * vbytes;
+  unsigned char *raw = (unsigned char*)malloc(raw_len);
+  /* in the worst case RLE uses 2 extra bytes per count */
+  unsigned char *rle = (unsigned char*)malloc((size_t)TILE * TILE * (vbytes + 2));
+  unsigned char hdr[HDR_LEN], *p, *q;
+  char name[1024], tmpname[1100];
+  int i, fd, ret = -1;
+
+  p = raw;
+  q = rle;
+  for (i=0; i<TILE*TILE; ) {
+    int run = 1;
+    while ( i + run < TILE*TILE && run < 65535 && it[i+run] == it[i] ) {
+      run++;
+    }
+    q = put_le(q, run, 2);
+    q = put_le(q, it[i], vbytes);
+    i += run;
+  }
+  for (i=0; i<TILE*TILE; i++) {
+    p = put_le(p, it[i], vbytes);
+  }
+  const int use_rle = ((size_t)(q - rle) < raw_len);
+  const unsigned char *payload = (use_rle ? rle : raw);
+  const size_t payload_len = (use_rle ? (size_t)(q - rle) : raw_len);
+
+  memcpy(hdr, "MTIL", 4);
+  p = hdr + 4;
+  p = put_le(p, level, 4);
+  p = put_le(p, tx, 4);
+  p = put_le(p, ty, 4);
+  p = put_le(p, maxit, 4);
+  p = put_le(p, TILE, 4);
+  p = put_le(p, use_rle, 4);
+  put_le(p, payload_len, 4);
+
+  tile_name(name, sizeof(name), dir, level, tx, ty, maxit);
+  snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", name);
+  fd = mkstemp(tmpname);
+  if ( fd >= 0 ) {
+    FILE *f;
+    fchmod(fd, 0644); /* mkstemp() creates the file with mode 0600 */
+    f = fdopen(fd, "wb");
+    if ( f &&
+         fwrite(hdr, 1, HDR_LEN, f) == HDR_LEN &&
+         fwrite(payload, 1, payload_len, f) == payload_len &&
+         0 == fclose(f) ) {
+      /* rename() is atomic: other processes see either the old
+         state (no tile) or the complete tile */
+      ret = rename(tmpname, name);
+    } else {
+      if ( f ) {
+        fclose(f);
+      } else {
+        close(fd);
+      }
+    }
+    if ( ret ) {
+      remove(tmpname);
+    }
+  }
+  free(raw);
+  free(rle);
+  return ret;
+}
+
+/* Load a tile from the cache into it[]. Returns 0 on success, -1 if
+   the tile is not in the cache or is invalid. */
+int load_tile( int *it, const char *dir, int level, long tx, long ty, int maxit )
+{
+  const int vbytes = (maxit > 65535 ? 4 : 2);
+  unsigned char hdr[HDR_LEN], *payload = NULL;
+  char name[1024];
+  int ret = -1;
+  FILE *f;
+
+  tile_name(name, sizeof(name), dir, level, tx, ty, maxit);
+  f = fopen(name, "rb");
+  if ( !f ) {
+    return -1;
+  }
+  if ( fread(hdr, 1, HDR_LEN, f) == HDR_LEN &&
+       0 == memcmp(hdr, "MTIL", 4) &&
+       get_le(hdr+4, 4) == (uint32_t)level &&
+       get_le(hdr+8, 4) == (uint32_t)tx &&
+       get_le(hdr+12, 4) == (uint32_t)ty &&
+       get_le(hdr+16, 4) == (uint32_t)maxit &&
+       get_le(hdr+20, 4) == TILE ) {
+    const int use_rle = get_le(hdr+24, 4);
+    const size_t len = get_le(hdr+28, 4);
+    payload = (unsigned char*)malloc(len);
+    if ( len <= (size_t)TILE * TILE * (vbytes + 2) && fread(payload, 1, len, f) == len ) {
+      size_t pos = 0;
+      int i = 0;
+      if ( use_rle ) {
+        while ( pos + 2 + vbytes <= len && i < TILE*TILE ) {
+          int run = get_le(payload + pos, 2);
+          const int v = get_le(payload + pos + 2, vbytes);
+          pos += 2 + vbytes;
+          for ( ; run > 0 && i < TILE*TILE; run--) {
+            it[i++] = v;
+          }
+        }
+      } else {
+        for ( ; pos + vbytes <= len && i < TILE*TILE; pos += vbytes) {
+          it[i++] = get_le(payload + pos, vbytes);
+        }
+      }
+      ret = (i == TILE*TILE && pos == len ? 0 : -1);
+    }
+  }
+  free(payload);
+  fclose(f);
+  return ret;
+}
+
+int main( int argc, char *argv[] )
+{
+  const char *dir = ".", *fname = "mandelbrot-tiles.ppm";
+  int level = 2, maxit = 1000, palette = 0, opt;
+  long px = 0, py = 0, width = 1024, height = 768;
+  long tx, ty, ntiles = 0, ncomputed = 0, nmissing = 0;
+  double niter = 0.0;
+  FILE *out;
+
+  while ( (opt = getopt(argc, argv, "l:x:y:w:h:i:p:d:o:")) != -1 ) {
+    switch (opt) {
+    case 'l': level = atoi(optarg); break;
+    case 'x': px = atol(optarg); break;
+    case 'y': py = atol(optarg); break;
+    case 'w': width = atol(optarg); break;
+    case 'h': height = atol(optarg); break;
+    case 'i': maxit = atoi(optarg); break;
+    case 'p': palette = atoi(optarg); break;
+    case 'd': dir = optarg; break;
+    case 'o': fname = optarg; break;
+    default:
+      fprintf(stderr, "Usage: %s [-l level] [-x px] [-y py] [-w width] [-h height] [-i maxit] [-p palette] [-d cachedir] [-o out.ppm]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  const long level_size = (long)TILE << level; /* pixels per side of the level */
+  if ( level < 0 || level > 40 || maxit < 1 || width < 1 || height < 1 ||
+       px < 0 || py < 0 || px + width > level_size || py + height > level_size ) {
+    fprintf(stderr, "FATAL: the view must lie within the %ld x %ld pixels of level %d\n", level_size, level_size, level);
+    return EXIT_FAILURE;
+  }
+
+  const long tx0 = px / TILE, tx1 = (px + width - 1) / TILE;
+  const long ty0 = py / TILE, ty1 = (py + height - 1) / TILE;
+  const long ntx = tx1 - tx0 + 1;
+  ntiles = ntx * (ty1 - ty0 + 1);
+  int *tiles = (int*)malloc((size_t)ntiles * TILE * TILE * sizeof(*tiles));
+  long *missing = (long*)malloc(ntiles * sizeof(*missing));
+  pixel_t *bitmap = (pixel_t*)malloc((size_t)width * height * sizeof(*bitmap));
+  long t;
+
+  const double tstart = omp_get_wtime();
+
+  /* Load the cached tiles, and collect the missing ones */
+  for (t=0; t<ntiles; t++) {
+    tx = tx0 + t % ntx;
+    ty = ty0 + t / ntx;
+    if ( load_tile(tiles + (size_t)t * TILE * TILE, dir, level, tx, ty, maxit) ) {
+      missing[nmissing++] = t;
+    }
+  }
+  const double tload = omp_get_wtime() - tstart;
+
+  /* Compute and save the missing tiles */
+#pragma omp parallel for schedule(dynamic) default(none) shared(tiles, missing, nmissing, ntx, tx0, ty0, level, maxit, dir, stderr) private(t, tx, ty) reduction(+:niter, ncomputed)
+  for (long m=0; m<nmissing; m++) {
+    t = missing[m];
+    tx = tx0 + t % ntx;
+    ty = ty0 + t / ntx;
+    niter += compute_tile(tiles + (size_t)t * TILE * TILE, level, tx, ty, maxit);
+    if ( save_tile(tiles + (size_t)t * TILE * TILE, dir, level, tx, ty, maxit) ) {
+      fprintf(stderr, "Warning: cannot save tile (%ld, %ld) of level %d to %s\n", tx, ty, level, dir);
+    }
+    ncomputed++;
+  }
+  const double tcompute = omp_get_wtime() - tstart - tload;
+
+  /* Shade the view */
+#pragma omp parallel for default(none) shared(tiles, bitmap, px, py, width, height, tx0, ty0, ntx, maxit, palette)
+  for (long y=0; y<height; y++) {
+    for (long x=0; x<width; x++) {
+      const long gx = px + x, gy = py + y;
+      const long tile = (gy / TILE - ty0) * ntx + (gx / TILE - tx0);
+      const int v = tiles[(size_t)tile * TILE * TILE + (gy % TILE) * TILE + gx % TILE];
+      set_color(&bitmap[y*width + x], v, maxit, palette);
+    }
+  }
+  const double elapsed = omp_get_wtime() - tstart;
+
+  out = fopen(fname, "w");
+  if ( !out ) {
+    fprintf(stderr, "FATAL: cannot create %s\n", fname);
+    return EXIT_FAILURE;
+  }
+  fprintf(out, "P6\n");
+  fprintf(out, "%ld %ld\n", width, height);
+  fprintf(out, "255\n");
+  fwrite(bitmap, sizeof(*bitmap), (size_t)width * height, out);
+  fclose(out);
+
+  printf("Level %d, view (%ld, %ld) %ld x %ld, maxit=%d\n", level, px, py, width, height, maxit);
+  printf("Tiles: %ld needed, %ld cached, %ld computed (%g iterations)\n", ntiles, ntiles - nmissing, ncomputed, niter);
+  printf("Load %f s, compute %f s, shade %f s, total %f s\n", tload, tcompute, elapsed - tload - tcompute, elapsed);
+
+  free(tiles);
+  free(missing);
+  free(bitmap);
+  return EXIT_SUCCESS;
+}
+
+// vim: set nofoldenable :
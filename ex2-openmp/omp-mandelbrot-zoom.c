@@ -0,0 +1,471 @@
+/* */
+/****************************************************************************
+ *
+ * omp-mandelbrot-zoom.c - Deep zoom into the Mandelbrot set with OpenMP
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * With plain float (or double) arithmetic the pixels of a view become
+ * indistinguishable once the view is smaller than ~1e-6 (~1e-14)
+ * times the whole set. This program uses perturbation theory: the
+ * orbit Z_n of one reference point C (the center of the view) is
+ * computed with double-double arithmetic (~32 significant digits);
+ * for every other pixel c = C + dc the difference d_n = z_n - Z_n
+ * obeys the recurrence
+ *
+ * d_0 = 0
+ * d_{n+1} = 2 Z_n d_n + d_n^2 + dc
+ *
+ * which only involves small quantities, and can therefore be computed
+ * in double precision.
+ *
+ * - Series approximation: d_n is approximated by the truncated series
+ *   A_n dc + B_n dc^2 + C_n dc^3, whose coefficients are computed
+ *   once along the reference orbit. All pixels start from iteration
+ *   |skip|, the last iteration at which the series agrees with the
+ *   true perturbation computed at a few probe points on the border
+ *   of the view.
+ *
+ * - Rebasing: when |Z_n + d_n| < |d_n|, or when the end of the
+ *   reference orbit is reached, the pixel switches back to the start
+ *   of the reference orbit (d := Z_n + d_n, n := 0). This avoids the
+ *   loss of precision ("glitches") that occurs when the pixel orbit
+ *   gets close to zero.
+ *
+ * - Glitch detection: with rebasing disabled (-r), pixels that
+ *   satisfy |Z_n + d_n|^2 < 1e-6 |Z_n|^2 (Pauldelbrot's criterion), or
+ *   that outlive the reference orbit, are marked as glitched; they
+ *   are recomputed in further passes using one of them as a new
+ *   reference point.
+ *
+ * Rows of the image are distributed among OpenMP threads.
+ *
+ * Compile with:
+ * gcc -fopenmp -std=c99 -Wall -Wpedantic -O2 omp-mandelbrot-zoom.c -lm -o omp-mandelbrot-zoom
+ *
+ * Run with:
+ * ./omp-mandelbrot-zoom [-x re] [-y im] [-z zoom] [-i maxit] [-s ysize] [-r] [-n]
+ *
+ * where (re, im) is the center of the view (given as decimal strings,
+ * so that they can have more digits than a double), |zoom| is the
+ * magnification (the view spans 2/zoom vertically), |maxit| is the
+ * maximum number of iterations, |ysize| is the height of the image in
+ * pixels; -r disables rebasing, -n disables the series
+ * approximation. Example:
+ *
+ * OMP_NUM_THREADS=4 ./omp-mandelbrot-zoom -x -0.743643887037158704752191506114774 -y 0.131825904205311970493132056385139 -z 1e20 -i 20000
+ *
+ * The image is written to "mandelbrot-zoom.ppm".
+ *
+ ****************************************************************************/
+
+/* The following #define is required by getopt() */
+#define _XOPEN_SOURCE 600
+
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>  /* for getopt() */
+#include <math.h>    /* for fma() */
+#include <complex.h>
+
+/****************************************************************************
+ * Double-double arithmetic: a number is represented as the unevaluated
+ * sum hi + lo of two doubles, with |lo| <= ulp(hi)/2.
+ ****************************************************************************/
+typedef struct {
+  double hi;
+  double lo;
+} dd_t;
+
+dd_t dd_from_double( double a )
+{
+  dd_t r = {a, 0.0};
+  return r;
+}
+
+/* Error-free sum of two doubles */
+dd_t two_sum( double a, double b )
+{
+  dd_t r;
+  const double s = a + b;
+  const double bb = s - a;
+  r.hi = s;
+  r.lo = (a - (s - bb)) + (b - bb);
+  return r;
+}
+
+/* Same as two_sum(), assuming |a| >= |b| */
+dd_t quick_two_sum( double a, double b )
+{
+  dd_t r;
+  const double s = a + b;
+  r.hi = s;
+  r.lo = b - (s - a);
+  return r;
+}
+
+dd_t dd_add( dd_t a, dd_t b )
+{
+  dd_t s = two_sum(a.hi, b.hi);
+  const dd_t t = two_sum(a.lo, b.lo);
+  s.lo += t.hi;
+  s = quick_two_sum(s.hi, s.lo);
+  s.lo += t.lo;
+  return quick_two_sum(s.hi, s.lo);
+}
+
+dd_t dd_neg( dd_t a )
+{
+  a.hi = -a.hi;
+  a.lo = -a.lo;
+  return a;
+}
+
+dd_t dd_mul( dd_t a, dd_t b )
+{
+  const double p = a.hi * b.hi;
+  const double e = fma(a.hi, b.hi, -p); /* exact error of the product */
+  return quick_two_sum(p, e + (a.hi * b.lo + a.lo * b.hi));
+}
+
+dd_t dd_mul_d( dd_t a, double b )
+{
+  const double p = a.hi * b;
+  const double e = fma(a.hi, b, -p);
+  return quick_two_sum(p, e + a.lo * b);
+}
+
+dd_t dd_div_d( dd_t a, double b )
+{
+  const double q1 = a.hi / b;
+  /* r = a - q1*b */
+  const dd_t r = dd_add(a, dd_neg(dd_mul_d(dd_from_double(q1), b)));
+  const double q2 = r.hi / b;
+  return quick_two_sum(q1, q2);
+}
+
+/* Convert the decimal string |s| (e.g., "-1.25e-3") to double-double.
+   Returns 0 if the string is not a valid number. */
+int dd_from_string( const char *s, dd_t *r )
+{
+  dd_t v = dd_from_double(0.0);
+  int neg = 0, ndigits = 0, frac_digits = 0, in_frac = 0, e = 0;
+
+  if ( *s == '-' || *s == '+' ) {
+    neg = (*s == '-');
+    s++;
+  }
+  for ( ; *s; s++ ) {
+    if ( *s >= '0' && *s <= '9' ) {
+      v = dd_add(dd_mul_d(v, 10.0), dd_from_double(*s - '0'));
+      ndigits++;
+      frac_digits += in_frac;
+    } else if ( *s == '.' && !in_frac ) {
+      in_frac = 1;
+    } else {
+      break;
+    }
+  }
+  if ( *s == 'e' || *s == 'E' ) {
+    char *end;
+    e = strtol(s+1, &end, 10);
+    s = end;
+  }
+  if ( *s != '\0' || ndigits == 0 ) {
+    return 0;
+  }
+  e -= frac_digits;
+  for ( ; e > 0; e-- ) {
+    v = dd_mul_d(v, 10.0);
+  }
+  for ( ; e < 0; e++ ) {
+    v = dd_div_d(v, 10.0);
+  }
+  *r = (neg ? dd_neg(v) : v);
+  return 1;
+}
+
+/****************************************************************************
+ * Reference orbit and series approximation
+ ****************************************************************************/
+
+/* Number of probe points used to validate the series approximation */
+#define NPROBES 8
+
+typedef struct {
+  dd_t cre, cim;         /* reference point */
+  double complex *Z;     /* Z[0..len-1] reference orbit, rounded to double */
+  int len;               /* number of valid elements of Z[] */
+  int skip;              /* number of iterations skipped by the series approximation */
+  double complex A, B, C; /* series coefficients at iteration |skip| */
+} ref_t;
+
+/* Compute the orbit of the reference point (|cre|, |cim|) with
+   double-double arithmetic, for at most |maxit| iterations or until
+   it escapes. Z[] must have room for |maxit|+1 elements. */
+void reference_orbit( ref_t *ref, dd_t cre, dd_t cim, int maxit )
+{
+  dd_t x = dd_from_double(0.0), y = dd_from_double(0.0);
+  int n;
+
+  ref->cre = cre;
+  ref->cim = cim;
+  for (n=0; n<=maxit; n++) {
+    ref->Z[n] = x.hi + I*y.hi;
+    if ( x.hi*x.hi + y.hi*y.hi > 4.0 ) {
+      n++;
+      break;
+    }
+    const dd_t x2 = dd_mul(x, x);
+    const dd_t y2 = dd_mul(y, y);
+    const dd_t xy = dd_mul(x, y);
+    x = dd_add(dd_add(x2, dd_neg(y2)), cre);
+    y = dd_add(dd_mul_d(xy, 2.0), cim);
+  }
+  ref->len = n;
+  ref->skip = 0;
+  ref->A = ref->B = ref->C = 0.0;
+}
+
+/* Compute the series approximation coefficients along the reference
+   orbit, and set ref->skip to the last iteration at which the series
+   evaluated at the |nprobes| offsets |probe[]| is within relative
+   tolerance |tol| of the perturbation computed directly. */
+void series_approximation( ref_t *ref, const double complex *probe, int nprobes, double tol )
+{
+  double complex A = 0.0, B = 0.0, C = 0.0, d[NPROBES];
+  int n, p;
+
+  for (p=0; p<nprobes; p++) {
+    d[p] = 0.0;
+  }
+  /* the last reference value is needed by the perturbation loop, so
+     at most len-2 iterations can be skipped */
+  for (n=0; n+2<ref->len; n++) {
+    const double complex Z = ref->Z[n];
+    const double complex An = 2.0*Z*A + 1.0;
+    const double complex Bn = 2.0*Z*B + A*A;
+    const double complex Cn = 2.0*Z*C + 2.0*A*B;
+    int ok = 1;
+    for (p=0; p<nprobes && ok; p++) {
+      const double complex dc = probe[p];
+      d[p] = (2.0*Z + d[p])*d[p] + dc;
+      const double complex s = ((Cn*dc + Bn)*dc + An)*dc;
+      const double complex z = ref->Z[n+1] + d[p];
+      ok = (cabs(s - d[p]) <= tol * cabs(d[p])) && (creal(z)*creal(z) + cimag(z)*cimag(z) <= 4.0);
+    }
+    if ( !ok ) {
+      break;
+    }
+    A = An;
+    B = Bn;
+    C = Cn;
+    ref->skip = n+1;
+    ref->A = A;
+    ref->B = B;
+    ref->C = C;
+  }
+}
+
+/****************************************************************************
+ * Rendering
+ ****************************************************************************/
+
+typedef struct {
+  uint8_t r;  /* red   */
+  uint8_t g;  /* green */
+  uint8_t b;  /* blue  */
+} pixel_t;
+
+/* The palette of mpi-mandelbrot.c is the linear gradient produced by
+   mandelcolor.c; it is computed here instead of being tabulated */
+const int NCOLORS = 100;
+
+void set_color( pixel_t *p, int v, int maxit )
+{
+  if ( v < maxit ) {
+    const float n = (v % NCOLORS) / (float)(NCOLORS-1);
+    p->r = (unsigned char)(0x22 * (1.0f-n) + (float)0xca * n);
+    p->g = (unsigned char)(0xce * (1.0f-n) + (float)0xac * n);
+    p->b = (unsigned char)(0x5a * (1.0f-n) + (float)0x0c * n);
+  } else {
+    p->r = p->g = p->b = 0;
+  }
+}
+
+/* Value returned by perturb() for glitched pixels */
+#define GLITCH (-1)
+
+/* Iterate the pixel at offset |dc| from the reference point, using
+   perturbation. Returns the escape iteration (as the scalar
+   iterate() would), or GLITCH. |*nrebase| is incremented by the
+   number of times the pixel has been rebased. */
+int perturb( const ref_t *ref, double complex dc, int maxit, int rebase, int *nrebase )
+{
+  const double complex *Z = ref->Z;
+  double complex d = ((ref->C*dc + ref->B)*dc + ref->A)*dc;
+  int k = ref->skip, n = ref->skip;
+
+  while ( k < maxit ) {
+    const double complex z = Z[n] + d;
+    const double zz = creal(z)*creal(z) + cimag(z)*cimag(z);
+    if ( zz > 4.0 ) {
+      break;
+    }
+    if ( rebase ) {
+      const double dd = creal(d)*creal(d) + cimag(d)*cimag(d);
+      if ( zz < dd || n+1 >= ref->len ) {
+        d = z;
+        n = 0;
+        (*nrebase)++;
+      }
+    } else {
+      const double ZZ = creal(Z[n])*creal(Z[n]) + cimag(Z[n])*cimag(Z[n]);
+      if ( zz < 1.0e-6 * ZZ || n+1 >= ref->len ) {
+        return GLITCH;
+      }
+    }
+    d = (2.0*Z[n] + d)*d + dc;
+    n++;
+    k++;
+  }
+  return k;
+}
+
+int main( int argc, char *argv[] )
+{
+  const char *fname = "mandelbrot-zoom.ppm";
+  const char *sre = "-0.75", *sim = "0";
+  double zoom = 1.0;
+  int ysize = 1024, maxit = 1000, rebase = 1, series = 1, opt;
+  dd_t cre, cim;
+  ref_t ref;
+  FILE *out;
+
+  while ( (opt = getopt(argc, argv, "x:y:z:i:s:rn")) != -1 ) {
+    switch (opt) {
+    case 'x': sre = optarg; break;
+    case 'y': sim = optarg; break;
+    case 'z': zoom = atof(optarg); break;
+    case 'i': maxit = atoi(optarg); break;
+    case 's': ysize = atoi(optarg); break;
+    case 'r': rebase = 0; break;
+    case 'n': series = 0; break;
+    default:
+      fprintf(stderr, "Usage: %s [-x re] [-y im] [-z zoom] [-i maxit] [-s ysize] [-r] [-n]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if ( !dd_from_string(sre, &cre) || !dd_from_string(sim, &cim) ) {
+    fprintf(stderr, "FATAL: invalid center %s %s\n", sre, sim);
+    return EXIT_FAILURE;
+  }
+  if ( zoom <= 0.0 || maxit < 1 || ysize < 2 ) {
+    fprintf(stderr, "FATAL: invalid parameters\n");
+    return EXIT_FAILURE;
+  }
+
+  const int xsize = ysize * 1.777777778;
+  const double pix = 2.0 / (zoom * (ysize - 1)); /* size of a pixel */
+  int *it = (int*)malloc((size_t)xsize * ysize * sizeof(*it));
+  pixel_t *bitmap = (pixel_t*)malloc((size_t)xsize * ysize * sizeof(*bitmap));
+  long nrebase = 0, nglitch = 0;
+  int x, y, pass;
+
+  ref.Z = (double complex*)malloc((maxit + 1) * sizeof(*ref.Z));
+
+  printf("Center %s %s, zoom %g, %d x %d pixels, maxit=%d\n", sre, sim, zoom, xsize, ysize, maxit);
+
+  const double tstart = omp_get_wtime();
+
+  reference_orbit(&ref, cre, cim, maxit);
+  if ( series ) {
+    /* probes on the corners and on the midpoints of the sides */
+    const double hx = pix * (xsize - 1) / 2.0, hy = pix * (ysize - 1) / 2.0;
+    const double complex probe[NPROBES] = {
+      -hx - I*hy, hx - I*hy, -hx + I*hy, hx + I*hy,
+      -hx, hx, -I*hy, I*hy };
+    series_approximation(&ref, probe, NPROBES, 1.0e-12);
+  }
+  printf("Reference orbit: %d iterations, series approximation skips %d\n", ref.len - 1, ref.skip);
+
+#pragma omp parallel for schedule(dynamic) default(none) shared(ref, it, xsize, ysize, pix, maxit, rebase) private(x) reduction(+:nrebase, nglitch)
+  for (y=0; y<ysize; y++) {
+    int nr = 0;
+    for (x=0; x<xsize; x++) {
+      const double complex dc = pix * (x - (xsize - 1) / 2.0) + I * pix * ((ysize - 1) / 2.0 - y);
+      const int v = perturb(&ref, dc, maxit, rebase, &nr);
+      it[(size_t)y * xsize + x] = v;
+      nglitch += (v == GLITCH);
+    }
+    nrebase += nr;
+  }
+
+  /* Without rebasing, glitched pixels are recomputed using the first
+     glitched pixel as the new reference point. */
+  for (pass = 0; pass < 10 && nglitch > 0; pass++) {
+    size_t g;
+    double complex dref;
+    for (g=0; it[g] != GLITCH; g++)
+      ;
+    x = g % xsize;
+    y = g / xsize;
+    dref = pix * (x - (xsize - 1) / 2.0) + I * pix * ((ysize - 1) / 2.0 - y);
+    reference_orbit(&ref, dd_add(cre, dd_from_double(creal(dref))), dd_add(cim, dd_from_double(cimag(dref))), maxit);
+    printf("Pass %d: %ld glitched pixels, new reference at (%d, %d)\n", pass+1, nglitch, x, y);
+    nglitch = 0;
+#pragma omp parallel for schedule(dynamic) default(none) shared(ref, it, xsize, ysize, pix, maxit, dref) private(x) reduction(+:nglitch)
+    for (y=0; y<ysize; y++) {
+      int nr = 0;
+      for (x=0; x<xsize; x++) {
+        int *v = it + (size_t)y * xsize + x;
+        if ( *v == GLITCH ) {
+          const double complex dc = pix * (x - (xsize - 1) / 2.0) + I * pix * ((ysize - 1) / 2.0 - y) - dref;
+          *v = perturb(&ref, dc, maxit, 0, &nr);
+          nglitch += (*v == GLITCH);
+        }
+      }
+    }
+  }
+
+  const double elapsed = omp_get_wtime() - tstart;
+
+  for (y=0; y<ysize; y++) {
+    for (x=0; x<xsize; x++) {
+      const size_t i = (size_t)y * xsize + x;
+      set_color(&bitmap[i], (it[i] == GLITCH ? maxit : it[i]), maxit);
+    }
+  }
+
+  out = fopen(fname, "w");
+  if ( !out ) {
+    fprintf(stderr, "FATAL: cannot create %s\n", fname);
+    return EXIT_FAILURE;
+  }
+  fprintf(out, "P6\n");
+  fprintf(out, "%d %d\n", xsize, ysize);
+  fprintf(out, "255\n");
+  fwrite(bitmap, sizeof(*bitmap), (size_t)xsize * ysize, out);
+  fclose(out);
+
+  printf("Rebased %ld times, %ld glitched pixels left\n", nrebase, nglitch);
+  printf("Elapsed time: %f\n", elapsed);
+
+  free(ref.Z);
+  free(it);
+  free(bitmap);
+  return EXIT_SUCCESS;
+}
+
+// vim: set nofoldenable :
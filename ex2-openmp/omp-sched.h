@@ -0,0 +1,293 @@
+/* */
+/****************************************************************************
+ *
+ * omp-sched.h - Loop schedulers with per-thread cost accounting
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * This header distributes the iterations 0, ... n-1 of a loop among
+ * the threads of a parallel region, with one of the following
+ * policies:
+ *
+ * static   chunks of |chunk| iterations are assigned round-robin to
+ *          the threads; with chunk 0 (default) each thread gets one
+ *          contiguous block, as with schedule(static)
+ * dynamic  each thread takes the next |chunk| iterations (default 1)
+ *          from a shared counter, that is incremented with an atomic
+ *          fetch-and-add (no critical section)
+ * guided   as dynamic, but each thread takes 1/(2P) of the remaining
+ *          iterations, P being the number of threads, and at least
+ *          |chunk|
+ * steal    each thread initially owns a contiguous block, from which
+ *          it takes |chunk| iterations at a time (default 1); a
+ *          thread whose block is exhausted steals the upper half of
+ *          the iterations left in the block of another thread. Each
+ *          block is protected by its own lock, so threads only
+ *          contend when stealing.
+ *
+ * The loop is written as
+ *
+ *   sched_t sched;
+ *   sched_init(&sched, SCHED_DYNAMIC, n, 1);
+ *   #pragma omp parallel
+ *   {
+ *     long i;
+ *     SCHED_FOR(&sched, i) {
+ *       ... body ...
+ *     }
+ *   }
+ *   sched_report(&sched, stdout);
+ *   sched_free(&sched);
+ *
+ * The body must not use "break". All the threads of the team must
+ * execute SCHED_FOR; there is no barrier at the end of the loop. For
+ * each thread the scheduler records the number of iterations and
+ * chunks executed, the time spent executing chunks (busy time), the
+ * longest chunk, the time spent in the scheduler itself, and the idle
+ * time, i.e., the time from when the thread finds no more work to
+ * when the last thread does; sched_report() prints them. The policy
+ * can be selected at run time with sched_parse(), e.g., from an
+ * environment variable, using the syntax of OMP_SCHEDULE
+ * ("dynamic,4").
+ *
+ * This file is used by omp-mandelbrot-area.c and omp-dynamic.c.
+ *
+ ****************************************************************************/
+
+#ifndef OMP_SCHED_H
+#define OMP_SCHED_H
+
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum { SCHED_STATIC, SCHED_DYNAMIC, SCHED_GUIDED, SCHED_STEAL } sched_kind_t;
+
+const char *sched_names[] = { "static", "dynamic", "guided", "steal" };
+
+/* Per-thread state; the padding keeps the state of different threads
+   on different cache lines */
+typedef struct {
+  long next;           /* static: index of the next chunk */
+  long begin, end;     /* steal: iterations still owned by the thread */
+  omp_lock_t lock;     /* steal: protects begin, end */
+  long niter;          /* iterations executed */
+  long nchunks;        /* chunks executed */
+  long nsteals;        /* successful steals */
+  double busy;         /* time spent executing chunks */
+  double maxchunk;     /* time spent executing the longest chunk */
+  double tfirst;       /* first call of sched_next() */
+  double tlast;        /* when the current chunk was handed out */
+  double tdone;        /* when the thread found no more work */
+  char pad[64];
+} sched_thread_t;
+
+typedef struct {
+  sched_kind_t kind;
+  long n;              /* the loop index goes from 0 to n-1 */
+  long chunk;
+  long next;           /* dynamic, guided: first iteration not handed out yet */
+  int nthreads;        /* size of th[] */
+  sched_thread_t *th;
+} sched_t;
+
+/* Prepare |s| to distribute |n| iterations with policy |kind| and
+   chunk size |chunk| (0 = default of the policy) among at most
+   omp_get_max_threads() threads. A schedule can only be used for one
+   loop; call sched_init() again for the next one. */
+void sched_init( sched_t *s, sched_kind_t kind, long n, long chunk )
+{
+  int t;
+
+  s->kind = kind;
+  s->n = n;
+  s->chunk = (chunk > 0 || SCHED_STATIC == kind ? chunk : 1);
+  s->next = 0;
+  s->nthreads = omp_get_max_threads();
+  s->th = (sched_thread_t*)calloc(s->nthreads, sizeof(*s->th));
+  for (t=0; t<s->nthreads; t++) {
+    s->th[t].begin = n * t / s->nthreads;
+    s->th[t].end = n * (t + 1) / s->nthreads;
+    omp_init_lock(&s->th[t].lock);
+  }
+}
+
+void sched_free( sched_t *s )
+{
+  int t;
+  for (t=0; t<s->nthreads; t++) {
+    omp_destroy_lock(&s->th[t].lock);
+  }
+  free(s->th);
+  s->th = NULL;
+}
+
+/* Parse a policy written as "kind[,chunk]"; returns 0 on success,
+   nonzero if |str| is not valid */
+int sched_parse( const char *str, sched_kind_t *kind, long *chunk )
+{
+  int k;
+  for (k=0; k<4; k++) {
+    const size_t len = strlen(sched_names[k]);
+    if ( 0 == strncmp(str, sched_names[k], len) && (str[len] == '\0' || str[len] == ',') ) {
+      *kind = (sched_kind_t)k;
+      *chunk = (str[len] == ',' ? atol(str + len + 1) : 0);
+      return (*chunk < 0);
+    }
+  }
+  return 1;
+}
+
+/* Steal policy: take the next chunk of the block of the calling
+   thread |me|, or steal half of the block of another thread */
+int sched_next_steal( sched_t *s, int me, long *b, long *e )
+{
+  sched_thread_t *t = &s->th[me];
+  int got = 0, k;
+
+  omp_set_lock(&t->lock);
+  if ( t->begin < t->end ) {
+    *b = t->begin;
+    *e = (t->end - *b > s->chunk ? *b + s->chunk : t->end);
+    t->begin = *e;
+    got = 1;
+  }
+  omp_unset_lock(&t->lock);
+
+  for (k=1; k<s->nthreads && !got; k++) {
+    sched_thread_t *v = &s->th[(me + k) % s->nthreads];
+    long sb = 0, se = 0;
+    omp_set_lock(&v->lock);
+    if ( v->begin < v->end ) {
+      sb = v->end - (v->end - v->begin + 1)/2;
+      se = v->end;
+      v->end = sb;
+      got = 1;
+    }
+    omp_unset_lock(&v->lock);
+    if ( got ) {
+      /* run the first chunk, keep the rest in our own block, where
+         other threads can steal it */
+      *b = sb;
+      *e = (se - sb > s->chunk ? sb + s->chunk : se);
+      omp_set_lock(&t->lock);
+      t->begin = *e;
+      t->end = se;
+      omp_unset_lock(&t->lock);
+      t->nsteals++;
+    }
+  }
+  return got;
+}
+
+/* Get the next chunk [*b, *e) of iterations of the calling thread;
+   returns 0 if there are no more iterations. This function is used
+   by SCHED_FOR. */
+int sched_next( sched_t *s, long *b, long *e )
+{
+  const int me = omp_get_thread_num();
+  sched_thread_t *t = &s->th[me];
+  const double now = omp_get_wtime();
+  long first = s->n, size;
+  int got;
+
+  if ( t->tlast > 0.0 ) {
+    const double cost = now - t->tlast;
+    t->busy += cost;
+    t->maxchunk = (cost > t->maxchunk ? cost : t->maxchunk);
+  } else {
+    t->tfirst = now;
+  }
+
+  switch (s->kind) {
+  case SCHED_STATIC:
+    if ( 0 == s->chunk ) {
+      const int p = omp_get_num_threads();
+      first = (0 == t->next ? s->n * me / p : s->n);
+      *e = s->n * (me + 1) / p;
+    } else {
+      first = (t->next * omp_get_num_threads() + me) * s->chunk;
+      *e = first + s->chunk;
+    }
+    t->next++;
+    got = (first < s->n && first < *e);
+    break;
+  case SCHED_DYNAMIC:
+#pragma omp atomic capture
+    { first = s->next; s->next += s->chunk; }
+    *e = first + s->chunk;
+    got = (first < s->n);
+    break;
+  case SCHED_GUIDED:
+    /* the chunk size is computed from a value of the counter that
+       may be stale, which only makes the chunk slightly larger */
+#pragma omp atomic read
+    first = s->next;
+    size = (s->n - first) / (2 * omp_get_num_threads());
+    size = (size > s->chunk ? size : s->chunk);
+#pragma omp atomic capture
+    { first = s->next; s->next += size; }
+    *e = first + size;
+    got = (first < s->n);
+    break;
+  default: /* SCHED_STEAL */
+    got = sched_next_steal(s, me, &first, e);
+  }
+
+  if ( got ) {
+    *b = first;
+    *e = (*e < s->n ? *e : s->n);
+    t->niter += *e - *b;
+    t->nchunks++;
+    t->tlast = omp_get_wtime();
+  } else {
+    t->tlast = 0.0;
+    t->tdone = omp_get_wtime();
+  }
+  return got;
+}
+
+/* Execute the following statement with |i| set to each iteration of
+   the calling thread (see the top of this file) */
+#define SCHED_FOR(s, i) \
+  for (long sched_b_, sched_e_; sched_next((s), &sched_b_, &sched_e_); ) \
+    for ((i) = sched_b_; (i) < sched_e_; (i)++)
+
+/* Print the statistics of each thread that took part in the loop,
+   and the imbalance ratio (maximum over average busy time) */
+void sched_report( const sched_t *s, FILE *f )
+{
+  double tend = 0.0, max_busy = 0.0, sum_busy = 0.0;
+  int t, nactive = 0;
+
+  for (t=0; t<s->nthreads; t++) {
+    tend = (s->th[t].tdone > tend ? s->th[t].tdone : tend);
+  }
+  fprintf(f, "Schedule %s, chunk %ld\n", sched_names[s->kind], s->chunk);
+  fprintf(f, "thread   iterations   chunks   steals    busy (s)  max chunk (s)   sched (s)    idle (s)\n");
+  for (t=0; t<s->nthreads; t++) {
+    const sched_thread_t *th = &s->th[t];
+    if ( th->tdone == 0.0 ) {
+      continue; /* not part of the team */
+    }
+    fprintf(f, "%6d %12ld %8ld %8ld %11.6f %14.6f %11.6f %11.6f\n", t, th->niter, th->nchunks, th->nsteals,
+            th->busy, th->maxchunk, th->tdone - th->tfirst - th->busy, tend - th->tdone);
+    max_busy = (th->busy > max_busy ? th->busy : max_busy);
+    sum_busy += th->busy;
+    nactive++;
+  }
+  if ( sum_busy > 0.0 ) {
+    fprintf(f, "Imbalance (max/avg busy time): %f\n", max_busy / (sum_busy / nactive));
+  }
+}
+
+#endif
@@ -20,7 +20,7 @@
  * without shared memory.
  *
  * Compile with:
- * nvcc cuda-anneal.cu -o cuda-anneal
+ * nvcc cuda-anneal.cu -o cuda-anneal -lpthread
  *
  * Run with:
  * ./cuda-anneal [steps [n]]
@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include "pbm-writer.h"
 
 #define BLKDIM_COPY 1024
 #define BLKDIM      32
@@ -164,25 +165,23 @@ void init( cell_t *cur, int ext_n, float p )
   }
 }
 
-/* Write |cur| to file |fname| in pbm (portable bitmap) format. */
+/* Write |cur| to file |fname| in binary pbm (portable bitmap)
+   format. */
 void write_pbm( cell_t *cur, int ext_n, const char* fname )
 {
-  int i, j;
-  FILE *f = fopen(fname, "w");
-  if (!f) { 
+  int i;
+  pbm_writer_t *w = pbm_open(fname, ext_n-2, ext_n-2, 1, "produced by cuda-anneal.cu");
+  if (!w) { 
     fprintf(stderr, "Cannot open %s for writing\n", fname);
     exit(EXIT_FAILURE);
   }
-  fprintf(f, "P1\n");
-  fprintf(f, "# produced by cuda-anneal.cu\n");
-  fprintf(f, "%d %d\n", ext_n-2, ext_n-2);
   for (i=1; i<ext_n-1; i++) {
-    for (j=1; j<ext_n-1; j++) {
-      fprintf(f, "%d ", *IDX(cur, ext_n, i, j));
-    }
-    fprintf(f, "\n");
+    pbm_put_row(w, IDX(cur, ext_n, i, 1));
+  }
+  if ( pbm_close(w) != 0 ) {
+    fprintf(stderr, "Error writing %s\n", fname);
+    exit(EXIT_FAILURE);
   }
-  fclose(f);
 }
 
 int main( int argc, char* argv[] )
@@ -16,14 +16,20 @@
  * --------------------------------------------------------------------------
  *
  * Compile with:
- * gcc -ansi -Wall -Wpedantic circles-gen.c -o circles-gen
+ * gcc -std=c99 -Wall -Wpedantic circles-gen.c -o circles-gen
  *
- * To generate 1000 random rectangles, run:
+ * To generate 1000 random circles, run:
  * ./circles-gen 1000 > circles-1000.in
  *
+ * With -b the circles are written in the binary columnar format of
+ * colfile.h (fields x, y, r), that mpi-circles reads with MPI-IO:
+ * ./circles-gen -b 1000000 > circles-1000000.bin
+ *
  ****************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "colfile.h"
 
 float randab(float a, float b)
 {
@@ -32,18 +38,41 @@ float randab(float a, float b)
 
 int main( int argc, char* argv[] )
 {
-    int i, n;
-    if ( argc != 2 ) {
-        fprintf(stderr, "Usage: %s n\n", argv[0]);
+    int i, n, binary;
+    float *cols[3];
+    binary = ( argc == 3 && 0 == strcmp(argv[1], "-b") );
+    if ( argc != 2 + binary ) {
+        fprintf(stderr, "Usage: %s [-b] n\n", argv[0]);
         return EXIT_FAILURE;
     }
-    n = atoi( argv[1] );
-    printf("%d\n", n);
+    n = atoi( argv[1 + binary] );
+    if ( binary ) {
+        for (i=0; i<3; i++) {
+            cols[i] = (float*)malloc(n * sizeof(float));
+        }
+    } else {
+        printf("%d\n", n);
+    }
     for (i=0; i<n; i++) {
         float x = randab(10, 990);
         float y = randab(10, 990);
         float r = randab(1, 10);
-        printf("%f %f %f\n", x, y, r);
+        if ( binary ) {
+            cols[0][i] = x;
+            cols[1][i] = y;
+            cols[2][i] = r;
+        } else {
+            printf("%f %f %f\n", x, y, r);
+        }
+    }
+    if ( binary ) {
+        if ( colfile_write(stdout, 3, n, cols) ) {
+            fprintf(stderr, "Write error\n");
+            return EXIT_FAILURE;
+        }
+        for (i=0; i<3; i++) {
+            free(cols[i]);
+        }
     }
     return EXIT_SUCCESS;
 }
@@ -16,107 +16,615 @@
  *
  * --------------------------------------------------------------------------
  *
+ * The program estimates the area of the union of the circles read
+ * from the input file by sampling points in the square (0,0) --
+ * (1000,1000) that contains them (see circles-gen.c). The points are
+ * produced by one of the estimators of qmc.h (-e, default mc), in
+ * |nrep| independent replicates (-r, default 16), from which the
+ * statistical error is computed; with the low-discrepancy sequences
+ * (halton, sobol) the same accuracy is reached with far fewer points.
+ * Each process handles a contiguous range of the points; the result
+ * depends only on npoints, the method and the seed (-s), not on the
+ * number of processes.
+ *
+ * Testing every point against every circle takes time proportional to
+ * npoints * N (option -b). Instead, each process builds a uniform grid
+ * over the square, and lists in each cell the circles whose bounding
+ * box overlaps it; a point is only tested against the circles of its
+ * cell. The count is the same as with -b, since the same test is
+ * applied to every circle that may contain the point. With -c the
+ * points are generated in chunks and sorted by cell before being
+ * tested, so that consecutive points use the same circles; this helps
+ * when the circles do not fit in the cache.
+ *
+ * With -x the program also computes the exact area of the union (up
+ * to rounding errors), and compares the estimate with it. By Green's
+ * theorem the area is the integral of (x dy - y dx)/2 along the border
+ * of the union, i.e., along the arcs of the circles that are not
+ * covered by other circles; for each circle, the covered arcs are
+ * computed from the circles that intersect it, found with a grid of
+ * the centers. The circles are divided among the MPI processes, and
+ * among the OpenMP threads of each process.
+ *
  * Compile with:
- * mpicc -std=c99 -Wall -Wpedantic mpi-circles.c -o mpi-circles
+ * mpicc -std=c99 -Wall -Wpedantic -O2 -fopenmp mpi-circles.c -lm -o mpi-circles
  *
  * Run with:
- * mpirun -n 4 ./mpi-circles 10000 circles-1000.in
+ * mpirun -n 4 ./mpi-circles [-e mc|strat|anti|halton|sobol] [-r nrep] [-s seed] [-b | -c] [-x] npoints inputfile
+ *
+ * Example:
+ * mpirun -n 4 ./mpi-circles -e sobol 100000 circles-1000.in
+ * mpirun -n 4 ./mpi-circles -x -e sobol 100000 circles-10000.in
+ *
+ * Larger inputs can be produced with circles-gen, e.g.:
+ * ./circles-gen 1000000 > circles-1000000.in
+ *
+ * The input file is either a text file (the number N of circles, then
+ * one circle x y r per line), that is read by the master and broadcast
+ * to the other processes, or a binary columnar file (see colfile.h)
+ * produced by "circles-gen -b"; in this case each process reads a
+ * slice of the circles with MPI-IO, and the slices are then exchanged
+ * with MPI_Allgatherv(), since every process needs all the circles.
  *
  ****************************************************************************/
 
+/* The following #define is required by getopt() */
+#define _XOPEN_SOURCE 600
+
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h> /* for time() */
+#include <inttypes.h> /* for PRIu64 */
+#include <unistd.h>   /* for getopt() */
+#include "qmc.h"
+#include "colfile.h"
+
+/* Side of the sampling square */
+const float SIDE = 1000.0;
+
+/* Maximum number of cells per side of the grid */
+const int MAX_GRID = 1024;
+
+typedef struct {
+  int g;        /* the grid has g x g cells */
+  float cell;   /* side of a cell */
+  int *first;   /* the circles overlapping cell c are idx[first[c]], ... idx[first[c+1]-1] */
+  int *idx;
+} grid_t;
 
 float sq(float x)
 {
   return x*x;
 }
 
-/* Generate |k| random points inside the square (0,0) --
-   (100,100). Return the number of points that fall inside at least one
-   of the |n| circles with center (x[i], y[i]) and radius r[i].  The
-   result must be <= |k|. */
-int inside( const float* x, const float* y, const float *r, int n, int k )
+/* Generate the points [start, end) of |q| inside the square (0,0) --
+   (SIDE,SIDE), and count those that fall inside at least one of the
+   |n| circles with center (x[i], y[i]) and radius r[i]; hits[rep] is
+   incremented by the count of replicate rep. Every point is tested
+   against all the circles. */
+void inside( const float* x, const float* y, const float *r, int n,
+             const qmc_t *q, uint64_t start, uint64_t end, uint64_t *hits )
 {
-  int i, np, c=0;
-  for (np=0; np<k; np++) {
-    const float px = 100.0*rand()/(float)RAND_MAX;
-    const float py = 100.0*rand()/(float)RAND_MAX;
+  uint64_t np;
+  qmc_iter_t it;
+  int i;
+
+  qmc_seek(q, &it, start);
+  for (np=start; np<end; np++) {
+    double u, v;
+    const int rep = qmc_next(&it, &u, &v);
+    const float px = SIDE * u;
+    const float py = SIDE * v;
     for (i=0; i<n; i++) {
       if ( sq(px-x[i]) + sq(py-y[i]) <= sq(r[i]) ) {
-        c++;
+        hits[rep]++;
         break;
       }
     }
   }
-  return c;
+}
+
+/* Index of the column (or row) of the grid that contains coordinate
+   |v|; values outside the square are clamped to the border cells */
+int grid_coord( const grid_t *grid, float v )
+{
+  const int c = (int)(v / grid->cell);
+  return (c < 0 ? 0 : (c >= grid->g ? grid->g - 1 : c));
+}
+
+/* List the |n| circles in the cells of |grid|, whose size must be set:
+   circle i goes in all the cells overlapped by its bounding box,
+   enlarged by |pad|, or only in the cell of its center if r is NULL */
+void grid_fill( grid_t *grid, const float* x, const float* y, const float *r, float pad, int n )
+{
+  const int ncells = grid->g * grid->g;
+  int i, c, cx, cy, pass;
+  int *next = (int*)malloc(ncells * sizeof(*next));
+
+  /* the first pass counts the circles of each cell, the second one
+     fills the lists */
+  grid->first = (int*)calloc(ncells + 1, sizeof(*grid->first));
+  grid->idx = NULL;
+  for (pass=0; pass<2; pass++) {
+    for (i=0; i<n; i++) {
+      const float ri = (r ? r[i] + pad : 0.0f);
+      for (cy=grid_coord(grid, y[i]-ri); cy<=grid_coord(grid, y[i]+ri); cy++) {
+        for (cx=grid_coord(grid, x[i]-ri); cx<=grid_coord(grid, x[i]+ri); cx++) {
+          if ( 0 == pass ) {
+            grid->first[cy * grid->g + cx + 1]++;
+          } else {
+            grid->idx[next[cy * grid->g + cx]++] = i;
+          }
+        }
+      }
+    }
+    if ( 0 == pass ) {
+      for (c=0; c<ncells; c++) {
+        grid->first[c+1] += grid->first[c];
+        next[c] = grid->first[c];
+      }
+      grid->idx = (int*)malloc(grid->first[ncells] * sizeof(*grid->idx));
+    }
+  }
+  free(next);
+}
+
+/* Build the grid for the |n| circles. The cell size is the larger of
+   the side that gives about one circle per cell and the average
+   radius, so that each circle overlaps a few cells. */
+void grid_init( grid_t *grid, const float* x, const float* y, const float *r, int n )
+{
+  double rsum = 0.0;
+  int i;
+
+  for (i=0; i<n; i++) {
+    rsum += r[i];
+  }
+  float cell = SIDE / sqrt(n > 0 ? n : 1);
+  if ( n > 0 && cell < rsum / n ) {
+    cell = rsum / n;
+  }
+  grid->g = (int)ceil(SIDE / cell);
+  grid->g = (grid->g < 1 ? 1 : (grid->g > MAX_GRID ? MAX_GRID : grid->g));
+  grid->cell = SIDE / grid->g;
+  /* the bounding boxes are slightly enlarged, so that rounding errors
+     in the test of a point can not make it fall in a circle that is
+     not listed in its cell */
+  grid_fill(grid, x, y, r, 1.0e-3f * grid->cell, n);
+}
+
+void grid_free( grid_t *grid )
+{
+  free(grid->first);
+  free(grid->idx);
+}
+
+/* Returns 1 iff point (px, py), that lies in cell |c|, is inside one
+   of the circles of that cell */
+int grid_test( const grid_t *grid, const float* x, const float* y, const float *r, int c, float px, float py )
+{
+  int k;
+  for (k=grid->first[c]; k<grid->first[c+1]; k++) {
+    const int i = grid->idx[k];
+    if ( sq(px-x[i]) + sq(py-y[i]) <= sq(r[i]) ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Same as inside(), using the grid */
+void inside_grid( const float* x, const float* y, const float *r, const grid_t *grid,
+                  const qmc_t *q, uint64_t start, uint64_t end, uint64_t *hits )
+{
+  uint64_t np;
+  qmc_iter_t it;
+
+  qmc_seek(q, &it, start);
+  for (np=start; np<end; np++) {
+    double u, v;
+    const int rep = qmc_next(&it, &u, &v);
+    const float px = SIDE * u;
+    const float py = SIDE * v;
+    const int c = grid_coord(grid, py) * grid->g + grid_coord(grid, px);
+    hits[rep] += grid_test(grid, x, y, r, c, px, py);
+  }
+}
+
+/* Same as inside_grid(), but the points are generated in chunks, that
+   are sorted by cell (counting sort) before being tested. Chunks have
+   at least as many points as cells, so the cost of the sort per point
+   is constant. */
+void inside_sorted( const float* x, const float* y, const float *r, const grid_t *grid,
+                    const qmc_t *q, uint64_t start, uint64_t end, uint64_t *hits )
+{
+  const int ncells = grid->g * grid->g;
+  const int chunk = (ncells > 65536 ? ncells : 65536);
+  float *px = (float*)malloc(chunk * sizeof(*px));
+  float *py = (float*)malloc(chunk * sizeof(*py));
+  int *rep = (int*)malloc(chunk * sizeof(*rep));
+  int *cell = (int*)malloc(chunk * sizeof(*cell));
+  int *order = (int*)malloc(chunk * sizeof(*order));
+  int *count = (int*)malloc((ncells + 1) * sizeof(*count));
+  uint64_t np;
+  qmc_iter_t it;
+  int i, c;
+
+  qmc_seek(q, &it, start);
+  for (np=start; np<end; np+=chunk) {
+    const int m = (end - np < (uint64_t)chunk ? (int)(end - np) : chunk);
+    for (c=0; c<=ncells; c++) {
+      count[c] = 0;
+    }
+    for (i=0; i<m; i++) {
+      double u, v;
+      rep[i] = qmc_next(&it, &u, &v);
+      px[i] = SIDE * u;
+      py[i] = SIDE * v;
+      cell[i] = grid_coord(grid, py[i]) * grid->g + grid_coord(grid, px[i]);
+      count[cell[i] + 1]++;
+    }
+    for (c=0; c<ncells; c++) {
+      count[c+1] += count[c];
+    }
+    for (i=0; i<m; i++) {
+      order[count[cell[i]]++] = i;
+    }
+    for (i=0; i<m; i++) {
+      const int k = order[i];
+      hits[rep[k]] += grid_test(grid, x, y, r, cell[k], px[k], py[k]);
+    }
+  }
+  free(px);
+  free(py);
+  free(rep);
+  free(cell);
+  free(order);
+  free(count);
+}
+
+/* An arc of a circle, from angle a to angle b (a <= b) */
+typedef struct {
+  double a, b;
+} arc_t;
+
+/* Buffers used by circle_area(), enlarged when needed */
+typedef struct {
+  int size;     /* capacity of nbrs; arcs has 2*size elements */
+  int *nbrs;    /* circles that intersect the current one */
+  arc_t *arcs;  /* covered arcs of the current circle */
+} scratch_t;
+
+int compare_arcs( const void *p, const void *q )
+{
+  const arc_t *u = (const arc_t*)p, *v = (const arc_t*)q;
+  return (u->a > v->a) - (u->a < v->a);
+}
+
+/* Contribution of circle |i| to the area of the union of the circles:
+   by Green's theorem the area is the integral of (x dy - y dx)/2 along
+   the border of the union, which is made of the arcs of each circle
+   that are not covered by any other circle. The circles that may
+   intersect circle i are found in |centers|, the grid of the centers,
+   given the maximum radius |rmax|. */
+double circle_area( const float* x, const float* y, const float *r, const grid_t *centers, float rmax,
+                    int i, scratch_t *buf )
+{
+  const double PI = 3.14159265358979323846;
+  const double xi = x[i], yi = y[i], ri = r[i];
+  int cx, cy, k, nn = 0, na = 0;
+
+  /* The first step finds the circles that intersect circle i without
+     computing any square root, and stops as soon as circle i turns
+     out to be inside another circle, which is frequent when the
+     circles are dense */
+  for (cy=grid_coord(centers, yi-ri-rmax); cy<=grid_coord(centers, yi+ri+rmax); cy++) {
+    for (cx=grid_coord(centers, xi-ri-rmax); cx<=grid_coord(centers, xi+ri+rmax); cx++) {
+      const int c = cy * centers->g + cx;
+      for (k=centers->first[c]; k<centers->first[c+1]; k++) {
+        const int j = centers->idx[k];
+        const double dx = x[j] - xi, dy = y[j] - yi, rj = r[j];
+        const double d2 = dx*dx + dy*dy;
+        if ( j == i || d2 >= (ri + rj)*(ri + rj) ) {
+          continue; /* disjoint */
+        }
+        if ( d2 == 0.0 && ri == rj ) {
+          /* of two identical circles, the one with the lower index
+             is kept */
+          if ( j < i ) {
+            return 0.0;
+          }
+          continue;
+        }
+        if ( ri >= rj && d2 <= (ri - rj)*(ri - rj) ) {
+          continue; /* circle j is inside circle i */
+        }
+        if ( rj >= ri && d2 <= (rj - ri)*(rj - ri) ) {
+          return 0.0; /* circle i is inside circle j */
+        }
+        if ( nn == buf->size ) {
+          buf->size = 2 * buf->size + 16;
+          buf->nbrs = (int*)realloc(buf->nbrs, buf->size * sizeof(*buf->nbrs));
+          buf->arcs = (arc_t*)realloc(buf->arcs, 2 * buf->size * sizeof(*buf->arcs));
+        }
+        buf->nbrs[nn++] = j;
+      }
+    }
+  }
+
+  /* compute the arcs covered by the intersecting circles */
+  for (k=0; k<nn; k++) {
+    const int j = buf->nbrs[k];
+    const double dx = x[j] - xi, dy = y[j] - yi, rj = r[j];
+    const double d = sqrt(dx*dx + dy*dy);
+    const double phi = atan2(dy, dx);
+    double cosa = (ri*ri + d*d - rj*rj) / (2.0 * ri * d);
+    cosa = (cosa < -1.0 ? -1.0 : (cosa > 1.0 ? 1.0 : cosa));
+    const double alpha = acos(cosa);
+    double a = phi - alpha, b = phi + alpha;
+    /* the covered arc [a, b] is split at -PI, so that every arc lies
+       in [-PI, PI] */
+    if ( a < -PI ) {
+      buf->arcs[na].a = a + 2*PI; buf->arcs[na].b = PI; na++;
+      a = -PI;
+    } else if ( b > PI ) {
+      buf->arcs[na].a = -PI; buf->arcs[na].b = b - 2*PI; na++;
+      b = PI;
+    }
+    buf->arcs[na].a = a; buf->arcs[na].b = b; na++;
+  }
+
+  /* integrate along the uncovered arcs */
+  qsort(buf->arcs, na, sizeof(*buf->arcs), compare_arcs);
+  double area = 0.0, from = -PI;
+  for (k=0; k<=na; k++) {
+    const double to = (k < na ? buf->arcs[k].a : PI);
+    if ( to > from ) {
+      area += 0.5 * (ri*ri*(to - from) + xi*ri*(sin(to) - sin(from)) - yi*ri*(cos(to) - cos(from)));
+    }
+    if ( k < na && buf->arcs[k].b > from ) {
+      from = buf->arcs[k].b;
+    }
+  }
+  return area;
+}
+
+/* Area of the union of the |n| circles, computed from the borders of
+   circles first, ... last-1 only; the area of the union is the sum of
+   the results over a partition of the circles */
+double exact_area( const float* x, const float* y, const float *r, int n, int first, int last )
+{
+  float rmax = 0.0f;
+  double area = 0.0;
+  grid_t centers;
+  int i;
+
+  for (i=0; i<n; i++) {
+    rmax = (r[i] > rmax ? r[i] : rmax);
+  }
+  /* each circle is listed in the cell of its center only; cells have
+     the size of the largest radius */
+  centers.g = (int)ceil(SIDE / (rmax > 0.0f ? rmax : SIDE));
+  centers.g = (centers.g < 1 ? 1 : (centers.g > MAX_GRID ? MAX_GRID : centers.g));
+  centers.cell = SIDE / centers.g;
+  grid_fill(&centers, x, y, NULL, 0.0f, n);
+
+#pragma omp parallel default(none) shared(x, y, r, centers, rmax, first, last) reduction(+:area)
+  {
+    scratch_t buf = { 0, NULL, NULL };
+#pragma omp for schedule(dynamic, 64)
+    for (i=first; i<last; i++) {
+      area += circle_area(x, y, r, &centers, rmax, i, &buf);
+    }
+    free(buf.nbrs);
+    free(buf.arcs);
+  }
+  grid_free(&centers);
+  return area;
 }
 
 int main( int argc, char* argv[] )
 {
   float *x = NULL, *y = NULL, *r = NULL;
-  int N, K, c = 0;
+  int N, nrep = 16, opt, rep, brute = 0, sorted = 0, exact = 0;
+  uint64_t K, seed = 1;
+  qmc_kind_t kind = QMC_MC;
+  qmc_t q;
   int my_rank, comm_sz;
 
   MPI_Init(&argc, &argv);
   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
 
-  /* Initialize the Random Number Generator (RNG) */
-  srand(time(NULL));
+  while ( (opt = getopt(argc, argv, "e:r:s:bcx")) != -1 ) {
+    switch (opt) {
+    case 'e':
+      if ( qmc_parse(optarg, &kind) ) {
+        if ( 0 == my_rank ) {
+          fprintf(stderr, "Unknown method %s\n", optarg);
+        }
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+      }
+      break;
+    case 'r':
+      nrep = atoi(optarg);
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'b':
+      brute = 1;
+      break;
+    case 'c':
+      sorted = 1;
+      break;
+    case 'x':
+      exact = 1;
+      break;
+    default:
+      optind = argc; /* print the usage message */
+    }
+  }
+
+  if ( (0 == my_rank) && (argc - optind != 2 || nrep < 2 || (brute && sorted)) ) {
+    fprintf(stderr, "Usage: %s [-e mc|strat|anti|halton|sobol] [-r nrep] [-s seed] [-b | -c] [-x] npoints inputfile\n", argv[0]);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
 
-  if ( (0 == my_rank) && (argc != 3) ) {
-    fprintf(stderr, "Usage: %s [npoints] [inputfile]\n", argv[0]);
+  qmc_init(&q, kind, strtoull(argv[optind], NULL, 10), nrep, seed);
+  K = qmc_npoints(&q);
+  if ( (0 == my_rank) && (K < 1) ) {
+    fprintf(stderr, "Too few points\n");
     MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
   }
 
-  K = atoi(argv[1]);
+  MPI_File fh;
+  int64_t n64;
+  const double tload = MPI_Wtime();
+  const int status = colfile_open(MPI_COMM_WORLD, argv[optind+1], 3, &fh, &n64);
+  const int binary = (0 == status);
 
-  /* It is required that the input file is read by the master only */
-  if ( 0 == my_rank ) {
-    FILE *in = fopen(argv[2], "r");
-    int i;
-    if ( !in ) {
-      fprintf(stderr, "Cannot open %s for reading\n", argv[2]);
-      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  if ( (0 == my_rank) && (2 == status) ) {
+    fprintf(stderr, "FATAL: %s is truncated, or holds too many circles\n", argv[optind+1]);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+
+  if ( binary ) {
+    /* every process reads its own slice of the circles with MPI-IO,
+       and the slices are then exchanged among all the processes */
+    int *counts = (int*)malloc(comm_sz * sizeof(*counts));
+    int *displs = (int*)malloc(comm_sz * sizeof(*displs));
+    N = n64;
+    for (rep=0; rep<comm_sz; rep++) {
+      displs[rep] = N * (long)rep / comm_sz;
+      counts[rep] = N * (long)(rep + 1) / comm_sz - displs[rep];
     }
-    fscanf(in, "%d", &N);
     x = (float*)malloc(N * sizeof(*x));
     y = (float*)malloc(N * sizeof(*y));
     r = (float*)malloc(N * sizeof(*r));
-    for (i=0; i<N; i++) {
-      fscanf(in, "%f %f %f", &x[i], &y[i], &r[i]);
+    float *cols[3] = { x + displs[my_rank], y + displs[my_rank], r + displs[my_rank] };
+    if ( colfile_read_at(fh, 3, n64, displs[my_rank], counts[my_rank], cols) ) {
+      fprintf(stderr, "FATAL: process %d could not read its part of %s\n", my_rank, argv[optind+1]);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    MPI_File_close(&fh);
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, x, counts, displs, MPI_FLOAT, MPI_COMM_WORLD);
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, y, counts, displs, MPI_FLOAT, MPI_COMM_WORLD);
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, r, counts, displs, MPI_FLOAT, MPI_COMM_WORLD);
+    free(counts);
+    free(displs);
+  } else {
+    /* It is required that the text input file is read by the master
+       only */
+    if ( 0 == my_rank ) {
+      FILE *in = fopen(argv[optind+1], "r");
+      int i;
+      if ( !in ) {
+        fprintf(stderr, "Cannot open %s for reading\n", argv[optind+1]);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+      }
+      fscanf(in, "%d", &N);
+      x = (float*)malloc(N * sizeof(*x));
+      y = (float*)malloc(N * sizeof(*y));
+      r = (float*)malloc(N * sizeof(*r));
+      for (i=0; i<N; i++) {
+        fscanf(in, "%f %f %f", &x[i], &y[i], &r[i]);
+      }
+      fclose(in);
     }
-    fclose(in);
-  }
 
-  MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-  const int start = my_rank * K / comm_sz;
-  const int end = (my_rank + 1) * K / comm_sz;
-  const int size = end - start;
+    if(my_rank != 0) {
+      x = (float*) malloc(N * sizeof(*x));
+      y = (float*) malloc(N * sizeof(*y));
+      r = (float*) malloc(N * sizeof(*r));
+    }
 
-  if(my_rank != 0) {
-    x = (float*) malloc(N * sizeof(*x));
-    y = (float*) malloc(N * sizeof(*y));
-    r = (float*) malloc(N * sizeof(*r));
+    MPI_Bcast(x, N, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(y, N, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(r, N, MPI_FLOAT, 0, MPI_COMM_WORLD);
   }
+  const double load_time = MPI_Wtime() - tload;
 
-  MPI_Bcast(x, N, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  MPI_Bcast(y, N, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  MPI_Bcast(r, N, MPI_FLOAT, 0, MPI_COMM_WORLD);
+  const uint64_t start = K * my_rank / comm_sz;
+  const uint64_t end = K * (my_rank + 1) / comm_sz;
 
-  int local_c = inside(x, y, r, N, size);
+  double exact_sum = 0.0, exact_time = 0.0;
+  if ( exact ) {
+    /* each process integrates along the borders of its own part of
+       the circles */
+    const double texact = MPI_Wtime();
+    const double local_sum = exact_area(x, y, r, N, N * (long)my_rank / comm_sz, N * (long)(my_rank + 1) / comm_sz);
+    MPI_Reduce(&local_sum, &exact_sum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    exact_time = MPI_Wtime() - texact;
+  }
 
-  MPI_Reduce(&local_c, &c, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  uint64_t *local_hits = (uint64_t*)calloc(nrep, sizeof(*local_hits));
+  uint64_t *hits = (uint64_t*)malloc(nrep * sizeof(*hits));
+  grid_t grid;
+  double tbuild = 0.0, local_time, max_time;
+
+  const double tstart = MPI_Wtime();
+  if ( brute ) {
+    inside(x, y, r, N, &q, start, end, local_hits);
+  } else {
+    grid_init(&grid, x, y, r, N);
+    tbuild = MPI_Wtime() - tstart;
+    if ( sorted ) {
+      inside_sorted(x, y, r, &grid, &q, start, end, local_hits);
+    } else {
+      inside_grid(x, y, r, &grid, &q, start, end, local_hits);
+    }
+  }
+  local_time = MPI_Wtime() - tstart;
+
+  MPI_Reduce(local_hits, hits, nrep, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&local_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
   /* the master prints the area */
   if ( 0 == my_rank ) {
-    printf("%d points, %d inside, area %f\n", K, c, 1.0e6*c/K);
+    double mean, err;
+    uint64_t c = 0;
+    for (rep=0; rep<nrep; rep++) {
+      c += hits[rep];
+    }
+    qmc_result(&q, hits, &mean, &err);
+    const double square = (double)SIDE * SIDE;
+    /* standard deviation of plain Monte Carlo with the same points */
+    const double err_mc = sqrt(mean * (1.0 - mean) / K);
+    printf("%" PRIu64 " points (%s, %d replicates), %" PRIu64 " inside, area %f\n", K, qmc_names[kind], nrep, c, square * mean);
+    printf("Statistical error (1 sigma, from the replicates): %f\n", square * err);
+    printf("Monte Carlo error with the same points: %f", square * err_mc);
+    if ( err > 0.0 ) {
+      printf("; Monte Carlo would need %.3g points", K * (err_mc/err) * (err_mc/err));
+    }
+    printf("\n");
+    printf("%d circles (%s input) loaded in %f s\n", N, (binary ? "binary" : "text"), load_time);
+    if ( brute ) {
+      printf("Brute force, %d circles\n", N);
+    } else {
+      printf("Grid %d x %d, %d circles, %.2f circles per cell, built in %f s%s\n", grid.g, grid.g, N,
+             grid.first[grid.g * grid.g] / (double)(grid.g * grid.g), tbuild, (sorted ? ", points sorted by cell" : ""));
+    }
+    printf("Elapsed time: %f s (%.2f Mpoints/s)\n", max_time, 1.0e-6 * K / max_time);
+    if ( exact ) {
+      const double diff = square * mean - exact_sum;
+      printf("Exact area %f, computed in %f s\n", exact_sum, exact_time);
+      printf("Estimate - exact: %f (%.2e relative", diff, diff / exact_sum);
+      if ( err > 0.0 ) {
+        printf(", %.2f sigma", fabs(diff) / (square * err));
+      }
+      printf(")\n");
+    }
+  }
+
+  if ( ! brute ) {
+    grid_free(&grid);
   }
 
+  free(local_hits);
+  free(hits);
   free(x);
   free(y);
   free(r);
@@ -19,35 +19,60 @@
  * This program implements the "rule 30 CA" as described in
  * https://en.wikipedia.org/wiki/Rule_30 
  *
+ * The domain is a ring of |width| cells, split among the processes,
+ * that keep their part for the whole run; process 0 only collects the
+ * rows of the output image. Each process stores |H| ghost cells on
+ * each side of its part. Since a cell depends on its neighbors at
+ * distance one, H ghost cells allow H steps to be computed without
+ * communicating: at the j-th of these steps (j = 0, ... H-1) the
+ * values of the ghost cells farther than j cells from the edge are
+ * still valid, and are recomputed along with the local cells. The
+ * ghost cells are exchanged once every H steps, which reduces the
+ * number of messages by a factor of H at the cost of some redundant
+ * computation (about H^2 cells per process every H steps).
+ *
+ * The exchange is nonblocking: the first step after it computes the
+ * cells that do not depend on the ghost cells while the messages are
+ * in transit, then waits and computes the remaining ones.
+ *
+ * One row every |k| steps is written to the output image (so the
+ * image has ceil(steps / k) rows); -n disables the output, to measure
+ * the speed of the computation alone. The image is a binary (P4) PBM
+ * file, written by a separate thread (see pbm-writer.h) while the
+ * computation goes on.
+ *
  * Compile with:
- * mpicc -std=c99 -Wall -Wpedantic mpi-rule30.c -o mpi-rule30
+ * mpicc -std=c99 -Wall -Wpedantic mpi-rule30.c -o mpi-rule30 -lpthread
  *
  * Run with:
+ * mpirun -n 4 ./mpi-rule30 [-H halo] [-k every] [-n] [width [steps]]
+ *
+ * Example:
  * mpirun -n 4 ./mpi-rule30 1024 1024
  *
  ****************************************************************************/
+
+/* The following #define is required by getopt() */
+#define _XOPEN_SOURCE 600
+
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h> /* for getopt() */
+#include "pbm-writer.h"
 
 /* Note: the MPI datatype corresponding to "signed char" is MPI_CHAR */
 typedef signed char cell_t;
 
-/* number of ghost cells on each side; currently, this program assumes
-   HALO == 1. */
-const int HALO = 1;
-
 /**
- * Given the current state of the CA, compute the next state. |ext_n|
- * is the number of cells PLUS the ghost cells. This function assumes
- * that the first and last cell of |cur| are ghost cells, and
- * therefore their values are used to compute |next| but are not
- * updated on the |next| array.
+ * Given the current state of the CA, compute the next state of the
+ * cells lo, ... hi-1. The cells lo-1 and hi of |cur| are read but not
+ * updated.
  */
-void step( const cell_t *cur, cell_t *next, int ext_n )
+void step( const cell_t *cur, cell_t *next, int lo, int hi )
 {
   int i;
-  for (i=HALO; i<ext_n-HALO; i++) {
+  for (i=lo; i<hi; i++) {
     const cell_t east = cur[i-1];
     const cell_t center = cur[i];
     const cell_t west = cur[i+1];
@@ -59,59 +84,84 @@ void step( const cell_t *cur, cell_t *next, int ext_n )
 }
 
 /**
- * Initialize the domain; all cells are 0, with the exception of a
- * single cell in the middle of the domain. |ext_n| is the width of the
- * domain PLUS the ghost cells.
+ * Initialize the domain of |n| cells; all cells are 0, with the
+ * exception of a single cell in the middle of the domain.
  */
-void init_domain( cell_t *cur, int ext_n )
+void init_domain( cell_t *cur, int n )
 {
   int i;
-  for (i=0; i<ext_n; i++) {
+  for (i=0; i<n; i++) {
     cur[i] = 0;
   }
-  cur[ext_n/2] = 1;
+  cur[n/2] = 1;
 }
 
 /**
- * Dump the current state of the automaton to PBM file |out|. |ext_n|
- * is the true width of the domain PLUS the ghost cells.
+ * Start the exchange of the ghost cells of the local domain |cur| of
+ * |local_n| cells plus |H| ghost cells on each side: the leftmost H
+ * local cells go to the previous process, the rightmost H to the next
+ * one. |req| must have room for 4 requests.
  */
-void dump_state( FILE *out, const cell_t *cur, int ext_n )
+void start_halo_exchange( cell_t *cur, int local_n, int H, int rank_prev, int rank_next, MPI_Request req[4] )
 {
-  int i;
-  for (i=HALO; i<ext_n-HALO; i++) {
-    fprintf(out, "%d ", cur[i]);
-  }
-  fprintf(out, "\n");
+  MPI_Irecv(cur, H, MPI_CHAR, rank_prev, 0, MPI_COMM_WORLD, &req[0]);
+  MPI_Irecv(cur + H + local_n, H, MPI_CHAR, rank_next, 1, MPI_COMM_WORLD, &req[1]);
+  MPI_Isend(cur + local_n, H, MPI_CHAR, rank_next, 0, MPI_COMM_WORLD, &req[2]);
+  MPI_Isend(cur + H, H, MPI_CHAR, rank_prev, 1, MPI_COMM_WORLD, &req[3]);
 }
 
 int main( int argc, char* argv[] )
 {
   const char *outname = "rule30.pbm";
-  FILE *out = NULL;
-  int width, ext_width, steps = 1024, s;        
+  pbm_writer_t *out = NULL;
+  int width, steps = 1024, s, H = 1, every = 1, dump = 1, opt;
   /* |cur| is the memory buffer containint |width| elements; this is
-     the full state of the CA. */
-  cell_t *cur = NULL, *next = NULL, *tmp;
+     the full state of the CA, used by the master to write the
+     output. */
+  cell_t *cur = NULL, *tmp;
   int my_rank, comm_sz;
+  long nmessages = 0;
+  double tstart, elapsed;
+  int provided;
 
-  MPI_Init(&argc, &argv);
+  /* only the main thread calls MPI; rank 0 also runs the I/O thread
+     of the PBM writer */
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
 
-  if ( 0 == my_rank && argc > 3 ) {
-    fprintf(stderr, "Usage: %s [width [steps]]\n", argv[0]);
-    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  while ( (opt = getopt(argc, argv, "H:k:n")) != -1 ) {
+    switch (opt) {
+    case 'H':
+      H = atoi(optarg);
+      break;
+    case 'k':
+      every = atoi(optarg);
+      break;
+    case 'n':
+      dump = 0;
+      break;
+    default:
+      H = 0; /* print usage */
+    }
+  }
+
+  if ( argc - optind > 2 || H < 1 || every < 1 ) {
+    if ( 0 == my_rank ) {
+      fprintf(stderr, "Usage: %s [-H halo] [-k every] [-n] [width [steps]]\n", argv[0]);
+    }
+    MPI_Finalize();
+    return EXIT_FAILURE;
   }
 
-  if ( argc > 1 ) {
-    width = atoi(argv[1]);
+  if ( argc > optind ) {
+    width = atoi(argv[optind]);
   } else {
     width = comm_sz * 256;
   }
 
-  if ( argc > 2 ) {
-    steps = atoi(argv[2]);
+  if ( argc > optind + 1 ) {
+    steps = atoi(argv[optind + 1]);
   }
 
   if ( (0 == my_rank) && (width % comm_sz) ) {
@@ -119,90 +169,91 @@ int main( int argc, char* argv[] )
     MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
   }
 
-  /* ext_width is the width PLUS the halo */    
-  ext_width = width + 2*HALO;
+  /* size of each local domain, without the ghost cells */
+  const int local_n = width / comm_sz;
+
+  if ( (0 == my_rank) && (H > local_n) ) {
+    printf("The halo (%d) can not be larger than the local domain (%d)\n", H, local_n);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
 
   /* The master creates the output file */    
   if ( 0 == my_rank ) {
-    out = fopen(outname, "w");
-    if ( !out ) {
-      fprintf(stderr, "Cannot create %s\n", outname);
-      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    if ( dump ) {
+      char comment[128];
+      snprintf(comment, sizeof(comment), "produced by %s %d %d", argv[0], width, steps);
+      /* the rows are sampled here, to avoid gathering the others */
+      out = pbm_open(outname, width, (steps + every - 1) / every, 1, comment);
+      if ( !out ) {
+        fprintf(stderr, "Cannot create %s\n", outname);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+      }
     }
-    fprintf(out, "P1\n");
-    fprintf(out, "# produced by %s %d %d\n", argv[0], width, steps);
-    fprintf(out, "%d %d\n", width, steps);
 
     /* Initialize the domain */
-    cur = (cell_t*)malloc( ext_width * sizeof(*cur) );
-    next = (cell_t*)malloc( ext_width * sizeof(*next) );
-    init_domain(cur, ext_width);
+    cur = (cell_t*)malloc( width * sizeof(*cur) );
+    init_domain(cur, width);
   }
 
-  /* [TODO] The following code already contains some pieces that
-     need to be filled in for the parallel version. */
-
-  /* [TODO] compute the rank of the next and previous process on the
-     chain. These will be used to exchange the boundary */
-
   const int rank_next = (my_rank + 1) % comm_sz;
   const int rank_prev = (my_rank - 1 + comm_sz) % comm_sz;
 
-  /* [TODO] size of each local domain; this will be set to |width /
-     comm_sz + 2*HALO|, since it must include the ghost cells */
-  const int local_width = (width / comm_sz) + 2 * HALO;
+  /* |local_cur| and |local_next| are the local domains, with H ghost
+     cells on each side; local cell i is at position H+i */
+  const int ext_n = local_n + 2*H;
+  cell_t *local_cur = (cell_t*) malloc(ext_n * sizeof(cell_t));
+  cell_t *local_next = (cell_t*) malloc(ext_n * sizeof(cell_t));
 
-  /* [TODO] |local_cur| and |local_next| are the local domains,
-     handled by each MPI process. They both have |local_width|
-     elements each */
-  cell_t *local_cur = (cell_t*) malloc(local_width * sizeof(cell_t));
-  cell_t *local_next = (cell_t*) malloc(local_width * sizeof(cell_t));
+  /* The domain is distributed only once */
+  MPI_Scatter(cur, local_n, MPI_CHAR, local_cur + H, local_n, MPI_CHAR, 0, MPI_COMM_WORLD);
 
+  MPI_Barrier(MPI_COMM_WORLD);
+  tstart = MPI_Wtime();
   for (s=0; s<steps; s++) {
+    /* j-th step since the last exchange */
+    const int j = s % H;
+
+    if ( dump && 0 == s % every ) {
+      MPI_Gather(local_cur + H, local_n, MPI_CHAR, cur, local_n, MPI_CHAR, 0, MPI_COMM_WORLD);
+      if ( 0 == my_rank ) {
+        /* Dump the current state to the output image */
+        pbm_put_row(out, cur);
+      }
+    }
 
-    /* [TODO] Here you should scatter the |cur| array into
-       |local_cur|; we are assuming that the width of the domain
-       is multiple of comm_sz. */
-    MPI_Scatter(&cur[1], width / comm_sz, MPI_CHAR, &local_cur[1], width / comm_sz, MPI_CHAR, 0, MPI_COMM_WORLD);
-
-    /* This is OK; do not modify it */
-    if ( 0 == my_rank ) {
-      /* Dump the current state to the output image */
-      dump_state(out, cur, ext_width);
+    if ( 0 == j ) {
+      MPI_Request req[4];
+      start_halo_exchange(local_cur, local_n, H, rank_prev, rank_next, req);
+      nmessages += 4;
+      /* the local cells 1, ... local_n-2 do not need the ghost cells */
+      step(local_cur, local_next, H + 1, H + local_n - 1);
+      MPI_Waitall(4, req, MPI_STATUSES_IGNORE);
+      step(local_cur, local_next, 1, H + 1);
+      step(local_cur, local_next, H + local_n - 1, ext_n - 1);
+    } else {
+      /* the outermost j ghost cells on each side are no longer valid */
+      step(local_cur, local_next, j + 1, ext_n - j - 1);
     }
 
-    /* [TODO] the following "if" should be modified to allow
-       neighbors to exchange ghost cells; two MPI_Sendrecv
-       operations are required to do so. */
-    MPI_Sendrecv(&local_cur[local_width - 2], 1, MPI_CHAR, rank_next, 0, local_cur, 1, MPI_CHAR, rank_prev, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-    MPI_Sendrecv(&local_cur[HALO], 1, MPI_CHAR, rank_prev, 0, &local_cur[local_width - 1], 1, MPI_CHAR, rank_next, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-    /* [TODO] replace the following block; each process calls
-       |step()| on its local domain */
-      /* Compute the next state */
-    step(local_cur, local_next, local_width);
-
-    /* [TODO] here we gather the local domains into the
-       |cur| array; indeed, in the parallel version the
-       master does not need |next| at all */
-    MPI_Gather(&local_next[1], local_width - 2, MPI_CHAR, &cur[1], local_width - 2, MPI_CHAR, 0, MPI_COMM_WORLD);
-
-    /* [TODO] Replace the following block; each process
-       exchanges local_cur and local_next */
-    /*if (0 == my_rank) {
-      //swap cur and next
-      tmp = cur;
-      cur = next;
-      next = tmp;
-    }*/
+    tmp = local_cur;
+    local_cur = local_next;
+    local_next = tmp;
   }
-  free(next);
+  elapsed = MPI_Wtime() - tstart;
+
+  if ( 0 == my_rank ) {
+    printf("%d cells, %d steps, %d processes, H=%d: %f s, %.0f steps/s, %ld messages per process%s\n",
+           width, steps, comm_sz, H, elapsed, steps / elapsed, nmessages,
+           (dump ? " (including output)" : ""));
+  }
+
   free(local_cur);
   free(local_next);
 
   if ( 0 == my_rank ) {
-    fclose(out);
+    if ( dump && pbm_close(out) != 0 ) {
+      fprintf(stderr, "Error writing %s\n", outname);
+    }
     free(cur);
   }
 
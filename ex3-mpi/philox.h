@@ -0,0 +1,117 @@
+/* */
+/****************************************************************************
+ *
+ * philox.h - Counter-based pseudo-random number generator Philox4x32-10
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Philox4x32-10 (J. K. Salmon, M. A. Moraes, R. O. Dror, D. E. Shaw,
+ * "Parallel random numbers: as easy as 1, 2, 3", SC 2011) maps a
+ * 128-bit counter and a 64-bit key to 128 random bits, i.e., four
+ * 32-bit words, with ten rounds of multiplications and XORs. There is
+ * no state: the i-th random block of a stream is obtained by
+ * encrypting counter i, so any thread or process can jump to any
+ * position of any stream in constant time. Here the low 64 bits of
+ * the counter are the position within the stream, the high 64 bits
+ * are the stream number, and the key is the seed. Giving each thread
+ * or process a disjoint range of positions (or a different stream)
+ * yields independent sequences, and the results do not depend on how
+ * the work is split.
+ *
+ * philox4x32_batch() computes PHILOX_BATCH consecutive blocks at
+ * once; the state of the blocks is kept in separate arrays, one per
+ * word, and every round is a loop over the blocks without
+ * dependencies between iterations, that GCC vectorizes with -O3
+ * -march=native. philox4x32() is the scalar reference.
+ *
+ * The same file is used by ex1-openmp/omp-pi.c, ex1-mpi/mpi-pi.c,
+ * ex2-mpi/mpi-pi.c and by qmc.h (ex1-openmp, ex3-mpi); keep the
+ * copies in sync.
+ *
+ ****************************************************************************/
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+/* Number of blocks computed by philox4x32_batch() */
+#define PHILOX_BATCH 16
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+/* Compute out[0..3] = Philox4x32-10(ctr[0..3], key[0..1]) */
+void philox4x32( const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4] )
+{
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint32_t k0 = key[0], k1 = key[1];
+  int r;
+
+  for (r=0; r<10; r++) {
+    const uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+    const uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+    c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+    c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+    c1 = (uint32_t)p1;
+    c3 = (uint32_t)p0;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+/* Compute the PHILOX_BATCH blocks at positions pos, pos+1, ... of
+   stream |stream|, with key |seed|. Word w of block pos+k is stored
+   in out[w*PHILOX_BATCH + k], so that each word forms a contiguous
+   array of PHILOX_BATCH values. The result is the same as calling
+   philox4x32() with ctr = {pos+k (low, high 32 bits), stream (low,
+   high 32 bits)} and key = {seed (low, high 32 bits)}. */
+void philox4x32_batch( uint64_t seed, uint64_t stream, uint64_t pos, uint32_t *out )
+{
+  /* each word is kept in the low half of a 64-bit lane, so that the
+     products are computed lane by lane without widening */
+  uint64_t c0[PHILOX_BATCH], c1[PHILOX_BATCH], c2[PHILOX_BATCH], c3[PHILOX_BATCH];
+  uint64_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+  int r, k;
+
+  for (k=0; k<PHILOX_BATCH; k++) {
+    c0[k] = (uint32_t)(pos + k);
+    c1[k] = (uint32_t)((pos + k) >> 32);
+    c2[k] = (uint32_t)stream;
+    c3[k] = (uint32_t)(stream >> 32);
+  }
+  for (r=0; r<10; r++) {
+    for (k=0; k<PHILOX_BATCH; k++) {
+      const uint64_t p0 = PHILOX_M0 * c0[k];
+      const uint64_t p1 = PHILOX_M1 * c2[k];
+      c0[k] = (p1 >> 32) ^ c1[k] ^ k0;
+      c2[k] = (p0 >> 32) ^ c3[k] ^ k1;
+      c1[k] = p1 & 0xFFFFFFFFu;
+      c3[k] = p0 & 0xFFFFFFFFu;
+    }
+    k0 = (uint32_t)(k0 + PHILOX_W0);
+    k1 = (uint32_t)(k1 + PHILOX_W1);
+  }
+  for (k=0; k<PHILOX_BATCH; k++) {
+    out[k] = c0[k];
+    out[PHILOX_BATCH + k] = c1[k];
+    out[2*PHILOX_BATCH + k] = c2[k];
+    out[3*PHILOX_BATCH + k] = c3[k];
+  }
+}
+
+#endif
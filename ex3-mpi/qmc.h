@@ -0,0 +1,261 @@
+/* */
+/****************************************************************************
+ *
+ * qmc.h - Sample points for Monte Carlo and quasi-Monte Carlo estimators
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * This header produces sequences of points in the unit square [0, 1)^2
+ * for estimating the fraction of the square covered by some region,
+ * with one of the following methods:
+ *
+ * mc      independent uniform points (Philox4x32-10, see philox.h)
+ * strat   stratified sampling: the square is divided in m x m cells,
+ *         m = floor(sqrt(n)), and each cell gets one uniform point
+ * anti    antithetic variates: uniform points (x, y), each one
+ *         followed by (1-x, 1-y)
+ * halton  Halton sequence with bases 2 and 3
+ * sobol   Sobol' sequence (two dimensions, in Gray code order)
+ *
+ * The error of mc decreases as 1/sqrt(n), that of the low-discrepancy
+ * sequences (halton, sobol) about as 1/n for regions with a smooth
+ * border, so they reach the same accuracy with far fewer points.
+ *
+ * The points are split into |nrep| independent replicates of n points
+ * each. Replicate r uses stream r of the random generator (mc, strat,
+ * anti), or the low-discrepancy sequence randomized by a random shift
+ * (halton: shift modulo 1; sobol: XOR of the binary digits). The
+ * estimate is the mean of the replicates, and its standard error is
+ * computed from their spread (qmc_result()); this is the only
+ * reliable error estimate for the low-discrepancy sequences.
+ *
+ * Point i (0 <= i < nrep*n) can be computed directly, without
+ * computing the previous ones: threads or processes can be given
+ * disjoint ranges of indices, and the result does not depend on how
+ * the points are divided. Typical use:
+ *
+ *   qmc_t q;
+ *   qmc_iter_t it;
+ *   qmc_init(&q, QMC_SOBOL, npoints, nrep, seed);
+ *   qmc_seek(&q, &it, start);
+ *   for (i=start; i<end; i++) {
+ *     double x, y;
+ *     const int r = qmc_next(&it, &x, &y);
+ *     hits[r] += inside(x, y);
+ *   }
+ *   qmc_result(&q, hits, &mean, &err);
+ *
+ * This file is used by ex1-openmp/omp-pi.c and ex3-mpi/mpi-circles.c;
+ * keep the copies in sync.
+ *
+ ****************************************************************************/
+
+#ifndef QMC_H
+#define QMC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "philox.h"
+
+typedef enum { QMC_MC, QMC_STRAT, QMC_ANTI, QMC_HALTON, QMC_SOBOL } qmc_kind_t;
+
+const char *qmc_names[] = { "mc", "strat", "anti", "halton", "sobol" };
+
+typedef struct {
+  qmc_kind_t kind;
+  uint64_t n;          /* points per replicate */
+  int nrep;            /* number of replicates */
+  uint64_t seed;
+  uint32_t m;          /* strat: cells per side (n = m*m) */
+  uint32_t v[2][32];   /* sobol: direction numbers */
+} qmc_t;
+
+typedef struct {
+  const qmc_t *q;
+  int r;               /* replicate of the next point */
+  uint64_t j;          /* index of the next point within the replicate */
+  uint32_t sx, sy;     /* sobol: current point (before the shift) */
+  uint32_t dx, dy;     /* sobol: digital shift of replicate r */
+  double hx, hy;       /* halton: shift of replicate r */
+} qmc_iter_t;
+
+/* Parse the name of a method; returns 0 on success, nonzero if |str|
+   is not valid */
+int qmc_parse( const char *str, qmc_kind_t *kind )
+{
+  int k;
+  for (k=0; k<5; k++) {
+    if ( 0 == strcmp(str, qmc_names[k]) ) {
+      *kind = (qmc_kind_t)k;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Prepare |q| to generate about |npoints| points in |nrep| replicates
+   with method |kind|. The number of points per replicate is rounded
+   down to a perfect square (strat) or to an even number (anti), and
+   is at most 2^32 (sobol); use qmc_npoints() to get the actual
+   total. */
+void qmc_init( qmc_t *q, qmc_kind_t kind, uint64_t npoints, int nrep, uint64_t seed )
+{
+  int k;
+
+  q->kind = kind;
+  q->nrep = (nrep < 1 ? 1 : nrep);
+  q->n = npoints / q->nrep;
+  q->seed = seed;
+  q->m = 0;
+  if ( QMC_STRAT == kind ) {
+    q->m = (uint32_t)sqrt((double)q->n);
+    while ( (uint64_t)q->m * q->m > q->n ) q->m--;
+    q->n = (uint64_t)q->m * q->m;
+  } else if ( QMC_ANTI == kind ) {
+    q->n &= ~(uint64_t)1;
+  } else if ( QMC_SOBOL == kind && q->n > ((uint64_t)1 << 32) ) {
+    q->n = (uint64_t)1 << 32; /* 32 direction numbers */
+  }
+  /* The first dimension is the van der Corput sequence in base 2; the
+     second one uses the primitive polynomial x + 1 with m_k = 1 for
+     all k */
+  q->v[0][0] = q->v[1][0] = 0x80000000u;
+  for (k=1; k<32; k++) {
+    q->v[0][k] = q->v[0][k-1] >> 1;
+    q->v[1][k] = q->v[1][k-1] ^ (q->v[1][k-1] >> 1);
+  }
+}
+
+/* Total number of points, nrep * n */
+uint64_t qmc_npoints( const qmc_t *q )
+{
+  return q->n * q->nrep;
+}
+
+/* Radical inverse of |i| in base |b| */
+double qmc_radical_inverse( uint64_t i, unsigned b )
+{
+  const double inv = 1.0 / b;
+  double f = inv, x = 0.0;
+  while ( i > 0 ) {
+    x += f * (i % b);
+    i /= b;
+    f *= inv;
+  }
+  return x;
+}
+
+/* Four random 32-bit words; stream 0 .. nrep-1 is used by the points
+   of the replicates, stream 2^32 + r by the shift of replicate r */
+void qmc_random( const qmc_t *q, uint64_t stream, uint64_t pos, uint32_t out[4] )
+{
+  const uint32_t ctr[4] = { (uint32_t)pos, (uint32_t)(pos >> 32), (uint32_t)stream, (uint32_t)(stream >> 32) };
+  const uint32_t key[2] = { (uint32_t)q->seed, (uint32_t)(q->seed >> 32) };
+  philox4x32(ctr, key, out);
+}
+
+/* Position |it| on point |i| of the whole sequence */
+void qmc_seek( const qmc_t *q, qmc_iter_t *it, uint64_t i )
+{
+  uint32_t w[4];
+  int k;
+
+  it->q = q;
+  it->r = (int)(i / q->n);
+  it->j = i % q->n;
+  qmc_random(q, ((uint64_t)1 << 32) + it->r, 0, w);
+  it->dx = w[0];
+  it->dy = w[1];
+  it->hx = w[2] * (1.0 / 4294967296.0);
+  it->hy = w[3] * (1.0 / 4294967296.0);
+  /* Sobol' point of index gray(j) */
+  const uint64_t g = it->j ^ (it->j >> 1);
+  it->sx = it->sy = 0;
+  for (k=0; k<32; k++) {
+    if ( (g >> k) & 1 ) {
+      it->sx ^= q->v[0][k];
+      it->sy ^= q->v[1][k];
+    }
+  }
+}
+
+/* Store the next point in (*x, *y), advance |it| and return the
+   replicate the point belongs to */
+int qmc_next( qmc_iter_t *it, double *x, double *y )
+{
+  const qmc_t *q = it->q;
+  const double scale = 1.0 / 4294967296.0; /* 2^-32 */
+  const int r = it->r;
+  const uint64_t j = it->j;
+  uint32_t w[4];
+
+  switch (q->kind) {
+  case QMC_MC:
+    qmc_random(q, r, j, w);
+    *x = w[0] * scale;
+    *y = w[1] * scale;
+    break;
+  case QMC_STRAT:
+    qmc_random(q, r, j, w);
+    *x = (j % q->m + w[0] * scale) / q->m;
+    *y = (j / q->m + w[1] * scale) / q->m;
+    break;
+  case QMC_ANTI:
+    qmc_random(q, r, j/2, w);
+    *x = w[0] * scale;
+    *y = w[1] * scale;
+    if ( j & 1 ) {
+      *x = 1.0 - *x;
+      *y = 1.0 - *y;
+    }
+    break;
+  case QMC_HALTON:
+    *x = qmc_radical_inverse(j + 1, 2) + it->hx;
+    *y = qmc_radical_inverse(j + 1, 3) + it->hy;
+    *x -= (*x >= 1.0);
+    *y -= (*y >= 1.0);
+    break;
+  default: /* QMC_SOBOL */
+    *x = (it->sx ^ it->dx) * scale;
+    *y = (it->sy ^ it->dy) * scale;
+    if ( j + 1 < q->n ) {
+      const int c = __builtin_ctzll(j + 1);
+      it->sx ^= q->v[0][c];
+      it->sy ^= q->v[1][c];
+    }
+  }
+
+  if ( ++it->j == q->n && r + 1 < q->nrep ) {
+    qmc_seek(q, it, (uint64_t)(r + 1) * q->n);
+  }
+  return r;
+}
+
+/* Given the number of hits[r] of each replicate r, compute the mean
+   fraction of hits and its standard error (0 if nrep == 1) */
+void qmc_result( const qmc_t *q, const uint64_t *hits, double *mean, double *stderror )
+{
+  double sum = 0.0, var = 0.0;
+  int r;
+
+  for (r=0; r<q->nrep; r++) {
+    sum += hits[r] / (double)q->n;
+  }
+  *mean = sum / q->nrep;
+  for (r=0; r<q->nrep; r++) {
+    const double d = hits[r] / (double)q->n - *mean;
+    var += d * d;
+  }
+  *stderror = (q->nrep > 1 ? sqrt(var / (q->nrep - 1) / q->nrep) : 0.0);
+}
+
+#endif
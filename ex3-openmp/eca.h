@@ -0,0 +1,257 @@
+/* */
+/****************************************************************************
+ *
+ * eca.h - Bit-packed elementary cellular automata (all 256 rules)
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * An elementary cellular automaton (ECA) is identified by its Wolfram
+ * rule number R (0-255): the next state of a cell whose left, center
+ * and right neighbors are (l, c, r) is bit 4l + 2c + r of R.
+ *
+ * The cells are stored 64 per uint64_t, as in omp-rule30.c, and the
+ * next state of all the cells of a word is computed at once with
+ * bitwise operations. The rule is evaluated as a tree of bitwise
+ * multiplexers, mux(s, a, b) = s ? a : b, selecting on l, then c, then
+ * r, among the eight bits of R, each one extended to a whole word.
+ * One kernel is instantiated per rule, with R known at compile time,
+ * so that the compiler folds the constants: e.g., rule 30 reduces to
+ * a handful of operations, rule 204 (identity) to a copy. The kernels
+ * process 256-bit vectors (4 words) with the vector extensions of
+ * GCC.
+ *
+ * The domain has |width| cells (any width); the boundary is periodic
+ * or fixed (the cells beyond the ends are always 0, or always 1).
+ *
+ * eca_run() splits the words of one automaton among the OpenMP
+ * threads; eca_run_batch() runs many independent automata (e.g.,
+ * different rules or initial states), one per thread at a time, which
+ * is better when they are small.
+ *
+ *   eca_t ca;
+ *   eca_init(&ca, 110, 1000, ECA_PERIODIC);
+ *   eca_set(&ca, 500, 1);
+ *   eca_run(&ca, 100);
+ *   ... eca_get(&ca, i) ...
+ *   eca_free(&ca);
+ *
+ ****************************************************************************/
+
+#ifndef ECA_H
+#define ECA_H
+
+#include <omp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum { ECA_PERIODIC, ECA_FIXED0, ECA_FIXED1 } eca_boundary_t;
+
+const char *eca_boundary_names[] = { "periodic", "fixed0", "fixed1" };
+
+typedef void (*eca_kernel_t)( const uint64_t *, uint64_t *, int, int );
+
+typedef struct {
+  int rule;
+  int width;                 /* number of cells */
+  int nwords;                /* ceil(width / 64) */
+  eca_boundary_t boundary;
+  eca_kernel_t kernel;
+  uint64_t *cur, *next;      /* nwords + 2 words: word 0 and word nwords+1 are ghost words */
+} eca_t;
+
+typedef uint64_t eca_v4w __attribute__((vector_size(32)));
+
+/* Bit k of rule R, extended to a word */
+#define ECA_BIT(R, k) ((((R) >> (k)) & 1) ? ~(uint64_t)0 : (uint64_t)0)
+/* Bitwise s ? a : b */
+#define ECA_MUX(s, a, b) ((b) ^ ((s) & ((a) ^ (b))))
+/* Next state of the cells with neighbors l, c, r (words or vectors) */
+#define ECA_EXPR(l, c, r, R)                                             \
+  ECA_MUX(l,                                                             \
+          ECA_MUX(c, ECA_MUX(r, ECA_BIT(R,7), ECA_BIT(R,6)),             \
+                     ECA_MUX(r, ECA_BIT(R,5), ECA_BIT(R,4))),            \
+          ECA_MUX(c, ECA_MUX(r, ECA_BIT(R,3), ECA_BIT(R,2)),             \
+                     ECA_MUX(r, ECA_BIT(R,1), ECA_BIT(R,0))))
+
+/* Kernel for rule R: compute the words lo, ... hi-1 of |next| from
+   |cur|; the words lo-1 and hi of |cur| are read */
+#define ECA_KERNEL(R)                                                    \
+void eca_kernel_##R( const uint64_t *cur, uint64_t *next, int lo, int hi ) \
+{                                                                        \
+  int i;                                                                 \
+  for (i=lo; i+4<=hi; i+=4) {                                            \
+    eca_v4w p, c, n;                                                     \
+    memcpy(&p, cur + i - 1, sizeof(p));                                  \
+    memcpy(&c, cur + i, sizeof(c));                                      \
+    memcpy(&n, cur + i + 1, sizeof(n));                                  \
+    const eca_v4w l = (c << 1) | (p >> 63);                              \
+    const eca_v4w r = (c >> 1) | (n << 63);                              \
+    const eca_v4w x = ECA_EXPR(l, c, r, R);                              \
+    memcpy(next + i, &x, sizeof(x));                                     \
+  }                                                                      \
+  for ( ; i<hi; i++) {                                                   \
+    const uint64_t c = cur[i];                                           \
+    const uint64_t l = (c << 1) | (cur[i-1] >> 63);                      \
+    const uint64_t r = (c >> 1) | (cur[i+1] << 63);                      \
+    next[i] = ECA_EXPR(l, c, r, R);                                      \
+  }                                                                      \
+}
+
+#define ECA_KERNEL16(H)                                                  \
+  ECA_KERNEL(0x##H##0) ECA_KERNEL(0x##H##1) ECA_KERNEL(0x##H##2) ECA_KERNEL(0x##H##3) \
+  ECA_KERNEL(0x##H##4) ECA_KERNEL(0x##H##5) ECA_KERNEL(0x##H##6) ECA_KERNEL(0x##H##7) \
+  ECA_KERNEL(0x##H##8) ECA_KERNEL(0x##H##9) ECA_KERNEL(0x##H##a) ECA_KERNEL(0x##H##b) \
+  ECA_KERNEL(0x##H##c) ECA_KERNEL(0x##H##d) ECA_KERNEL(0x##H##e) ECA_KERNEL(0x##H##f)
+
+ECA_KERNEL16(0) ECA_KERNEL16(1) ECA_KERNEL16(2) ECA_KERNEL16(3)
+ECA_KERNEL16(4) ECA_KERNEL16(5) ECA_KERNEL16(6) ECA_KERNEL16(7)
+ECA_KERNEL16(8) ECA_KERNEL16(9) ECA_KERNEL16(a) ECA_KERNEL16(b)
+ECA_KERNEL16(c) ECA_KERNEL16(d) ECA_KERNEL16(e) ECA_KERNEL16(f)
+
+#define ECA_NAMES16(H)                                                   \
+  eca_kernel_0x##H##0, eca_kernel_0x##H##1, eca_kernel_0x##H##2, eca_kernel_0x##H##3, \
+  eca_kernel_0x##H##4, eca_kernel_0x##H##5, eca_kernel_0x##H##6, eca_kernel_0x##H##7, \
+  eca_kernel_0x##H##8, eca_kernel_0x##H##9, eca_kernel_0x##H##a, eca_kernel_0x##H##b, \
+  eca_kernel_0x##H##c, eca_kernel_0x##H##d, eca_kernel_0x##H##e, eca_kernel_0x##H##f
+
+const eca_kernel_t eca_kernels[256] = {
+  ECA_NAMES16(0), ECA_NAMES16(1), ECA_NAMES16(2), ECA_NAMES16(3),
+  ECA_NAMES16(4), ECA_NAMES16(5), ECA_NAMES16(6), ECA_NAMES16(7),
+  ECA_NAMES16(8), ECA_NAMES16(9), ECA_NAMES16(a), ECA_NAMES16(b),
+  ECA_NAMES16(c), ECA_NAMES16(d), ECA_NAMES16(e), ECA_NAMES16(f)
+};
+
+/* Create an automaton with rule |rule| and |width| cells, all 0 */
+void eca_init( eca_t *ca, int rule, int width, eca_boundary_t boundary )
+{
+  ca->rule = rule & 0xff;
+  ca->width = width;
+  ca->nwords = (width + 63) / 64;
+  ca->boundary = boundary;
+  ca->kernel = eca_kernels[ca->rule];
+  ca->cur = (uint64_t*)calloc(ca->nwords + 2, sizeof(uint64_t));
+  ca->next = (uint64_t*)calloc(ca->nwords + 2, sizeof(uint64_t));
+}
+
+void eca_free( eca_t *ca )
+{
+  free(ca->cur);
+  free(ca->next);
+  ca->cur = ca->next = NULL;
+}
+
+int eca_get( const eca_t *ca, int i )
+{
+  return (ca->cur[1 + i/64] >> (i%64)) & 1;
+}
+
+void eca_set( eca_t *ca, int i, int v )
+{
+  const uint64_t bit = (uint64_t)1 << (i%64);
+  if ( v ) {
+    ca->cur[1 + i/64] |= bit;
+  } else {
+    ca->cur[1 + i/64] &= ~bit;
+  }
+}
+
+/* Set each cell to 0 or 1 with probability 1/2, from |seed| */
+void eca_randomize( eca_t *ca, uint64_t seed )
+{
+  int i;
+  for (i=1; i<=ca->nwords; i++) {
+    /* splitmix64 */
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    ca->cur[i] = z ^ (z >> 31);
+  }
+}
+
+/* Fill the ghost words, and the bits of the last word beyond |width|,
+   with the values of the cells beyond the ends of the domain. Only
+   bit 63 of the left ghost word and the first bit beyond the last
+   cell are actually read. */
+void eca_boundary( eca_t *ca )
+{
+  uint64_t left, right;
+  const int tail = ca->width % 64;
+
+  if ( ECA_PERIODIC == ca->boundary ) {
+    left = eca_get(ca, ca->width - 1) ? ~(uint64_t)0 : 0;
+    right = eca_get(ca, 0) ? ~(uint64_t)0 : 0;
+  } else {
+    left = right = (ECA_FIXED1 == ca->boundary ? ~(uint64_t)0 : 0);
+  }
+  ca->cur[0] = left;
+  ca->cur[ca->nwords + 1] = right;
+  if ( tail ) {
+    const uint64_t mask = ((uint64_t)1 << tail) - 1;
+    ca->cur[ca->nwords] = (ca->cur[ca->nwords] & mask) | (right & ~mask);
+  }
+}
+
+void eca_swap( eca_t *ca )
+{
+  uint64_t *tmp = ca->cur;
+  ca->cur = ca->next;
+  ca->next = tmp;
+}
+
+/* Advance |ca| by |steps| steps with the calling thread only */
+void eca_run_serial( eca_t *ca, int steps )
+{
+  int s;
+  for (s=0; s<steps; s++) {
+    eca_boundary(ca);
+    ca->kernel(ca->cur, ca->next, 1, ca->nwords + 1);
+    eca_swap(ca);
+  }
+}
+
+/* Advance |ca| by |steps| steps; each OpenMP thread updates a
+   contiguous range of words, aligned to 8 words */
+void eca_run( eca_t *ca, int steps )
+{
+  int s;
+#pragma omp parallel default(none) private(s) shared(ca, steps)
+  {
+    const int nt = omp_get_num_threads();
+    const int id = omp_get_thread_num();
+    const int nblocks = (ca->nwords + 7) / 8;
+    const int lo = 1 + 8 * (int)((long)nblocks * id / nt);
+    const int hi_block = 1 + 8 * (int)((long)nblocks * (id + 1) / nt);
+    const int hi = (hi_block < ca->nwords + 1 ? hi_block : ca->nwords + 1);
+
+    for (s=0; s<steps; s++) {
+#pragma omp single
+      eca_boundary(ca);
+      ca->kernel(ca->cur, ca->next, lo, hi);
+#pragma omp barrier
+#pragma omp single
+      eca_swap(ca);
+    }
+  }
+}
+
+/* Advance each of the |n| automata |ca[0]|, ... |ca[n-1]| by |steps|
+   steps; the automata are distributed among the OpenMP threads */
+void eca_run_batch( eca_t *ca, int n, int steps )
+{
+  int k;
+#pragma omp parallel for schedule(dynamic) default(none) shared(ca, n, steps)
+  for (k=0; k<n; k++) {
+    eca_run_serial(&ca[k], steps);
+  }
+}
+
+#endif
@@ -0,0 +1,490 @@
+/* */
+/****************************************************************************
+ *
+ * omp-anneal.c - Bit-sliced ANNEAL cellular automaton with OpenMP
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * The ANNEAL CA of ex3-cuda/cuda-anneal.cu on an n x n torus: a cell
+ * becomes 1 iff the number of 1s among itself and its 8 neighbors is
+ * 4 or at least 6 (a "twisted" majority vote).
+ *
+ * The reference version stores one cell per byte, fills the ghost
+ * cells around the domain before each step, and adds up the 9 cells
+ * of each neighborhood, as the CUDA version does.
+ *
+ * The bit-sliced version stores each row as ceil(n/64) words, 64
+ * cells per word (cell j of a row is bit j%64 of word j/64). The
+ * counts are computed 64 cells at a time with bitwise operations that
+ * act as adders on bit "slices":
+ *
+ * - for each row, a full adder sums the west, center and east cells
+ *   of each column into a 2-bit number (l, h) (0-3); this "horizontal
+ *   sum" is computed once per row and used by the three rows that
+ *   need it (the rows above, at and below it);
+ *
+ * - for each row, the horizontal sums of the rows above, at and below
+ *   are added by a network of full and half adders into a 4-bit count
+ *   (0-9), from which the next state is obtained.
+ *
+ * The boundary is periodic, and is handled without ghost cells: the
+ * rows above the first and below the last are found by wrapping the
+ * row index, and the cells beyond the first and last column by
+ * reading the other end of the same row in the first and last word.
+ *
+ * The rows are split in bands among the OpenMP threads; each thread
+ * keeps the horizontal sums of three rows in a private buffer.
+ *
+ * A sweep of the whole grid per step reads and writes the grid from
+ * memory at every step, once the grid does not fit in the cache. The
+ * temporally blocked version advances T steps at a time, one tile of
+ * TILE_ROWS x TILE_WORDS words at a time: the tile is copied, with T
+ * extra rows above and below it and one extra word on each side, to a
+ * small private buffer; there it is advanced T steps, computing at
+ * step t only the rows that are still valid (the band shrinks by one
+ * row per side per step: a trapezoid in space-time), and the
+ * central part is finally copied to the next grid. The rows of the
+ * buffer are treated as periodic, so that the same code is used: the
+ * wrong values that this brings in from the opposite end only spread
+ * by one cell per step, and do not reach beyond the extra words as
+ * long as T <= 64. The grid is thus read and written once every T
+ * steps, at the cost of recomputing the overlapping parts of
+ * neighboring tiles. The tiles are independent, and are distributed
+ * among the OpenMP threads. If n is not a multiple of 64 the tiles
+ * span whole rows.
+ *
+ * The program runs all the versions on the same initial state, and
+ * checks that the results are the same; the reference version is only
+ * run for n <= REF_MAX_N. The final state is written to
+ * anneal-<steps>.pbm (binary PBM).
+ *
+ * Compile with:
+ *
+ * gcc -fopenmp -std=c99 -Wall -Wpedantic -O3 -march=native omp-anneal.c -o omp-anneal
+ *
+ * Run with:
+ *
+ * ./omp-anneal [nsteps [n [T]]]
+ *
+ ****************************************************************************/
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define REF_MAX_N 4096
+#define TILE_ROWS 128
+#define TILE_WORDS 256
+
+typedef unsigned char cell_t;
+
+/* Pointer to cell (i, j) of a (ext_n * ext_n) grid with ghost cells */
+cell_t *IDX( cell_t *grid, int ext_n, int i, int j )
+{
+  return (grid + i*ext_n + j);
+}
+
+/* Fill the ghost cells of |grid|: first the top and bottom rows, then
+   the left and right columns (including the corners) */
+void copy_halo( cell_t *grid, int ext_n )
+{
+  int i, j;
+  for (j=0; j<ext_n; j++) {
+    *IDX(grid, ext_n, ext_n-1, j) = *IDX(grid, ext_n, 1, j);
+    *IDX(grid, ext_n, 0, j) = *IDX(grid, ext_n, ext_n-2, j);
+  }
+  for (i=0; i<ext_n; i++) {
+    *IDX(grid, ext_n, i, ext_n-1) = *IDX(grid, ext_n, i, 1);
+    *IDX(grid, ext_n, i, 0) = *IDX(grid, ext_n, i, ext_n-2);
+  }
+}
+
+/* Reference version: compute |next| from |cur|, one cell per byte */
+void step_bytes( cell_t *cur, cell_t *next, int ext_n )
+{
+  int i, j;
+#pragma omp parallel for private(j) schedule(static)
+  for (i=1; i<ext_n-1; i++) {
+    for (j=1; j<ext_n-1; j++) {
+      const int nbors =
+        *IDX(cur, ext_n, i-1, j-1) + *IDX(cur, ext_n, i-1, j) + *IDX(cur, ext_n, i-1, j+1) +
+        *IDX(cur, ext_n, i  , j-1) + *IDX(cur, ext_n, i  , j) + *IDX(cur, ext_n, i  , j+1) +
+        *IDX(cur, ext_n, i+1, j-1) + *IDX(cur, ext_n, i+1, j) + *IDX(cur, ext_n, i+1, j+1);
+      *IDX(next, ext_n, i, j) = (nbors >= 6 || nbors == 4);
+    }
+  }
+}
+
+/* Initialize the current grid |cur| with alive cells with density
+   |p|, as in cuda-anneal.cu */
+void init( cell_t *cur, int ext_n, float p )
+{
+  int i, j;
+  for (i=1; i<ext_n-1; i++) {
+    for (j=1; j<ext_n-1; j++) {
+      *IDX(cur, ext_n, i, j) = (((float)rand())/RAND_MAX < p);
+    }
+  }
+}
+
+/* Horizontal sum of one word: (*l, *h) = w + c + e, bit by bit */
+static inline void hsum_word( uint64_t w, uint64_t c, uint64_t e, uint64_t *l, uint64_t *h )
+{
+  *l = w ^ c ^ e;
+  *h = (w & c) | (e & (w ^ c));
+}
+
+/* Horizontal sums of the |nw| words of |row| (a row of |n| cells,
+   whose bits beyond the n-th are 0), with periodic boundary */
+void hsum_row( const uint64_t *restrict row, int n, int nw, uint64_t *restrict l, uint64_t *restrict h )
+{
+  const int last = (n - 1) % 64;          /* bit of column n-1 in word nw-1 */
+  const uint64_t col_first = row[0] & 1;
+  const uint64_t col_last = (row[nw-1] >> last) & 1;
+  int k;
+
+  if ( 1 == nw ) {
+    const uint64_t c = row[0];
+    hsum_word((c << 1) | col_last, c, (c >> 1) | (col_first << last), &l[0], &h[0]);
+    return;
+  }
+  hsum_word((row[0] << 1) | col_last, row[0], (row[0] >> 1) | (row[1] << 63), &l[0], &h[0]);
+  for (k=1; k<nw-1; k++) {
+    const uint64_t c = row[k];
+    hsum_word((c << 1) | (row[k-1] >> 63), c, (c >> 1) | (row[k+1] << 63), &l[k], &h[k]);
+  }
+  hsum_word((row[nw-1] << 1) | (row[nw-2] >> 63), row[nw-1], (row[nw-1] >> 1) | (col_first << last), &l[nw-1], &h[nw-1]);
+}
+
+/* Next state of the |nw| words of a row, from the horizontal sums
+   (l0, h0), (l1, h1), (l2, h2) of the rows above, at and below it */
+void combine( const uint64_t *restrict l0, const uint64_t *restrict h0,
+              const uint64_t *restrict l1, const uint64_t *restrict h1,
+              const uint64_t *restrict l2, const uint64_t *restrict h2,
+              uint64_t *restrict out, int nw, uint64_t tailmask )
+{
+  int k;
+  for (k=0; k<nw; k++) {
+    /* count = s0 + 2*(c0 + t0) + 4*t1 = s0 + 2*b1 + 4*b2 + 8*b3 */
+    const uint64_t s0 = l0[k] ^ l1[k] ^ l2[k];
+    const uint64_t c0 = (l0[k] & l1[k]) | (l2[k] & (l0[k] ^ l1[k]));
+    const uint64_t t0 = h0[k] ^ h1[k] ^ h2[k];
+    const uint64_t t1 = (h0[k] & h1[k]) | (h2[k] & (h0[k] ^ h1[k]));
+    const uint64_t b1 = c0 ^ t0;
+    const uint64_t c1 = c0 & t0;
+    const uint64_t b2 = t1 ^ c1;
+    const uint64_t b3 = t1 & c1;
+    /* count >= 8, or count is 4, 6 or 7 */
+    out[k] = b3 | (b2 & (b1 | ~s0));
+  }
+  out[nw-1] &= tailmask;
+}
+
+/**
+ * Compute the rows r0, ... r1-1 of |next| from |cur|, that have
+ * |nrows| rows of |n| cells each (the row after the last is the
+ * first). |buf| must have room for 6*ceil(n/64) words.
+ */
+void step_band( const uint64_t *cur, uint64_t *next, int n, int nrows, int r0, int r1, uint64_t *buf )
+{
+  const int nw = (n + 63) / 64;
+  const uint64_t tailmask = (n % 64 ? ((uint64_t)1 << (n % 64)) - 1 : ~(uint64_t)0);
+  uint64_t *l[3], *h[3], *tmp;
+  int i, k;
+
+  for (k=0; k<3; k++) {
+    l[k] = buf + 2*k*nw;
+    h[k] = buf + (2*k + 1)*nw;
+  }
+  hsum_row(cur + (size_t)((r0 - 1 + nrows) % nrows) * nw, n, nw, l[0], h[0]);
+  hsum_row(cur + (size_t)r0 * nw, n, nw, l[1], h[1]);
+  for (i=r0; i<r1; i++) {
+    hsum_row(cur + (size_t)((i + 1) % nrows) * nw, n, nw, l[2], h[2]);
+    combine(l[0], h[0], l[1], h[1], l[2], h[2], next + (size_t)i * nw, nw, tailmask);
+    /* the row at i becomes the row above i+1, and so on */
+    tmp = l[0]; l[0] = l[1]; l[1] = l[2]; l[2] = tmp;
+    tmp = h[0]; h[0] = h[1]; h[1] = h[2]; h[2] = tmp;
+  }
+}
+
+/**
+ * Run |steps| steps of the bit-sliced CA of |n| x |n| cells in
+ * |*cur|, using |*next| as scratch space; on return, |*cur| holds the
+ * final state. Each thread updates a band of contiguous rows.
+ */
+void run_bits( uint64_t **cur, uint64_t **next, int n, int steps )
+{
+  const int nw = (n + 63) / 64;
+  int s;
+#pragma omp parallel default(none) private(s) shared(cur, next, n, nw, steps)
+  {
+    const int nt = omp_get_num_threads();
+    const int id = omp_get_thread_num();
+    const int r0 = (int)((long)n * id / nt);
+    const int r1 = (int)((long)n * (id + 1) / nt);
+    uint64_t *buf = (uint64_t*)malloc(6 * nw * sizeof(*buf));
+
+    for (s=0; s<steps; s++) {
+      if ( r0 < r1 ) {
+        step_band(*cur, *next, n, n, r0, r1, buf);
+      }
+#pragma omp barrier
+#pragma omp single
+      {
+        uint64_t *tmp = *cur;
+        *cur = *next;
+        *next = tmp;
+      }
+    }
+    free(buf);
+  }
+}
+
+/**
+ * Advance by |T| steps the tile of |cur| made of the |nr| rows from
+ * |r0| and the |nwt| words from |w0| of each row, and store it in
+ * |next|. If |nwt| < ceil(n/64) (only allowed if n is a multiple of
+ * 64), |a| and |b| must have room for (nr + 2T) * (nwt + 2) words,
+ * otherwise for (nr + 2T) * ceil(n/64) words; |buf| must have room
+ * for 6 * (nwt + 2) words.
+ */
+void advance_tile( const uint64_t *cur, uint64_t *next, int n, int r0, int nr, int w0, int nwt, int T,
+                   uint64_t *a, uint64_t *b, uint64_t *buf )
+{
+  const int nw = (n + 63) / 64;
+  const int ext = nr + 2*T;              /* rows in the buffer */
+  const int g = (nwt < nw ? 1 : 0);      /* extra words on each side */
+  const int tw = nwt + 2*g;              /* words per row in the buffer */
+  const int width = (g ? 64 * tw : n);   /* cells per row in the buffer */
+  uint64_t *tmp;
+  int k, t;
+
+  /* rows r0-T, ... r0+nr+T-1 and words w0-g, ... w0+nwt+g-1, wrapping
+     around the edges of the grid */
+  for (k=0; k<ext; k++) {
+    const uint64_t *row = cur + (size_t)(((r0 - T + k) % n + n) % n) * nw;
+    if ( g ) {
+      a[(size_t)k * tw] = row[(w0 - 1 + nw) % nw];
+      memcpy(a + (size_t)k * tw + 1, row + w0, nwt * sizeof(*a));
+      a[(size_t)k * tw + tw - 1] = row[(w0 + nwt) % nw];
+    } else {
+      memcpy(a + (size_t)k * tw, row, nw * sizeof(*a));
+    }
+  }
+  for (t=1; t<=T; t++) {
+    /* after t steps, only the rows t, ... ext-t-1 are valid */
+    step_band(a, b, width, ext, t, ext - t, buf);
+    tmp = a; a = b; b = tmp;
+  }
+  for (k=0; k<nr; k++) {
+    memcpy(next + (size_t)(r0 + k) * nw + w0, a + (size_t)(T + k) * tw + g, nwt * sizeof(*a));
+  }
+}
+
+/**
+ * Same as run_bits(), with temporal blocking: the grid is advanced by
+ * |T| steps at a time (1 <= T <= 64), one tile at a time.
+ */
+void run_tiled( uint64_t **cur, uint64_t **next, int n, int steps, int T )
+{
+  const int nw = (n + 63) / 64;
+  /* tiles of TILE_WORDS words per row, if n is a multiple of 64 */
+  const int nwt = (0 == n % 64 && nw > TILE_WORDS ? TILE_WORDS : nw);
+  const int tiles_x = (nw + nwt - 1) / nwt;
+  const int tiles_y = (n + TILE_ROWS - 1) / TILE_ROWS;
+  int s;
+#pragma omp parallel default(none) private(s) shared(cur, next, n, nw, nwt, tiles_x, tiles_y, steps, T)
+  {
+    const size_t bufsize = (size_t)(TILE_ROWS + 2*T) * (nwt + 2);
+    uint64_t *a = (uint64_t*)malloc(bufsize * sizeof(*a));
+    uint64_t *b = (uint64_t*)malloc(bufsize * sizeof(*b));
+    uint64_t *buf = (uint64_t*)malloc(6 * (nwt + 2) * sizeof(*buf));
+    int tile;
+
+    for (s=0; s<steps; s+=T) {
+      const int tt = (steps - s < T ? steps - s : T);
+#pragma omp for schedule(static)
+      for (tile=0; tile<tiles_x*tiles_y; tile++) {
+        const int r0 = (tile / tiles_x) * TILE_ROWS;
+        const int w0 = (tile % tiles_x) * nwt;
+        const int nr = (r0 + TILE_ROWS <= n ? TILE_ROWS : n - r0);
+        const int nwl = (w0 + nwt <= nw ? nwt : nw - w0);
+        advance_tile(*cur, *next, n, r0, nr, w0, nwl, tt, a, b, buf);
+      }
+      /* the implicit barrier of the omp for ensures that all the tiles
+         are done */
+#pragma omp single
+      {
+        uint64_t *tmp = *cur;
+        *cur = *next;
+        *next = tmp;
+      }
+    }
+    free(a);
+    free(b);
+    free(buf);
+  }
+}
+
+/* Pack the cells of |grid| (with ghost cells) into the rows of |bits| */
+void pack( cell_t *grid, int ext_n, uint64_t *bits )
+{
+  const int n = ext_n - 2, nw = (n + 63) / 64;
+  int i, j;
+  memset(bits, 0, (size_t)n * nw * sizeof(*bits));
+  for (i=0; i<n; i++) {
+    for (j=0; j<n; j++) {
+      bits[(size_t)i * nw + j/64] |= (uint64_t)*IDX(grid, ext_n, i+1, j+1) << (j%64);
+    }
+  }
+}
+
+/* Write the |n| x |n| bit-packed grid |bits| to file |fname| in
+   binary pbm (portable bitmap) format */
+void write_pbm( const uint64_t *bits, int n, const char *fname )
+{
+  const int nw = (n + 63) / 64, rowbytes = (n + 7) / 8;
+  unsigned char *buf = (unsigned char*)malloc(rowbytes);
+  int i, b, k;
+  FILE *f = fopen(fname, "wb");
+  if (!f) {
+    fprintf(stderr, "Cannot open %s for writing\n", fname);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f, "P4\n");
+  fprintf(f, "# produced by omp-anneal.c\n");
+  fprintf(f, "%d %d\n", n, n);
+  for (i=0; i<n; i++) {
+    /* PBM stores the leftmost cell of each byte in the most
+       significant bit */
+    for (b=0; b<rowbytes; b++) {
+      const unsigned v = (bits[(size_t)i * nw + b/8] >> (8*(b%8))) & 0xff;
+      unsigned char r = 0;
+      for (k=0; k<8; k++) {
+        r |= ((v >> k) & 1) << (7 - k);
+      }
+      buf[b] = r;
+    }
+    fwrite(buf, 1, rowbytes, f);
+  }
+  fclose(f);
+  free(buf);
+}
+
+/* Nonzero iff the bit-packed grid |bits| and the grid with ghost
+   cells |grid| hold the same state */
+int same_state( const uint64_t *bits, cell_t *grid, int n )
+{
+  const int nw = (n + 63) / 64, ext_n = n + 2;
+  int i, j, ok = 1;
+  for (i=0; i<n; i++) {
+    for (j=0; j<n; j++) {
+      ok &= ( ((bits[(size_t)i * nw + j/64] >> (j%64)) & 1) == *IDX(grid, ext_n, i+1, j+1) );
+    }
+  }
+  return ok;
+}
+
+int main( int argc, char* argv[] )
+{
+  char fname[128];
+  int s, i, j, nsteps = 64, n = 256, T = 16, ok;
+  uint64_t *cur, *next, *tcur;
+  cell_t *bcur = NULL, *bnext = NULL;
+  double tstart, t_bytes = 0.0, t_bits, t_tiled;
+
+  if ( argc > 4 ) {
+    fprintf(stderr, "Usage: %s [nsteps [n [T]]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if ( argc > 1 ) {
+    nsteps = atoi(argv[1]);
+  }
+  if ( argc > 2 ) {
+    n = atoi(argv[2]);
+  }
+  if ( argc > 3 ) {
+    T = atoi(argv[3]);
+  }
+  if ( n < 1 || T < 1 || T > 64 ) {
+    fprintf(stderr, "FATAL: the size must be positive, and T must be in 1-64\n");
+    return EXIT_FAILURE;
+  }
+
+  const int nw = (n + 63) / 64;
+  const size_t size = (size_t)n * nw * sizeof(uint64_t);
+  const int ext_n = n + 2;
+  const double nupdates = (double)n * n * nsteps;
+  cur = (uint64_t*)malloc(size);
+  next = (uint64_t*)malloc(size);
+  tcur = (uint64_t*)malloc(size);
+
+  printf("Anneal CA: steps=%d size=%d T=%d threads=%d\n", nsteps, n, T, omp_get_max_threads());
+
+  if ( n <= REF_MAX_N ) {
+    bcur = (cell_t*)calloc(ext_n * ext_n, sizeof(cell_t));
+    bnext = (cell_t*)calloc(ext_n * ext_n, sizeof(cell_t));
+    init(bcur, ext_n, 0.5);
+    pack(bcur, ext_n, cur);
+  } else {
+    /* too large for the reference version: random state, generated
+       directly in bit-packed form */
+    const uint64_t tailmask = (n % 64 ? ((uint64_t)1 << (n % 64)) - 1 : ~(uint64_t)0);
+    for (i=0; i<n; i++) {
+      for (j=0; j<nw; j++) {
+        cur[(size_t)i * nw + j] = ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+      }
+      cur[(size_t)i * nw + nw - 1] &= tailmask;
+    }
+  }
+  memcpy(tcur, cur, size);
+
+  if ( bcur ) {
+    tstart = omp_get_wtime();
+    for (s=0; s<nsteps; s++) {
+      cell_t *tmp;
+      copy_halo(bcur, ext_n);
+      step_bytes(bcur, bnext, ext_n);
+      tmp = bcur; bcur = bnext; bnext = tmp;
+    }
+    t_bytes = omp_get_wtime() - tstart;
+    printf("%-24s %8.3f s %10.3f Gcells/s\n", "bytes (reference)", t_bytes, 1e-9 * nupdates / t_bytes);
+  }
+
+  tstart = omp_get_wtime();
+  run_bits(&cur, &next, n, nsteps);
+  t_bits = omp_get_wtime() - tstart;
+  printf("%-24s %8.3f s %10.3f Gcells/s", "bit-sliced", t_bits, 1e-9 * nupdates / t_bits);
+  if ( bcur ) {
+    printf(", %6.1fx %s", t_bytes / t_bits, (same_state(cur, bcur, n) ? "OK" : "MISMATCH"));
+  }
+  printf("\n");
+
+  tstart = omp_get_wtime();
+  run_tiled(&tcur, &next, n, nsteps, T);
+  t_tiled = omp_get_wtime() - tstart;
+  ok = (0 == memcmp(cur, tcur, size));
+  printf("%-24s %8.3f s %10.3f Gcells/s, %6.1fx %s\n", "bit-sliced, tiled", t_tiled,
+         1e-9 * nupdates / t_tiled, t_bits / t_tiled, (ok ? "OK" : "MISMATCH"));
+
+  snprintf(fname, sizeof(fname), "anneal-%05d.pbm", nsteps);
+  write_pbm(tcur, n, fname);
+
+  free(bcur);
+  free(bnext);
+  free(cur);
+  free(next);
+  free(tcur);
+  return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// vim: set nofoldenable :
@@ -0,0 +1,165 @@
+/* */
+/****************************************************************************
+ *
+ * omp-eca.c - Elementary cellular automata with OpenMP
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Exercises the bit-packed engine of eca.h. The program first checks
+ * all the 256 rules, with every boundary condition, against a
+ * reference version that stores one cell per byte and looks up the
+ * next state in the rule number; the width is not a multiple of 64,
+ * to exercise the handling of the last word. Then it measures:
+ *
+ * - the throughput of eca_run() on a single large automaton, for a
+ *   few representative rules (chaotic, additive, universal, traffic,
+ *   identity), starting from a random state;
+ *
+ * - the throughput of eca_run_batch() on a batch of |nbatch| small
+ *   automata, one per rule (cycling through the 256 rules), each with
+ *   its own random initial state.
+ *
+ * Compile with:
+ *
+ * gcc -fopenmp -std=c99 -Wall -Wpedantic -O3 -march=native omp-eca.c -o omp-eca
+ *
+ * Run with:
+ *
+ * ./omp-eca [width [steps [nbatch [batch_width]]]]
+ *
+ ****************************************************************************/
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "eca.h"
+
+typedef signed char cell_t;
+
+/**
+ * Reference version: one cell per byte. |cur| and |next| have |n|
+ * cells plus one ghost cell on each side.
+ */
+void step_bytes( int rule, eca_boundary_t boundary, cell_t *cur, cell_t *next, int n )
+{
+  int i;
+  if ( ECA_PERIODIC == boundary ) {
+    cur[0] = cur[n];
+    cur[n+1] = cur[1];
+  } else {
+    cur[0] = cur[n+1] = (ECA_FIXED1 == boundary);
+  }
+  for (i=1; i<=n; i++) {
+    next[i] = (rule >> (4*cur[i-1] + 2*cur[i] + cur[i+1])) & 1;
+  }
+}
+
+/* Check every rule and boundary condition against step_bytes(); returns
+   the number of mismatches */
+int check( int width, int steps )
+{
+  cell_t *cur = (cell_t*)malloc(width + 2);
+  cell_t *next = (cell_t*)malloc(width + 2);
+  int rule, b, s, i, errors = 0;
+
+  for (rule=0; rule<256; rule++) {
+    for (b=ECA_PERIODIC; b<=ECA_FIXED1; b++) {
+      eca_t ca;
+      eca_init(&ca, rule, width, (eca_boundary_t)b);
+      eca_randomize(&ca, rule);
+      for (i=0; i<width; i++) {
+        cur[1+i] = eca_get(&ca, i);
+      }
+      for (s=0; s<steps; s++) {
+        cell_t *tmp;
+        step_bytes(rule, (eca_boundary_t)b, cur, next, width);
+        tmp = cur; cur = next; next = tmp;
+      }
+      eca_run(&ca, steps);
+      for (i=0; i<width; i++) {
+        if ( eca_get(&ca, i) != cur[1+i] ) {
+          fprintf(stderr, "MISMATCH: rule %d, %s boundary, cell %d\n", rule, eca_boundary_names[b], i);
+          errors++;
+          break;
+        }
+      }
+      eca_free(&ca);
+    }
+  }
+  free(cur);
+  free(next);
+  return errors;
+}
+
+int main( int argc, char* argv[] )
+{
+  int width = 1024*1024, steps = 10000, nbatch = 1024, batch_width = 4096, k, errors;
+  const int rules[] = { 30, 90, 110, 184, 150, 54, 204 };
+  const int nrules = sizeof(rules) / sizeof(rules[0]);
+  double tstart, t;
+  eca_t *batch;
+
+  if ( argc > 5 ) {
+    fprintf(stderr, "Usage: %s [width [steps [nbatch [batch_width]]]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if ( argc > 1 ) {
+    width = atoi(argv[1]);
+  }
+  if ( argc > 2 ) {
+    steps = atoi(argv[2]);
+  }
+  if ( argc > 3 ) {
+    nbatch = atoi(argv[3]);
+  }
+  if ( argc > 4 ) {
+    batch_width = atoi(argv[4]);
+  }
+  if ( width <= 0 || batch_width <= 0 || nbatch <= 0 ) {
+    fprintf(stderr, "FATAL: the widths and the batch size must be positive\n");
+    return EXIT_FAILURE;
+  }
+
+  errors = check(1000, 200);
+  printf("Check of 256 rules x 3 boundaries: %s\n", (errors ? "FAILED" : "OK"));
+
+  printf("\n%d cells, %d steps, %d threads\n", width, steps, omp_get_max_threads());
+  for (k=0; k<nrules; k++) {
+    eca_t ca;
+    eca_init(&ca, rules[k], width, ECA_PERIODIC);
+    eca_randomize(&ca, k);
+    tstart = omp_get_wtime();
+    eca_run(&ca, steps);
+    t = omp_get_wtime() - tstart;
+    printf("rule %3d %8.3f s %10.3f Gcells/s\n", rules[k], t, 1e-9 * width * steps / t);
+    eca_free(&ca);
+  }
+
+  printf("\nBatch of %d automata of %d cells (rules 0-255), %d steps\n", nbatch, batch_width, steps);
+  batch = (eca_t*)malloc(nbatch * sizeof(*batch));
+  for (k=0; k<nbatch; k++) {
+    eca_init(&batch[k], k % 256, batch_width, ECA_PERIODIC);
+    eca_randomize(&batch[k], k);
+  }
+  tstart = omp_get_wtime();
+  eca_run_batch(batch, nbatch, steps);
+  t = omp_get_wtime() - tstart;
+  printf("batch    %8.3f s %10.3f Gcells/s\n", t, 1e-9 * (double)nbatch * batch_width * steps / t);
+  for (k=0; k<nbatch; k++) {
+    eca_free(&batch[k]);
+  }
+  free(batch);
+
+  return (errors ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+// vim: set nofoldenable :
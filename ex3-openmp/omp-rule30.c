@@ -0,0 +1,247 @@
+/* */
+/****************************************************************************
+ *
+ * omp-rule30.c - Bit-packed Rule30 Cellular Automaton with OpenMP
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * The "rule 30 CA" (https://en.wikipedia.org/wiki/Rule_30) on a ring
+ * of |width| cells. The reference version (as in ex3-mpi/mpi-rule30.c)
+ * stores one cell per byte, and evaluates a four-term boolean
+ * expression for each cell. Rule 30 can be written as
+ *
+ *   next = left XOR (center OR right)
+ *
+ * that only uses bitwise operations, so 64 cells can be stored in a
+ * uint64_t and updated at once: cell i is bit (i % 64) of word i / 64,
+ * and the left and right neighbors of all the cells of a word are
+ * obtained by shifting the word by one bit and bringing in the
+ * boundary bit of the adjacent word. The same is done on vectors of 4
+ * or 8 words (256 or 512 bits) using the vector extensions of GCC,
+ * and the words are split among OpenMP threads.
+ *
+ * The program runs all the versions on the same initial state (a
+ * single 1 in the middle), checks that the results are the same, and
+ * prints the number of cell updates per second of each one.
+ *
+ * Compile with:
+ *
+ * gcc -fopenmp -std=c99 -Wall -Wpedantic -O3 -march=native omp-rule30.c -o omp-rule30
+ *
+ * Run with:
+ *
+ * ./omp-rule30 [width [steps]]
+ *
+ * |width| must be a multiple of 64.
+ *
+ ****************************************************************************/
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef signed char cell_t;
+
+typedef uint64_t v4w __attribute__((vector_size(32)));
+typedef uint64_t v8w __attribute__((vector_size(64)));
+
+/**
+ * Reference version: one cell per byte. |cur| and |next| have |n|
+ * cells plus one ghost cell on each side.
+ */
+void step_bytes( const cell_t *cur, cell_t *next, int n )
+{
+  int i;
+#pragma omp for schedule(static)
+  for (i=1; i<=n; i++) {
+    const cell_t east = cur[i-1];
+    const cell_t center = cur[i];
+    const cell_t west = cur[i+1];
+    next[i] = ( (east && !center && !west) ||
+                (!east && !center && west) ||
+                (!east && center && !west) ||
+                (!east && center && west) );
+  }
+}
+
+/**
+ * Compute the words lo, ... hi-1 of |next| from |cur|; the words lo-1
+ * and hi of |cur| must be valid (they may be ghost words).
+ */
+void step_words( const uint64_t *cur, uint64_t *next, int lo, int hi )
+{
+  int i;
+  for (i=lo; i<hi; i++) {
+    const uint64_t c = cur[i];
+    const uint64_t left = (c << 1) | (cur[i-1] >> 63);
+    const uint64_t right = (c >> 1) | (cur[i+1] << 63);
+    next[i] = left ^ (c | right);
+  }
+}
+
+/* Same as step_words(), 4 words at a time */
+void step_words_v4( const uint64_t *cur, uint64_t *next, int lo, int hi )
+{
+  int i;
+  for (i=lo; i+4<=hi; i+=4) {
+    v4w p, c, n;
+    memcpy(&p, cur + i - 1, sizeof(p));
+    memcpy(&c, cur + i, sizeof(c));
+    memcpy(&n, cur + i + 1, sizeof(n));
+    const v4w r = ((c << 1) | (p >> 63)) ^ (c | ((c >> 1) | (n << 63)));
+    memcpy(next + i, &r, sizeof(r));
+  }
+  step_words(cur, next, i, hi);
+}
+
+/* Same as step_words(), 8 words at a time */
+void step_words_v8( const uint64_t *cur, uint64_t *next, int lo, int hi )
+{
+  int i;
+  for (i=lo; i+8<=hi; i+=8) {
+    v8w p, c, n;
+    memcpy(&p, cur + i - 1, sizeof(p));
+    memcpy(&c, cur + i, sizeof(c));
+    memcpy(&n, cur + i + 1, sizeof(n));
+    const v8w r = ((c << 1) | (p >> 63)) ^ (c | ((c >> 1) | (n << 63)));
+    memcpy(next + i, &r, sizeof(r));
+  }
+  step_words(cur, next, i, hi);
+}
+
+typedef void (*kernel_t)( const uint64_t *, uint64_t *, int, int );
+
+/**
+ * Run |steps| steps of the bit-packed CA of |nwords| words (plus one
+ * ghost word on each side) in |*cur|, using |*next| as scratch space;
+ * on return, |*cur| holds the final state. Each thread updates a
+ * contiguous range of words, aligned to 8 words.
+ */
+void run_bits( uint64_t **cur, uint64_t **next, int nwords, int steps, kernel_t kernel )
+{
+  int s;
+#pragma omp parallel default(none) private(s) shared(cur, next, nwords, steps, kernel)
+  {
+    const int nt = omp_get_num_threads();
+    const int id = omp_get_thread_num();
+    const int nblocks = (nwords + 7) / 8;
+    const int lo = 1 + 8 * (int)((long)nblocks * id / nt);
+    const int hi_block = 1 + 8 * (int)((long)nblocks * (id + 1) / nt);
+    const int hi = (hi_block < nwords + 1 ? hi_block : nwords + 1);
+
+    for (s=0; s<steps; s++) {
+#pragma omp single
+      {
+        /* periodic boundary */
+        (*cur)[0] = (*cur)[nwords];
+        (*cur)[nwords+1] = (*cur)[1];
+      }
+      kernel(*cur, *next, lo, hi);
+#pragma omp barrier
+#pragma omp single
+      {
+        uint64_t *tmp = *cur;
+        *cur = *next;
+        *next = tmp;
+      }
+    }
+  }
+}
+
+/* Same as run_bits(), for the reference version */
+void run_bytes( cell_t **cur, cell_t **next, int n, int steps )
+{
+  int s;
+#pragma omp parallel default(none) private(s) shared(cur, next, n, steps)
+  for (s=0; s<steps; s++) {
+#pragma omp single
+    {
+      (*cur)[0] = (*cur)[n];
+      (*cur)[n+1] = (*cur)[1];
+    }
+    step_bytes(*cur, *next, n);
+#pragma omp single
+    {
+      cell_t *tmp = *cur;
+      *cur = *next;
+      *next = tmp;
+    }
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  int width = 1024*1024, steps = 1000, nwords, i, k;
+  cell_t *cur, *next;
+  uint64_t *bcur, *bnext, *initial;
+  double tstart, t_bytes;
+  const struct { const char *name; kernel_t kernel; } engines[] = {
+    { "bits (64-bit words)", step_words },
+    { "bits (256-bit vectors)", step_words_v4 },
+    { "bits (512-bit vectors)", step_words_v8 }
+  };
+
+  if ( argc > 3 ) {
+    fprintf(stderr, "Usage: %s [width [steps]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if ( argc > 1 ) {
+    width = atoi(argv[1]);
+  }
+  if ( argc > 2 ) {
+    steps = atoi(argv[2]);
+  }
+  if ( width <= 0 || width % 64 ) {
+    fprintf(stderr, "FATAL: the width (%d) must be a positive multiple of 64\n", width);
+    return EXIT_FAILURE;
+  }
+  nwords = width / 64;
+
+  cur = (cell_t*)calloc(width + 2, sizeof(*cur));
+  next = (cell_t*)calloc(width + 2, sizeof(*next));
+  cur[1 + width/2] = 1;
+  initial = (uint64_t*)calloc(nwords + 2, sizeof(*initial));
+  initial[1 + (width/2) / 64] = (uint64_t)1 << ((width/2) % 64);
+  bcur = (uint64_t*)malloc((nwords + 2) * sizeof(*bcur));
+  bnext = (uint64_t*)calloc(nwords + 2, sizeof(*bnext));
+
+  printf("%d cells, %d steps, %d threads\n", width, steps, omp_get_max_threads());
+
+  tstart = omp_get_wtime();
+  run_bytes(&cur, &next, width, steps);
+  t_bytes = omp_get_wtime() - tstart;
+  printf("%-24s %8.3f s %10.3f Gcells/s\n", "bytes (reference)", t_bytes, 1e-9 * width * steps / t_bytes);
+
+  for (k=0; k<(int)(sizeof(engines)/sizeof(engines[0])); k++) {
+    double t;
+    int ok = 1;
+
+    memcpy(bcur, initial, (nwords + 2) * sizeof(*bcur));
+    tstart = omp_get_wtime();
+    run_bits(&bcur, &bnext, nwords, steps, engines[k].kernel);
+    t = omp_get_wtime() - tstart;
+    for (i=0; i<width; i++) {
+      ok &= ( ((bcur[1 + i/64] >> (i%64)) & 1) == (uint64_t)cur[1 + i] );
+    }
+    printf("%-24s %8.3f s %10.3f Gcells/s, %6.1fx %s\n", engines[k].name, t,
+           1e-9 * width * steps / t, t_bytes / t, (ok ? "OK" : "MISMATCH"));
+  }
+
+  free(cur);
+  free(next);
+  free(initial);
+  free(bcur);
+  free(bnext);
+  return EXIT_SUCCESS;
+}
+
+// vim: set nofoldenable :